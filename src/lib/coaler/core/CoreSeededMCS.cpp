@@ -0,0 +1,448 @@
+#include "CoreSeededMCS.hpp"
+
+#include <GraphMol/MolOps.h>
+#include <GraphMol/RWMol.h>
+
+#include <algorithm>
+#include <list>
+#include <optional>
+#include <queue>
+#include <set>
+#include <unordered_map>
+
+namespace {
+    const int UNMAPPED = -1;
+
+    // the number of mapped side chain atoms outweighs the preference for atoms of the same element
+    const unsigned SIDE_CHAIN_SIZE_WEIGHT = 2;
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool is_ring_atom(const RDKit::Atom &atom) {
+        return atom.getOwningMol().getRingInfo()->numAtomRings(atom.getIdx()) > 0;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool is_chiral(const RDKit::Atom &atom) {
+        return atom.getChiralTag() == RDKit::Atom::CHI_TETRAHEDRAL_CW
+               || atom.getChiralTag() == RDKit::Atom::CHI_TETRAHEDRAL_CCW;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // the chiral tags depend on the order of the bonds, they are only compared after growing by
+    // has_same_chirality()
+    bool atoms_compatible(const RDKit::Atom &first, const RDKit::Atom &second, bool strict) {
+        if (first.getAtomicNum() == 1 || second.getAtomicNum() == 1 || is_ring_atom(first) != is_ring_atom(second)) {
+            return false;
+        }
+        if (!strict) {
+            return true;
+        }
+        return first.getAtomicNum() == second.getAtomicNum() && first.getFormalCharge() == second.getFormalCharge()
+               && is_chiral(first) == is_chiral(second);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool bonds_compatible(const RDKit::Bond *first, const RDKit::Bond *second, bool strict) {
+        if (first == nullptr || second == nullptr) {
+            return first == second;
+        }
+        return !strict || first->getBondType() == second->getBondType();
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    /**
+     * Atom mapping between two molecules in both directions.
+     */
+    struct Mapping {
+        std::vector<int> forward;
+        std::vector<int> reverse;
+
+        void map(unsigned firstId, unsigned secondId) {
+            forward.at(firstId) = static_cast<int>(secondId);
+            reverse.at(secondId) = static_cast<int>(firstId);
+        }
+
+        void unmap(unsigned firstId) {
+            reverse.at(forward.at(firstId)) = UNMAPPED;
+            forward.at(firstId) = UNMAPPED;
+        }
+    };
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // the pair (firstId, secondId) has to have the same bonds to all mapped atoms in both molecules
+    bool is_consistent(const RDKit::ROMol &first, const RDKit::ROMol &second, const Mapping &mapping,
+                       unsigned firstId, unsigned secondId, bool strict) {
+        for (const auto &neighborId :
+             boost::make_iterator_range(first.getAtomNeighbors(first.getAtomWithIdx(firstId)))) {
+            const int mappedId = mapping.forward.at(neighborId);
+            if (mappedId != UNMAPPED
+                && !bonds_compatible(first.getBondBetweenAtoms(firstId, neighborId),
+                                     second.getBondBetweenAtoms(secondId, mappedId), strict)) {
+                return false;
+            }
+        }
+        for (const auto &neighborId :
+             boost::make_iterator_range(second.getAtomNeighbors(second.getAtomWithIdx(secondId)))) {
+            const int mappedId = mapping.reverse.at(neighborId);
+            if (mappedId != UNMAPPED && first.getBondBetweenAtoms(firstId, mappedId) == nullptr) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // maps unmapped neighbors of the atoms in @param frontier to the first compatible neighbor of their partner,
+    // returns the number of newly mapped atoms
+    unsigned grow_greedily(const RDKit::ROMol &first, const RDKit::ROMol &second, Mapping &mapping, bool strict,
+                           std::queue<unsigned> frontier) {
+        unsigned numMapped = 0;
+        while (!frontier.empty()) {
+            const unsigned firstId = frontier.front();
+            frontier.pop();
+            const auto secondId = static_cast<unsigned>(mapping.forward.at(firstId));
+
+            for (const auto &firstNeighbor :
+                 boost::make_iterator_range(first.getAtomNeighbors(first.getAtomWithIdx(firstId)))) {
+                if (mapping.forward.at(firstNeighbor) != UNMAPPED) {
+                    continue;
+                }
+                for (const auto &secondNeighbor :
+                     boost::make_iterator_range(second.getAtomNeighbors(second.getAtomWithIdx(secondId)))) {
+                    if (mapping.reverse.at(secondNeighbor) == UNMAPPED
+                        && atoms_compatible(*first.getAtomWithIdx(firstNeighbor),
+                                            *second.getAtomWithIdx(secondNeighbor), strict)
+                        && is_consistent(first, second, mapping, firstNeighbor, secondNeighbor, strict)) {
+                        mapping.map(firstNeighbor, secondNeighbor);
+                        frontier.push(firstNeighbor);
+                        numMapped++;
+                        break;
+                    }
+                }
+            }
+        }
+        return numMapped;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // finds the assignment of the candidates in @param weights (rows: first neighbors, columns: second neighbors, 0 if
+    // not compatible) with the largest total weight, atoms have only a handful of neighbors so all are enumerated
+    void find_best_assignment(const std::vector<std::vector<unsigned>> &weights, unsigned row,
+                              std::vector<bool> &usedColumns, std::vector<int> &assignment, unsigned weight,
+                              std::vector<int> &bestAssignment, unsigned &bestWeight) {
+        if (row == weights.size()) {
+            if (weight > bestWeight) {
+                bestWeight = weight;
+                bestAssignment = assignment;
+            }
+            return;
+        }
+
+        assignment.at(row) = UNMAPPED;
+        find_best_assignment(weights, row + 1, usedColumns, assignment, weight, bestAssignment, bestWeight);
+        for (unsigned column = 0; column < usedColumns.size(); column++) {
+            if (usedColumns.at(column) || weights.at(row).at(column) == 0) {
+                continue;
+            }
+            usedColumns.at(column) = true;
+            assignment.at(row) = static_cast<int>(column);
+            find_best_assignment(weights, row + 1, usedColumns, assignment, weight + weights.at(row).at(column),
+                                 bestAssignment, bestWeight);
+            usedColumns.at(column) = false;
+        }
+        assignment.at(row) = UNMAPPED;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // the side chains of a mapped atom pair are not mapped to the first compatible neighbors, but by the assignment of
+    // neighbors that maps the most atoms. The size of the side chain behind a neighbor pair is estimated by growing
+    // it greedily, atoms of the same element are preferred on ties.
+    void grow_side_chains(const RDKit::ROMol &first, const RDKit::ROMol &second, Mapping &mapping, bool strict) {
+        std::queue<unsigned> frontier;
+        for (unsigned firstId = 0; firstId < first.getNumAtoms(); firstId++) {
+            if (mapping.forward.at(firstId) != UNMAPPED) {
+                frontier.push(firstId);
+            }
+        }
+
+        while (!frontier.empty()) {
+            const unsigned firstId = frontier.front();
+            frontier.pop();
+            const auto secondId = static_cast<unsigned>(mapping.forward.at(firstId));
+
+            std::vector<unsigned> firstNeighbors;
+            for (const auto &neighborId :
+                 boost::make_iterator_range(first.getAtomNeighbors(first.getAtomWithIdx(firstId)))) {
+                if (mapping.forward.at(neighborId) == UNMAPPED) {
+                    firstNeighbors.push_back(neighborId);
+                }
+            }
+            std::vector<unsigned> secondNeighbors;
+            for (const auto &neighborId :
+                 boost::make_iterator_range(second.getAtomNeighbors(second.getAtomWithIdx(secondId)))) {
+                if (mapping.reverse.at(neighborId) == UNMAPPED) {
+                    secondNeighbors.push_back(neighborId);
+                }
+            }
+
+            std::vector<std::vector<unsigned>> weights(firstNeighbors.size(),
+                                                       std::vector<unsigned>(secondNeighbors.size(), 0));
+            for (unsigned row = 0; row < firstNeighbors.size(); row++) {
+                const auto *firstAtom = first.getAtomWithIdx(firstNeighbors.at(row));
+                for (unsigned column = 0; column < secondNeighbors.size(); column++) {
+                    const auto *secondAtom = second.getAtomWithIdx(secondNeighbors.at(column));
+                    if (!atoms_compatible(*firstAtom, *secondAtom, strict)
+                        || !is_consistent(first, second, mapping, firstAtom->getIdx(), secondAtom->getIdx(),
+                                          strict)) {
+                        continue;
+                    }
+
+                    Mapping lookahead = mapping;
+                    lookahead.map(firstAtom->getIdx(), secondAtom->getIdx());
+                    std::queue<unsigned> start;
+                    start.push(firstAtom->getIdx());
+                    const unsigned size = 1 + grow_greedily(first, second, lookahead, strict, start);
+                    const unsigned sameElement = firstAtom->getAtomicNum() == secondAtom->getAtomicNum() ? 1 : 0;
+                    weights.at(row).at(column) = size * SIDE_CHAIN_SIZE_WEIGHT + sameElement;
+                }
+            }
+
+            std::vector<bool> usedColumns(secondNeighbors.size(), false);
+            std::vector<int> assignment(firstNeighbors.size(), UNMAPPED);
+            std::vector<int> bestAssignment = assignment;
+            unsigned bestWeight = 0;
+            find_best_assignment(weights, 0, usedColumns, assignment, 0, bestAssignment, bestWeight);
+
+            for (unsigned row = 0; row < firstNeighbors.size(); row++) {
+                if (bestAssignment.at(row) == UNMAPPED) {
+                    continue;
+                }
+                // neighbors that are bonded to each other can exclude each other
+                const unsigned firstNeighbor = firstNeighbors.at(row);
+                const unsigned secondNeighbor = secondNeighbors.at(bestAssignment.at(row));
+                if (is_consistent(first, second, mapping, firstNeighbor, secondNeighbor, strict)) {
+                    mapping.map(firstNeighbor, secondNeighbor);
+                    frontier.push(firstNeighbor);
+                }
+            }
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // compares the chirality of a mapped atom pair in the bond order of @param first. Chirality that depends on more
+    // than one unmapped neighbor can not be compared and is accepted.
+    bool has_same_chirality(const RDKit::ROMol &first, const RDKit::ROMol &second, const Mapping &mapping,
+                            unsigned firstId, unsigned secondId) {
+        const auto *firstAtom = first.getAtomWithIdx(firstId);
+        const auto *secondAtom = second.getAtomWithIdx(secondId);
+        if (!is_chiral(*firstAtom) || !is_chiral(*secondAtom)) {
+            return is_chiral(*firstAtom) == is_chiral(*secondAtom);
+        }
+        if (firstAtom->getDegree() != secondAtom->getDegree()) {
+            return true;
+        }
+
+        int unmappedSecondBond = UNMAPPED;
+        for (const auto &bond : boost::make_iterator_range(second.getAtomBonds(secondAtom))) {
+            if (mapping.reverse.at(second[bond]->getOtherAtomIdx(secondId)) == UNMAPPED) {
+                if (unmappedSecondBond != UNMAPPED) {
+                    return true;
+                }
+                unmappedSecondBond = static_cast<int>(second[bond]->getIdx());
+            }
+        }
+
+        // the bonds of the second atom in the order of the corresponding bonds of the first atom
+        std::list<int> probe;
+        for (const auto &bond : boost::make_iterator_range(first.getAtomBonds(firstAtom))) {
+            const int secondNeighbor = mapping.forward.at(first[bond]->getOtherAtomIdx(firstId));
+            if (secondNeighbor == UNMAPPED) {
+                probe.push_back(unmappedSecondBond);
+            } else {
+                probe.push_back(static_cast<int>(second.getBondBetweenAtoms(secondId, secondNeighbor)->getIdx()));
+            }
+        }
+
+        const bool inverted = secondAtom->getPerturbationOrder(probe) % 2 == 1;
+        return (firstAtom->getChiralTag() == secondAtom->getChiralTag()) != inverted;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // unmaps side chain atoms whose chirality differs in both molecules
+    void prune_chirality(const RDKit::ROMol &first, const RDKit::ROMol &second, Mapping &mapping,
+                         const std::vector<bool> &isCore) {
+        std::vector<unsigned> mismatched;
+        for (unsigned firstId = 0; firstId < first.getNumAtoms(); firstId++) {
+            const int secondId = mapping.forward.at(firstId);
+            if (secondId != UNMAPPED && !isCore.at(firstId)
+                && !has_same_chirality(first, second, mapping, firstId, secondId)) {
+                mismatched.push_back(firstId);
+            }
+        }
+        for (const auto firstId : mismatched) {
+            mapping.unmap(firstId);
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool is_partially_mapped(const std::vector<int> &ring, const std::vector<int> &mapping) {
+        const auto numMapped
+            = std::count_if(ring.begin(), ring.end(), [&](int atomId) { return mapping.at(atomId) != UNMAPPED; });
+        return numMapped > 0 && numMapped < static_cast<long>(ring.size());
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // unmaps side chain atoms of rings that are only partially mapped in either molecule and everything that is no
+    // longer connected to the core afterwards
+    void prune_incomplete_rings(const RDKit::ROMol &first, const RDKit::ROMol &second, Mapping &mapping,
+                                const std::vector<bool> &isCore) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (const auto &ring : first.getRingInfo()->atomRings()) {
+                if (!is_partially_mapped(ring, mapping.forward)) {
+                    continue;
+                }
+                for (const auto atomId : ring) {
+                    if (mapping.forward.at(atomId) != UNMAPPED && !isCore.at(atomId)) {
+                        mapping.unmap(atomId);
+                        changed = true;
+                    }
+                }
+            }
+            for (const auto &ring : second.getRingInfo()->atomRings()) {
+                if (!is_partially_mapped(ring, mapping.reverse)) {
+                    continue;
+                }
+                for (const auto atomId : ring) {
+                    const int firstId = mapping.reverse.at(atomId);
+                    if (firstId != UNMAPPED && !isCore.at(firstId)) {
+                        mapping.unmap(firstId);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        std::vector<bool> connected(first.getNumAtoms(), false);
+        std::queue<unsigned> queue;
+        for (unsigned atomId = 0; atomId < first.getNumAtoms(); atomId++) {
+            if (isCore.at(atomId)) {
+                connected.at(atomId) = true;
+                queue.push(atomId);
+            }
+        }
+        while (!queue.empty()) {
+            const unsigned atomId = queue.front();
+            queue.pop();
+            for (const auto &neighborId :
+                 boost::make_iterator_range(first.getAtomNeighbors(first.getAtomWithIdx(atomId)))) {
+                if (!connected.at(neighborId) && mapping.forward.at(neighborId) != UNMAPPED) {
+                    connected.at(neighborId) = true;
+                    queue.push(neighborId);
+                }
+            }
+        }
+        for (unsigned atomId = 0; atomId < first.getNumAtoms(); atomId++) {
+            if (!connected.at(atomId) && mapping.forward.at(atomId) != UNMAPPED) {
+                mapping.unmap(atomId);
+            }
+        }
+    }
+}  // namespace
+
+/*----------------------------------------------------------------------------------------------------------------*/
+
+namespace coaler::core {
+    PairwiseMCS CoreSeededMCS::grow(const RDKit::ROMol &first, const RDKit::ROMol &second,
+                                    const RDKit::MatchVectType &firstCoreMatch,
+                                    const std::vector<RDKit::MatchVectType> &secondCoreMatches, bool strict) {
+        // every match of the core in the second molecule is a different correspondence of the core atoms
+        std::optional<Mapping> bestMapping;
+        long bestSize = 0;
+        for (const auto &secondCoreMatch : secondCoreMatches) {
+            Mapping mapping{std::vector<int>(first.getNumAtoms(), UNMAPPED),
+                            std::vector<int>(second.getNumAtoms(), UNMAPPED)};
+            std::unordered_map<int, int> coreToSecond(secondCoreMatch.begin(), secondCoreMatch.end());
+            // the core query may generalize elements and bond orders, so the strict MCS only keeps the core atoms
+            // that are compatible like the side chain atoms
+            std::vector<bool> isCore(first.getNumAtoms(), false);
+            for (const auto &[queryId, firstId] : firstCoreMatch) {
+                const int secondId = coreToSecond.at(queryId);
+                if (strict
+                    && (!atoms_compatible(*first.getAtomWithIdx(firstId), *second.getAtomWithIdx(secondId), true)
+                        || !is_consistent(first, second, mapping, firstId, secondId, true))) {
+                    continue;
+                }
+                mapping.map(firstId, secondId);
+                isCore.at(firstId) = true;
+            }
+
+            grow_side_chains(first, second, mapping, strict);
+            if (strict) {
+                prune_chirality(first, second, mapping, isCore);
+            }
+            prune_incomplete_rings(first, second, mapping, isCore);
+
+            const long size = std::count_if(mapping.forward.begin(), mapping.forward.end(),
+                                            [](int secondId) { return secondId != UNMAPPED; });
+            if (size > bestSize) {
+                bestSize = size;
+                bestMapping = std::move(mapping);
+            }
+        }
+
+        if (!bestMapping.has_value()) {
+            return {};
+        }
+
+        RDKit::MatchVectType firstMatch;
+        RDKit::MatchVectType secondMatch;
+        std::vector<std::set<int>> atomicNums;
+        for (unsigned firstId = 0; firstId < first.getNumAtoms(); firstId++) {
+            const int secondId = bestMapping->forward.at(firstId);
+            if (secondId == UNMAPPED) {
+                continue;
+            }
+            const auto queryId = static_cast<int>(firstMatch.size());
+            firstMatch.emplace_back(queryId, firstId);
+            secondMatch.emplace_back(queryId, secondId);
+            atomicNums.push_back({first.getAtomWithIdx(firstId)->getAtomicNum(),
+                                  second.getAtomWithIdx(secondId)->getAtomicNum()});
+        }
+
+        // the fragment of the mapped atoms, removing them from the back keeps the atom ids equal to the query ids
+        RDKit::RWMol fragment(first);
+        for (int firstId = static_cast<int>(first.getNumAtoms()) - 1; firstId >= 0; firstId--) {
+            if (bestMapping->forward.at(firstId) == UNMAPPED) {
+                fragment.removeAtom(static_cast<unsigned>(firstId));
+            }
+        }
+        RDKit::MolOps::findSSSR(fragment);
+        std::vector<std::set<RDKit::Bond::BondType>> bondTypes;
+        for (const auto *bond : fragment.bonds()) {
+            const auto firstBegin = firstMatch.at(bond->getBeginAtomIdx()).second;
+            const auto firstEnd = firstMatch.at(bond->getEndAtomIdx()).second;
+            const auto secondBegin = secondMatch.at(bond->getBeginAtomIdx()).second;
+            const auto secondEnd = secondMatch.at(bond->getEndAtomIdx()).second;
+            bondTypes.push_back({first.getBondBetweenAtoms(firstBegin, firstEnd)->getBondType(),
+                                 second.getBondBetweenAtoms(secondBegin, secondEnd)->getBondType()});
+        }
+
+        // the SMARTS is generalized like the core, so it matches both molecules
+        return std::make_tuple(firstMatch, secondMatch, Matcher::getGeneralizedSmarts(fragment, atomicNums, bondTypes));
+    }
+}  // namespace coaler::core
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <GraphMol/ROMol.h>
+#include <GraphMol/Substruct/SubstructMatch.h>
+
+#include <vector>
+
+#include "Matcher.hpp"
+
+/**
+ * @file CoreSeededMCS.hpp
+ * @brief This file contains the CoreSeededMCS class which grows the MCS of a ligand pair from a shared core.
+ */
+namespace coaler::core {
+
+    /**
+     * The CoreSeededMCS class calculates a common substructure of two molecules by growing the side chains from a
+     * known correspondence of their core atoms.
+     *
+     * Starting from the core, unmapped neighbors of mapped atom pairs are added if the atoms and bonds are compatible
+     * and the new pair is consistent with all bonds to already mapped atoms. The neighbors of a mapped pair are
+     * assigned to each other such that the most side chain atoms behind them can be mapped. Afterwards side chain
+     * atoms of different chirality and incompletely mapped rings are pruned, so the result follows the complete rings
+     * only semantics of the MCS parameters. For the strict MCS, core atoms that are not strictly compatible (e.g.
+     * atoms of a generalized element query) are left out as well.
+     *
+     * The search only touches side chain atoms. Every compatible neighbor pair is scored by growing the side chain
+     * behind it greedily, so the growth is quadratic in the number of side chain atoms in the worst case, but
+     * independent of the core size and without the backtracking of findMCS.
+     */
+    class CoreSeededMCS {
+      public:
+        /**
+         * Grow the common substructure of @param first and @param second.
+         * @param firstCoreMatch Match of the core in @param first.
+         * @param secondCoreMatches All matches of the core in @param second, the largest result is returned.
+         * @param strict Whether atoms and bonds have to match like for the strict MCS parameters (element, charge,
+         * chirality, bond order) or only the ring membership like for the relaxed ones.
+         * @return The common substructure with matches in order (first, second). The query atom ids enumerate the
+         * mapped atoms, the SMARTS describes the fragment of @param first with the elements and bond types of both
+         * molecules. Empty if there is no core match.
+         */
+        static PairwiseMCS grow(const RDKit::ROMol& first, const RDKit::ROMol& second,
+                                const RDKit::MatchVectType& firstCoreMatch,
+                                const std::vector<RDKit::MatchVectType>& secondCoreMatches, bool strict);
+    };
+}  // namespace coaler::core
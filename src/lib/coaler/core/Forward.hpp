@@ -1,3 +1,8 @@
 #pragma once
 
 #include "Matcher.hpp"
+#include "PairwiseMCSCalculator.hpp"
+#include "PairwiseMCSProvider.hpp"
+#include "CoreSeededMCS.hpp"
+#include "ThreadBudget.hpp"
+#include "TaskGraph.hpp"
@@ -3,24 +3,178 @@
 #include <omp.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <boost/dynamic_bitset.hpp>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <set>
+
 #include "GraphMol/ChemTransforms/ChemTransforms.h"
 #include "GraphMol/DistGeomHelpers/Embedder.h"
 #include "GraphMol/FMCS/FMCS.h"
 #include "GraphMol/ForceFieldHelpers/UFF/UFF.h"
+#include "GraphMol/QueryAtom.h"
+#include "GraphMol/QueryBond.h"
+#include "GraphMol/QueryOps.h"
 #include "GraphMol/RWMol.h"
 #include "GraphMol/SmilesParse/SmartsWrite.h"
+#include "GraphMol/SmilesParse/SmilesParse.h"
 #include "GraphMol/SmilesParse/SmilesWrite.h"
+#include "PairwiseMCSCalculator.hpp"
+#include "ThreadBudget.hpp"
 
 namespace {
-    RDKit::SubstructMatchParameters get_optimizer_substruct_params() {
-        RDKit::SubstructMatchParameters substructMatchParams;
-        substructMatchParams.uniquify = true;
-        substructMatchParams.useChirality = false;
-        substructMatchParams.useQueryQueryMatches = false;
-        substructMatchParams.maxMatches = 1;
-        substructMatchParams.numThreads = 1;
-        substructMatchParams.useEnhancedStereo = false;
-        return substructMatchParams;
+    // number of molecules whose MCS is calculated together on each level of the hierarchical core search
+    const unsigned CORE_GROUP_SIZE = 2;
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    /**
+     * @return the fragment of @param mol matched by @param query with perceived rings, nullptr if there is no match
+     */
+    RDKit::ROMOL_SPTR extract_mcs_fragment(const RDKit::ROMol &mol, const RDKit::ROMol &query) {
+        RDKit::SubstructMatchParameters params;
+        params.useChirality = false;
+        params.maxMatches = 1;
+        auto matches = RDKit::SubstructMatch(mol, query, params);
+        if (matches.empty()) {
+            return nullptr;
+        }
+
+        std::vector<bool> keep(mol.getNumAtoms(), false);
+        for (const auto &[queryId, molId] : matches.front()) {
+            keep.at(molId) = true;
+        }
+
+        // deletion of atoms needs to be in order of atomIdx (high to low)
+        auto fragment = boost::make_shared<RDKit::RWMol>(mol);
+        for (int atomId = static_cast<int>(mol.getNumAtoms()) - 1; atomId >= 0; atomId--) {
+            if (!keep.at(atomId)) {
+                fragment->removeAtom(atomId);
+            }
+        }
+        fragment->updatePropertyCache(false);
+        RDKit::MolOps::findSSSR(*fragment);
+
+        return fragment;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // query of ring atoms if @param inRing is set, of chain atoms otherwise
+    RDKit::ATOM_EQUALS_QUERY *make_ring_query(bool inRing) {
+        auto *query = RDKit::makeAtomInRingQuery();
+        query->setNegation(!inRing);
+        return query;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // cores smaller than this fraction of the smallest molecule are only used if no variant finds a larger one
+    const double PORTFOLIO_MIN_CORE_SIZE_FACTOR = 0.2;
+
+    struct PortfolioVariant {
+        std::string name;
+        RDKit::MCSParameters params;
+    };
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::vector<PortfolioVariant> get_portfolio_variants() {
+        std::vector<PortfolioVariant> variants;
+
+        auto params = coaler::core::Matcher::getCoreMCSParams();
+        variants.push_back({"default", params});
+
+        params.Timeout = 10;
+        variants.push_back({"extended timeout", params});
+
+        params = coaler::core::Matcher::getCoreMCSParams();
+        params.Timeout = 5;
+        params.BondCompareParameters.RingMatchesRingOnly = true;
+        variants.push_back({"ring bonds match ring bonds only", params});
+
+        params = coaler::core::Matcher::getCoreMCSParams();
+        params.Timeout = 5;
+        params.AtomCompareParameters.CompleteRingsOnly = false;
+        params.BondCompareParameters.CompleteRingsOnly = false;
+        params.BondCompareParameters.MatchFusedRings = false;
+        variants.push_back({"partial rings", params});
+
+        params = coaler::core::Matcher::getCoreMCSParams();
+        params.Timeout = 5;
+        params.Threshold = 0.9;
+        variants.push_back({"threshold 0.9", params});
+
+        return variants;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // size of the best valid core of the variants that finished their search
+    struct PortfolioBest {
+        std::mutex mutex;
+        unsigned numAtoms{0};
+    };
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    struct PortfolioProgress {
+        std::chrono::steady_clock::time_point start;
+        unsigned timeout;
+        unsigned upperBound;
+        PortfolioBest *best;
+        // set if the variant was cancelled because it can not win, its partial core is not a result
+        bool pruned{false};
+    };
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // replaces the default timeout callback of RDKit, so it has to enforce the timeout as well
+    bool portfolio_progress_callback(const RDKit::MCSProgressData & /*stat*/, const RDKit::MCSParameters & /*params*/,
+                                     void *userData) {
+        auto *progress = static_cast<PortfolioProgress *>(userData);
+        const auto elapsed = std::chrono::steady_clock::now() - progress->start;
+
+        {
+            const std::lock_guard<std::mutex> lock(progress->best->mutex);
+            // the variant can not find a larger core than the best finished variant anymore
+            if (progress->best->numAtoms >= progress->upperBound) {
+                progress->pruned = true;
+                return false;
+            }
+        }
+
+        return progress->timeout == 0 || elapsed < std::chrono::seconds(progress->timeout);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    /**
+     * @return the largest possible core of an MCS search with @param threshold, i.e. the heavy atom count of the
+     * smallest molecule among the molecules the MCS has to be contained in
+     */
+    unsigned get_core_size_upper_bound(const RDKit::MOL_SPTR_VECT &mols, double threshold) {
+        std::vector<unsigned> numAtoms;
+        numAtoms.reserve(mols.size());
+        for (const auto &mol : mols) {
+            numAtoms.push_back(mol->getNumAtoms());
+        }
+        std::sort(numAtoms.begin(), numAtoms.end(), std::greater<>());
+
+        const auto numRequired = static_cast<std::size_t>(std::ceil(threshold * static_cast<double>(mols.size())));
+        return numAtoms.at(std::clamp<std::size_t>(numRequired, 1, numAtoms.size()) - 1);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool core_matches_all(const RDKit::MOL_SPTR_VECT &mols, const RDKit::ROMol &core) {
+        RDKit::SubstructMatchParameters params;
+        params.useChirality = false;
+        params.maxMatches = 1;
+        return std::all_of(mols.begin(), mols.end(),
+                           [&](const auto &mol) { return !RDKit::SubstructMatch(*mol, core, params).empty(); });
     }
 }  // namespace
 
@@ -43,12 +197,141 @@ namespace coaler::core {
 
         spdlog::info("mcs: {}", mcs.SmartsString);
 
+        return this->buildCoreResult(mols, mcs.QueryMol);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::optional<CoreResult> Matcher::calculateCoreHierarchical(RDKit::MOL_SPTR_VECT &mols) {
+        RDKit::MOL_SPTR_VECT molsWithoutHs;
+        for (auto &mol : mols) {
+            molsWithoutHs.push_back(RDKit::ROMOL_SPTR(RDKit::MolOps::removeHs(*mol)));
+        }
+
+        // every level replaces each group of molecules by the fragment of its first molecule matched by the group MCS
+        RDKit::MOL_SPTR_VECT level = molsWithoutHs;
+        for (unsigned depth = 0; level.size() > 1; depth++) {
+            const unsigned numGroups = (level.size() + CORE_GROUP_SIZE - 1) / CORE_GROUP_SIZE;
+            RDKit::MOL_SPTR_VECT nextLevel(numGroups);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(m_threads) shared(level, nextLevel)
+            for (unsigned groupId = 0; groupId < numGroups; groupId++) {
+                const auto begin = level.begin() + groupId * CORE_GROUP_SIZE;
+                const auto end = level.begin() + std::min<std::size_t>((groupId + 1) * CORE_GROUP_SIZE, level.size());
+                const RDKit::MOL_SPTR_VECT group(begin, end);
+                if (group.size() == 1) {
+                    nextLevel.at(groupId) = group.front();
+                    continue;
+                }
+
+                auto mcsParams = Matcher::getCoreMCSParams();
+                const RDKit::MCSResult mcs = RDKit::findMCS(group, &mcsParams);
+                if (mcs.QueryMol != nullptr) {
+                    nextLevel.at(groupId) = extract_mcs_fragment(*group.front(), *mcs.QueryMol);
+                }
+            }
+
+            if (std::any_of(nextLevel.begin(), nextLevel.end(), [](const auto &mol) { return mol == nullptr; })) {
+                spdlog::warn("hierarchical mcs failed on level {}, falling back to mcs of all molecules", depth);
+                return this->calculateCoreMcs(mols);
+            }
+            spdlog::debug("hierarchical mcs level {}: {} fragments", depth, nextLevel.size());
+            level = std::move(nextLevel);
+        }
+
+        // the remaining fragment is a common substructure of all molecules, only its atom and bond types have to be
+        // generalized over all molecules. This needs one substructure match per molecule instead of a MCS search.
+        const RDKit::ROMOL_SPTR core = Matcher::generalizeFragment(*level.front(), molsWithoutHs);
+        if (core == nullptr) {
+            spdlog::warn("reduced hierarchical mcs does not match all molecules, falling back to mcs of all molecules");
+            return this->calculateCoreMcs(mols);
+        }
+
+        spdlog::info("hierarchical mcs: {}", RDKit::MolToSmarts(*core));
+
+        return this->buildCoreResult(mols, core);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::optional<CoreResult> Matcher::calculateCorePortfolio(RDKit::MOL_SPTR_VECT &mols) {
+        RDKit::MOL_SPTR_VECT molsWithoutHs;
+        for (auto &mol : mols) {
+            molsWithoutHs.push_back(RDKit::ROMOL_SPTR(RDKit::MolOps::removeHs(*mol)));
+        }
+
+        auto variants = get_portfolio_variants();
+        const auto minCoreAtoms = static_cast<unsigned>(PORTFOLIO_MIN_CORE_SIZE_FACTOR
+                                                        * get_core_size_upper_bound(molsWithoutHs, 1.0));
+
+        PortfolioBest best;
+        std::vector<RDKit::ROMOL_SPTR> cores(variants.size());
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(std::min<int>(m_threads, variants.size())) \
+    shared(variants, molsWithoutHs, best, cores)
+        for (unsigned variantId = 0; variantId < variants.size(); variantId++) {
+            auto &[name, params] = variants.at(variantId);
+            const auto start = std::chrono::steady_clock::now();
+
+            PortfolioProgress progress{start, params.Timeout,
+                                       get_core_size_upper_bound(molsWithoutHs, params.Threshold), &best};
+            params.ProgressCallback = portfolio_progress_callback;
+            params.ProgressCallbackUserData = &progress;
+
+            const RDKit::MCSResult mcs = RDKit::findMCS(molsWithoutHs, &params);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+
+            // cores found with a threshold below one are only usable if they happen to match all molecules
+            const bool valid = mcs.QueryMol != nullptr && core_matches_all(molsWithoutHs, *mcs.QueryMol);
+            spdlog::debug("portfolio mcs '{}': {} atoms, valid: {}, canceled: {}, pruned: {}, {} ms", name,
+                          mcs.NumAtoms, valid, mcs.Canceled, progress.pruned, duration.count());
+            // a pruned variant stopped in the middle of its search and can not beat the best finished core
+            if (!valid || progress.pruned) {
+                continue;
+            }
+
+            cores.at(variantId) = mcs.QueryMol;
+            // timed out variants keep their partial core like calculateCoreMcs(), but they are no reference for the
+            // other variants
+            if (!mcs.Canceled && mcs.NumAtoms >= minCoreAtoms) {
+                const std::lock_guard<std::mutex> lock(best.mutex);
+                best.numAtoms = std::max(best.numAtoms, mcs.NumAtoms);
+            }
+        }
+
+        // prefer cores above the minimum size, then the most atoms and bonds, then the order of the variants
+        std::optional<unsigned> bestVariantId;
+        const auto getRank = [&](unsigned variantId) {
+            const auto &core = cores.at(variantId);
+            return std::make_tuple(core->getNumAtoms() >= minCoreAtoms, core->getNumAtoms(), core->getNumBonds());
+        };
+        for (unsigned variantId = 0; variantId < variants.size(); variantId++) {
+            if (cores.at(variantId) != nullptr
+                && (!bestVariantId.has_value() || getRank(variantId) > getRank(bestVariantId.value()))) {
+                bestVariantId = variantId;
+            }
+        }
+
+        if (!bestVariantId.has_value()) {
+            return std::nullopt;
+        }
+
+        const auto &core = cores.at(bestVariantId.value());
+        spdlog::info("portfolio mcs ({}): {}", variants.at(bestVariantId.value()).name, RDKit::MolToSmarts(*core));
+
+        return this->buildCoreResult(mols, core);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    CoreResult Matcher::buildCoreResult(RDKit::MOL_SPTR_VECT &mols, const RDKit::ROMOL_SPTR &core) const {
         // creating a reference molecule of the core to embed conformer with atom coords
-        auto ref = this->buildMolConformerForQuery(*mols.at(0), *mcs.QueryMol);
+        auto ref = this->buildMolConformerForQuery(*mols.at(0), *core);
 
         spdlog::info("Reference: {}", RDKit::MolToSmiles(*ref));
 
-        auto matches = RDKit::SubstructMatch(*ref, *mcs.QueryMol, this->getMatchParams());
+        auto matches = RDKit::SubstructMatch(*ref, *core, this->getMatchParams());
         assert(!matches.empty());
 
         auto match = matches.at(0);
@@ -57,7 +340,7 @@ namespace coaler::core {
             coreToRef[queryId] = molId;
         }
 
-        return CoreResult{mcs.QueryMol, ref, coreToRef};
+        return CoreResult{core, ref, coreToRef};
     }
 
     /*----------------------------------------------------------------------------------------------------------------*/
@@ -75,70 +358,7 @@ namespace coaler::core {
             return std::nullopt;
         }
 
-        // initialize vars for DFS and find all atoms that are part of any ring
-        std::vector<bool> visit(mcsRWMol.getNumAtoms(), false);
-
-        std::vector<int> ringAtoms;
-        std::vector<std::vector<int>> ringVec = mcsRWMol.getRingInfo()->atomRings();
-        for (const auto ring : ringVec) {
-            for (const auto atomID : ring) {
-                if (visit.at(atomID)) {
-                    continue;
-                }
-                ringAtoms.push_back(atomID);
-            }
-        }
-
-        // start pruning of mcs, save to-be-deleted atoms and bonds
-        std::vector<int> delAtomsMaybe;
-        std::vector<std::pair<int, int>> delBonds;
-        RDKit::RWMOL_SPTR murckoPtr = boost::make_shared<RDKit::RWMol>(mcsRWMol);
-
-        // start from each ring atom
-        for (const auto atomID : ringAtoms) {
-            for (int i = 0; i < murckoPtr->getNumAtoms(); i++) {
-                visit.at(i) = false;
-            }
-            murckoPruningRecursive(murckoPtr, atomID, -1, visit, delAtomsMaybe, delBonds, ringAtoms);
-        }
-
-        // delete duplicates from deletion lists
-        sort(delAtomsMaybe.begin(), delAtomsMaybe.end());
-        delAtomsMaybe.erase(unique(delAtomsMaybe.begin(), delAtomsMaybe.end()), delAtomsMaybe.end());
-        sort(delBonds.begin(), delBonds.end());
-        delBonds.erase(unique(delBonds.begin(), delBonds.end()), delBonds.end());
-
-        // check atoms in delAtomMaybe if they are part of the substructure between rings. If not
-        // they are added to a delAtomsDefinitely.
-        // An atom is part of the substructure between at least two rings if the DFS finds two or more
-        // ring atoms.
-        std::vector<int> foundRingAtoms;
-        std::vector<int> delAtomsDefinitely;
-        for (const auto delAtomsID : delAtomsMaybe) {
-            for (int i = 0; i < murckoPtr->getNumAtoms(); i++) {
-                visit.at(i) = false;
-            }
-            foundRingAtoms.clear();
-
-            murckoCheckDelAtoms(murckoPtr, delAtomsID, -1, visit, ringAtoms, foundRingAtoms);
-            if (foundRingAtoms.size() < 2) {
-                delAtomsDefinitely.push_back(delAtomsID);
-            }
-        }
-
-        // remove all bonds and atoms that are not part of  the murcko scaffold.
-        // Deletion of atoms needs to be in order of atomIdx (high to low) to avoid
-        // deletion errors.
-        std::sort(delAtomsDefinitely.begin(), delAtomsDefinitely.end(), std::greater<>());
-        for (auto [atom1, atom2] : delBonds) {
-            if (std::find(delAtomsDefinitely.begin(), delAtomsDefinitely.end(), atom1) != delAtomsDefinitely.end()
-                && std::find(delAtomsDefinitely.begin(), delAtomsDefinitely.end(), atom2) != delAtomsDefinitely.end()) {
-                murckoPtr->removeBond(atom1, atom2);
-            }
-        }
-        for (auto atom : delAtomsDefinitely) {
-            murckoPtr->removeAtom(atom);
-        }
+        RDKit::RWMOL_SPTR murckoPtr = Matcher::extractMurckoScaffold(mcsRWMol);
 
         spdlog::info("murco: {}", RDKit::MolToSmarts(*murckoPtr));
 
@@ -165,68 +385,164 @@ namespace coaler::core {
     RDKit::ROMOL_SPTR Matcher::buildMolConformerForQuery(RDKit::RWMol first, const RDKit::ROMol & /*query*/) const {
         // Generates all parameters needed for Embedding
         auto params = RDKit::DGeomHelpers::srETKDGv3;
-        params.numThreads = m_threads;
+        params.numThreads = ThreadBudget::getNestedShare(m_threads);
         params.randomSeed = 42;
         params.useRandomCoords = true;
         RDKit::DGeomHelpers::EmbedMolecule(first, params);
 
         std::vector<std::pair<int, double>> result;
-        RDKit::UFF::UFFOptimizeMoleculeConfs(first, result, m_threads);
+        RDKit::UFF::UFFOptimizeMoleculeConfs(first, result, ThreadBudget::getNestedShare(m_threads));
 
         return boost::make_shared<RDKit::ROMol>(first);
     }
 
     /*----------------------------------------------------------------------------------------------------------------*/
 
-    void Matcher::murckoPruningRecursive(RDKit::RWMOL_SPTR &mol, int atomID, int parentID, std::vector<bool> &visit,
-                                         std::vector<int> &delAtoms, std::vector<std::pair<int, int>> &delBonds,
-                                         std::vector<int> &ringAtoms) {
-        // mark atom as visited and find all neighbor atoms of atom with atomID
-        visit.at(atomID) = true;
-        for (const auto &neighborID : boost::make_iterator_range(mol->getAtomNeighbors(mol->getAtomWithIdx(atomID)))) {
-            // only visit atoms not the parent, not yet visited and which are not part of any ring
-            if (neighborID == parentID || visit.at(neighborID)
-                || std::find(ringAtoms.begin(), ringAtoms.end(), neighborID) != ringAtoms.end()) {
+    RDKit::RWMOL_SPTR Matcher::extractMurckoScaffold(const RDKit::RWMol &mol) {
+        const unsigned numAtoms = mol.getNumAtoms();
+        boost::dynamic_bitset<> ringAtoms(numAtoms);
+        for (const auto &ring : mol.getRingInfo()->atomRings()) {
+            for (const auto atomID : ring) {
+                ringAtoms.set(atomID);
+            }
+        }
+
+        // the atoms outside of rings form trees. A tree is part of the scaffold if it links at least two ring atoms,
+        // otherwise it is a side chain that is removed completely (equivalent to peeling it leaf by leaf).
+        boost::dynamic_bitset<> visited(numAtoms);
+        boost::dynamic_bitset<> delAtoms(numAtoms);
+        std::vector<int> lastContactComponent(numAtoms, -1);
+        std::vector<unsigned> component;
+        std::vector<unsigned> stack;
+        for (unsigned startID = 0; startID < numAtoms; startID++) {
+            if (ringAtoms.test(startID) || visited.test(startID)) {
                 continue;
             }
-            murckoPruningRecursive(mol, neighborID, atomID, visit, delAtoms, delBonds, ringAtoms);
-
-            // find neighbors that are not on the to-be-deleted-list and count them
-            int numNbrs = 0;
-            for (const auto &nextNeighborID :
-                 boost::make_iterator_range(mol->getAtomNeighbors(mol->getAtomWithIdx(neighborID)))) {
-                if (std::find(delAtoms.begin(), delAtoms.end(), nextNeighborID) == delAtoms.end()) {
-                    numNbrs++;
+
+            component.clear();
+            unsigned numRingContacts = 0;
+            stack.push_back(startID);
+            visited.set(startID);
+            while (!stack.empty()) {
+                const unsigned atomID = stack.back();
+                stack.pop_back();
+                component.push_back(atomID);
+
+                const auto *atom = mol.getAtomWithIdx(atomID);
+                for (const auto &neighborID : boost::make_iterator_range(mol.getAtomNeighbors(atom))) {
+                    if (ringAtoms.test(neighborID)) {
+                        // count every ring atom once per component
+                        if (lastContactComponent.at(neighborID) != static_cast<int>(startID)) {
+                            lastContactComponent.at(neighborID) = static_cast<int>(startID);
+                            numRingContacts++;
+                        }
+                    } else if (!visited.test(neighborID)) {
+                        visited.set(neighborID);
+                        stack.push_back(neighborID);
+                    }
                 }
             }
 
-            // atoms with only one neighbor (parent) will be deleted after recursive call.
-            // They are not deleted here cause internal IDs are updated after deletion.
-            if (numNbrs == 1) {
-                delBonds.push_back(std::make_pair(neighborID, atomID));
-                delAtoms.push_back(neighborID);
+            if (numRingContacts < 2) {
+                for (const auto atomID : component) {
+                    delAtoms.set(atomID);
+                }
+            }
+        }
+
+        // deletion of atoms needs to be in order of atomIdx (high to low) to avoid deletion errors.
+        auto murckoPtr = boost::make_shared<RDKit::RWMol>(mol);
+        for (int atomID = static_cast<int>(numAtoms) - 1; atomID >= 0; atomID--) {
+            if (delAtoms.test(atomID)) {
+                murckoPtr->removeAtom(atomID);
             }
         }
+
+        return murckoPtr;
     }
 
     /*----------------------------------------------------------------------------------------------------------------*/
 
-    void Matcher::murckoCheckDelAtoms(RDKit::RWMOL_SPTR &mol, int atomID, int parentID, std::vector<bool> &visit,
-                                      std::vector<int> &ringAtoms, std::vector<int> &foundRingAtoms) {
-        // mark atom as visited and check if they are part of any ring. If yes save and return to
-        // recursive call before
-        visit.at(atomID) = true;
-        if (std::find(ringAtoms.begin(), ringAtoms.end(), atomID) != ringAtoms.end()) {
-            foundRingAtoms.push_back(atomID);
-            return;
+    RDKit::ROMOL_SPTR Matcher::generalizeFragment(const RDKit::ROMol &fragment, const RDKit::MOL_SPTR_VECT &mols) {
+        RDKit::RWMol topology(fragment);
+        if (!topology.getRingInfo()->isInitialized()) {
+            RDKit::MolOps::findSSSR(topology);
         }
-        // visit all neighbors if they are not the parent and are not yet visited
-        for (const auto &neighborID : boost::make_iterator_range(mol->getAtomNeighbors(mol->getAtomWithIdx(atomID)))) {
-            if (neighborID == parentID || visit.at(neighborID)) {
-                continue;
+
+        // ring atoms only match ring atoms like in the MCS search of the core
+        for (unsigned atomId = 0; atomId < topology.getNumAtoms(); atomId++) {
+            RDKit::QueryAtom queryAtom;
+            queryAtom.setQuery(make_ring_query(topology.getRingInfo()->numAtomRings(atomId) > 0));
+            topology.replaceAtom(atomId, &queryAtom);
+        }
+        for (unsigned bondId = 0; bondId < topology.getNumBonds(); bondId++) {
+            RDKit::QueryBond queryBond;
+            queryBond.setQuery(RDKit::makeBondNullQuery());
+            topology.replaceBond(bondId, &queryBond);
+        }
+
+        std::vector<std::set<int>> atomicNums(fragment.getNumAtoms());
+        std::vector<std::set<RDKit::Bond::BondType>> bondTypes(fragment.getNumBonds());
+        RDKit::SubstructMatchParameters params;
+        params.useChirality = false;
+        params.maxMatches = 1;
+        for (const auto &mol : mols) {
+            const auto matches = RDKit::SubstructMatch(*mol, topology, params);
+            if (matches.empty()) {
+                return nullptr;
+            }
+
+            std::vector<int> molIds(fragment.getNumAtoms());
+            for (const auto &[queryId, molId] : matches.front()) {
+                molIds.at(queryId) = molId;
+                atomicNums.at(queryId).insert(mol->getAtomWithIdx(molId)->getAtomicNum());
+            }
+            for (const auto *bond : fragment.bonds()) {
+                const auto *molBond
+                    = mol->getBondBetweenAtoms(molIds.at(bond->getBeginAtomIdx()), molIds.at(bond->getEndAtomIdx()));
+                bondTypes.at(bond->getIdx()).insert(molBond->getBondType());
+            }
+        }
+
+        // the core is passed on as SMARTS (e.g. as seed of the pairwise MCS), so it is parsed back from its SMARTS
+        return RDKit::ROMOL_SPTR(RDKit::SmartsToMol(getGeneralizedSmarts(fragment, atomicNums, bondTypes)));
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::string Matcher::getGeneralizedSmarts(const RDKit::ROMol &fragment,
+                                              const std::vector<std::set<int>> &atomicNums,
+                                              const std::vector<std::set<RDKit::Bond::BondType>> &bondTypes) {
+        RDKit::RWMol query(fragment);
+        if (!query.getRingInfo()->isInitialized()) {
+            RDKit::MolOps::findSSSR(query);
+        }
+        std::vector<bool> inRing;
+        for (unsigned atomId = 0; atomId < query.getNumAtoms(); atomId++) {
+            inRing.push_back(query.getRingInfo()->numAtomRings(atomId) > 0);
+        }
+
+        for (unsigned atomId = 0; atomId < query.getNumAtoms(); atomId++) {
+            auto *elementQuery = new RDKit::ATOM_OR_QUERY;
+            for (const int atomicNum : atomicNums.at(atomId)) {
+                elementQuery->addChild(RDKit::ATOM_OR_QUERY::CHILD_TYPE(RDKit::makeAtomNumQuery(atomicNum)));
             }
-            murckoCheckDelAtoms(mol, neighborID, atomID, visit, ringAtoms, foundRingAtoms);
+            RDKit::QueryAtom queryAtom;
+            queryAtom.setQuery(elementQuery);
+            queryAtom.expandQuery(make_ring_query(inRing.at(atomId)));
+            query.replaceAtom(atomId, &queryAtom);
         }
+        for (unsigned bondId = 0; bondId < query.getNumBonds(); bondId++) {
+            auto *typeQuery = new RDKit::BOND_OR_QUERY;
+            for (const auto bondType : bondTypes.at(bondId)) {
+                typeQuery->addChild(RDKit::BOND_OR_QUERY::CHILD_TYPE(RDKit::makeBondOrderEqualsQuery(bondType)));
+            }
+            RDKit::QueryBond queryBond;
+            queryBond.setQuery(typeQuery);
+            query.replaceBond(bondId, &queryBond);
+        }
+
+        return RDKit::MolToSmarts(query);
     }
 
     /*----------------------------------------------------------------------------------------------------------------*/
@@ -236,7 +552,7 @@ namespace coaler::core {
         substructMatchParams.useChirality = true;
         substructMatchParams.useEnhancedStereo = true;
         substructMatchParams.aromaticMatchesConjugated = true;
-        substructMatchParams.numThreads = m_threads;
+        substructMatchParams.numThreads = ThreadBudget::getNestedShare(m_threads);
 
         return substructMatchParams;
     }
@@ -303,76 +619,8 @@ namespace coaler::core {
 
     /*----------------------------------------------------------------------------------------------------------------*/
 
-    PairwiseMCSMap Matcher::calcPairwiseMCS(const multialign::LigandVector &mols, bool strict,
-                                            const std::string &seed) {
-        // Generates all parameters needed for RDKit::findMCS()
-        PairwiseMCSMap mcsMap;
-        RDKit::MCSParameters mcsParams;
-        if (strict) {
-            mcsParams = getStrictMCSParams();
-        } else {
-            mcsParams = getRelaxedMCSParams();
-        }
-
-        omp_lock_t mapLock;
-        omp_init_lock(&mapLock);
-
-        const RDKit::SubstructMatchParameters substructMatchParams = get_optimizer_substruct_params();
-
-        // iterate over all ligand pairs and calculating their pairwise MCS
-#pragma omp parallel for shared(mols, mcsParams, substructMatchParams, mcsMap, mapLock, strict, seed) default(none)
-        for (auto firstLigandId = 0; firstLigandId < mols.size(); ++firstLigandId) {
-            for (auto secondLigandId = firstLigandId + 1; secondLigandId < mols.size(); ++secondLigandId) {
-                const multialign::LigandPair ligandPair(firstLigandId, secondLigandId);
-
-                const auto &firstLigand = mols.at(firstLigandId);
-                const auto &secondLigand = mols.at(secondLigandId);
-
-                auto firstMol = firstLigand.getMolecule();
-                auto firstWithoutHs = boost::make_shared<RDKit::ROMol>(*RDKit::MolOps::removeHs(firstMol));
-
-                auto secondMol = secondLigand.getMolecule();
-                auto secondWithoutHs = boost::make_shared<RDKit::ROMol>(*RDKit::MolOps::removeHs(secondMol));
-
-                const RDKit::MOL_SPTR_VECT molPair{firstWithoutHs, secondWithoutHs};
-                mcsParams.InitialSeed = seed;
-
-                const RDKit::MCSResult mcsResult = RDKit::findMCS(molPair, &mcsParams);
-                if (mcsResult.QueryMol == nullptr) {
-                    omp_set_lock(&mapLock);
-                    mcsMap.emplace(ligandPair, std::tuple<RDKit::MatchVectType, RDKit::MatchVectType, std::string>());
-                    omp_unset_lock(&mapLock);
-
-                    spdlog::error("no {} mcs found between {} and {}", strict ? "strict" : "relaxed",
-                                  RDKit::MolToSmiles(firstMol), RDKit::MolToSmiles(secondMol));
-
-                    continue;
-                }
-
-                // finds atom pair matches of molecule pair and saves them in mcsMap
-                auto firstMatches = RDKit::SubstructMatch(firstMol, *mcsResult.QueryMol, substructMatchParams);
-                auto secondMatches = RDKit::SubstructMatch(secondMol, *mcsResult.QueryMol, substructMatchParams);
-
-                if (firstMatches.empty() || secondMatches.empty()) {
-                    auto empty = std::tuple<RDKit::MatchVectType, RDKit::MatchVectType, std::string>();
-
-                    omp_set_lock(&mapLock);
-                    mcsMap.emplace(ligandPair, empty);
-                    omp_unset_lock(&mapLock);
-
-                    continue;
-                }
-
-                const RDKit::MatchVectType firstLigandMatch = firstMatches.at(0);
-                const RDKit::MatchVectType secondLigandMatch = secondMatches.at(0);
-
-                omp_set_lock(&mapLock);
-                mcsMap.emplace(ligandPair,
-                               std::make_tuple(firstLigandMatch, secondLigandMatch, mcsResult.SmartsString));
-                omp_unset_lock(&mapLock);
-            }
-        }
-
-        return mcsMap;
+    PairwiseMCSMap Matcher::calcPairwiseMCS(const multialign::LigandVector &mols, bool strict, const std::string &seed,
+                                            io::PairwiseMCSCache *cache) {
+        return PairwiseMCSCalculator(mols, seed, cache).calculateAll(strict);
     }
 }  // namespace coaler::core
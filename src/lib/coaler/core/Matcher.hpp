@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <queue>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -16,11 +17,18 @@
  * @brief This file contains the Matcher class which is used to calculate the MCS and Murcko scaffold of molecules
  */
 
+namespace coaler::io {
+    class PairwiseMCSCache;
+}  // namespace coaler::io
+
 namespace coaler::core {
 
-    using PairwiseMCSMap = std::unordered_map<multialign::LigandPair,
-                                              std::tuple<RDKit::MatchVectType, RDKit::MatchVectType, std::string>,
-                                              multialign::LigandPairHash>;
+    /**
+     * MCS of a ligand pair: atom matches of the MCS query in the first and second ligand and the MCS SMARTS.
+     */
+    using PairwiseMCS = std::tuple<RDKit::MatchVectType, RDKit::MatchVectType, std::string>;
+
+    using PairwiseMCSMap = std::unordered_map<multialign::LigandPair, PairwiseMCS, multialign::LigandPairHash>;
 
     // NOLINTBEGIN(cppcoreguidelines-pro-type-member-init)
     struct CoreResult {
@@ -50,6 +58,24 @@ namespace coaler::core {
          */
         std::optional<CoreResult> calculateCoreMurcko(RDKit::MOL_SPTR_VECT& mols);
 
+        /**
+         * calculates the MCS of the molecules with a tournament style reduction. The MCS of small groups of molecules
+         * are calculated in parallel and reduced level by level, the final fragment is generalized over all molecules
+         * with generalizeFragment(). Falls back to calculateCoreMcs() if any level fails.
+         * @param mols molecules the MCS is calculated for
+         * @return MCS as ROMol
+         */
+        std::optional<CoreResult> calculateCoreHierarchical(RDKit::MOL_SPTR_VECT& mols);
+
+        /**
+         * calculates the MCS of the molecules with a portfolio of MCS parameter sets (ring constraints, threshold
+         * and timeout) running concurrently. A variant is cancelled once the upper bound of its core size is not above
+         * the core of the best finished variant, the partial cores of cancelled variants are discarded.
+         * @param mols molecules the MCS is calculated for
+         * @return largest MCS that matches all molecules, preferring cores above a minimum size
+         */
+        std::optional<CoreResult> calculateCorePortfolio(RDKit::MOL_SPTR_VECT& mols);
+
         /**
          * @return mcs params for very flexibly mcs search
          * i.e. no atom types, bond types, chirality
@@ -65,46 +91,56 @@ namespace coaler::core {
         static RDKit::MCSParameters getCoreMCSParams();
 
         /**
-         * calculates the pairwise MCS for all molecule pairs of molecules in @param mols
-         * @param mols molecules the pariwise MCS are calculated for
-         * @param strict bool, determs if parameters fpr MCS calculatin are strict or relaxed
-         * @return a map of pairwise MCS atom matches for all molecule pairs
+         * extracts the Murcko scaffold (rings and linkers between them) of a molecule in linear time
+         * @param mol molecule with perceived rings
+         * @return copy of @param mol without side chains
          */
-        static PairwiseMCSMap calcPairwiseMCS(const multialign::LigandVector& mols, bool strict,
-                                              const std::string& seed = "");
+        static RDKit::RWMOL_SPTR extractMurckoScaffold(const RDKit::RWMol& mol);
 
-      private:
         /**
-         * recursive implementation of a murcko pruning of the mcs structure. The function does not delete atoms or
-         * bonds from mol but saves them in delAtoms and delBonds to be deleted after function call.
-         * @param mol molecule to be pruned
-         * @param atomID current atomID of atom looked at
-         * @param parentID parent atomID of parent of atom
-         * @param visit vector to save visited atoms
-         * @param delAtoms vector to save atoms to be deleted
-         * @param delBonds vector to save bonds to be deleted
+         * generalizes a common substructure of molecules to a query like the MCS query of the core parameters: every
+         * atom and bond of the fragment is matched topologically (ring atoms onto ring atoms only) in every molecule
+         * and the query accepts the atomic numbers and bond types found at the matched positions
+         * @param fragment the common substructure
+         * @param mols molecules the query has to match
+         * @return the generalized query parsed from its SMARTS, nullptr if the fragment does not match all molecules
          */
-        void murckoPruningRecursive(RDKit::RWMOL_SPTR& mol, int atomID, int parentID, std::vector<bool>& visit,
-                                    std::vector<int>& delAtoms, std::vector<std::pair<int, int>>& delBonds,
-                                    std::vector<int>& ringAtoms);
+        static RDKit::ROMOL_SPTR generalizeFragment(const RDKit::ROMol& fragment, const RDKit::MOL_SPTR_VECT& mols);
 
         /**
-         * recursive implementation to find atoms in delAtoms which are sidechains in the murcko structure and therefore
-         * need to stay in the molecule.
-         * @param mol molecule to be pruned
-         * @param atomID current atomID of atom looked at
-         * @param parentID parent atomID of parent of atom
-         * @param visit vector to save visited atoms
-         * @param ringAtoms atoms which are inside a ring of the molecule  @param mol
-         * @param foundRingAtoms atoms found during DFS which are ringatoms of @param mol
+         * builds the SMARTS of a query for the graph of a fragment, ring atoms of the fragment only match ring atoms
+         * @param fragment the fragment
+         * @param atomicNums the atomic numbers every atom of the fragment accepts
+         * @param bondTypes the bond types every bond of the fragment accepts
+         * @return the SMARTS of the query
+         */
+        static std::string getGeneralizedSmarts(const RDKit::ROMol& fragment,
+                                                const std::vector<std::set<int>>& atomicNums,
+                                                const std::vector<std::set<RDKit::Bond::BondType>>& bondTypes);
+
+        /**
+         * calculates the pairwise MCS for all molecule pairs of molecules in @param mols
+         * @param mols molecules the pariwise MCS are calculated for
+         * @param strict bool, determs if parameters fpr MCS calculatin are strict or relaxed
+         * @param cache optional persistent cache to look up and store the pairwise MCS in
+         * @return a map of pairwise MCS atom matches for all molecule pairs
          */
-        void murckoCheckDelAtoms(RDKit::RWMOL_SPTR& mol, int atomID, int parentID, std::vector<bool>& visit,
-                                 std::vector<int>& ringAtoms, std::vector<int>& foundRingAtoms);
+        static PairwiseMCSMap calcPairwiseMCS(const multialign::LigandVector& mols, bool strict,
+                                              const std::string& seed = "", io::PairwiseMCSCache* cache = nullptr);
 
+      private:
         int m_threads;
 
         [[nodiscard]] RDKit::SubstructMatchParameters getMatchParams() const;
 
         [[nodiscard]] RDKit::ROMOL_SPTR buildMolConformerForQuery(RDKit::RWMol first, const RDKit::ROMol& query) const;
+
+        /**
+         * embeds a reference conformer for @param core and maps the core atoms to the reference atoms
+         * @param mols molecules the core was calculated for
+         * @param core core structure (query)
+         * @return the core result
+         */
+        [[nodiscard]] CoreResult buildCoreResult(RDKit::MOL_SPTR_VECT& mols, const RDKit::ROMOL_SPTR& core) const;
     };
 }  // namespace coaler::core
\ No newline at end of file
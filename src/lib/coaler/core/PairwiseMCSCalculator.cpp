@@ -0,0 +1,271 @@
+#include "PairwiseMCSCalculator.hpp"
+
+#include <GraphMol/MolOps.h>
+#include <GraphMol/RascalMCES/RascalMCES.h>
+#include <GraphMol/RascalMCES/RascalOptions.h>
+#include <GraphMol/SmilesParse/SmilesParse.h>
+#include <GraphMol/Substruct/SubstructMatch.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include "CoreSeededMCS.hpp"
+#include "coaler/io/PairwiseMCSCache.hpp"
+#include "coaler/multialign/models/Ligand.hpp"
+#include "coaler/multialign/models/LigandPair.hpp"
+
+namespace {
+    // similarity threshold of the prescreen RASCAL run, above the largest possible similarity
+    const double RASCAL_BOUND_ONLY_THRESHOLD = 1.1;
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    RDKit::SubstructMatchParameters get_optimizer_substruct_params() {
+        RDKit::SubstructMatchParameters substructMatchParams;
+        substructMatchParams.uniquify = true;
+        substructMatchParams.useChirality = false;
+        substructMatchParams.useQueryQueryMatches = false;
+        substructMatchParams.maxMatches = 1;
+        substructMatchParams.numThreads = 1;
+        substructMatchParams.useEnhancedStereo = false;
+        return substructMatchParams;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // index of a pair in the upper triangle of the ligand matrix (without the diagonal)
+    std::size_t get_pair_index(const coaler::multialign::LigandPair &pair, std::size_t numLigands) {
+        const std::size_t first = pair.getFirst();
+        const std::size_t second = pair.getSecond();
+        return first * numLigands - first * (first + 1) / 2 + (second - first - 1);
+    }
+}  // namespace
+
+/*----------------------------------------------------------------------------------------------------------------*/
+
+namespace coaler::core {
+    PairwiseMCSCalculator::PairwiseMCSCalculator(const multialign::LigandVector &ligands, std::string seed,
+                                                 io::PairwiseMCSCache *cache)
+        : m_seed(std::move(seed)),
+          m_cache(cache),
+          m_prescreenOnce(ligands.size() * (ligands.size() - 1) / 2),
+          m_prescreenResults(ligands.size() * (ligands.size() - 1) / 2, 0) {
+        if (!m_seed.empty()) {
+            m_seedQuery.reset(RDKit::SmartsToMol(m_seed));
+        }
+
+        m_molecules.reserve(ligands.size());
+        m_moleculesWithoutHs.reserve(ligands.size());
+        m_canonicalMolecules.reserve(ligands.size());
+        for (const auto &ligand : ligands) {
+            auto mol = boost::make_shared<RDKit::ROMol>(*ligand.getMoleculePtr());
+            // ring membership is needed by the core growth
+            if (!mol->getRingInfo()->isInitialized()) {
+                RDKit::MolOps::findSSSR(*mol);
+            }
+            m_moleculesWithoutHs.push_back(RDKit::ROMOL_SPTR(RDKit::MolOps::removeHs(*mol)));
+            // canonicalization writes properties onto the molecule, so it must not run in the concurrent tasks
+            m_canonicalMolecules.push_back(io::PairwiseMCSCache::getCanonicalMolecule(*mol));
+            m_molecules.push_back(mol);
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    PairwiseMCS PairwiseMCSCalculator::calculate(const multialign::LigandPair &pair, bool strict,
+                                                 RDKit::MCSParameters &mcsParams) const {
+        const auto &firstMol = getMolecule(pair.getFirst());
+        const auto &secondMol = getMolecule(pair.getSecond());
+
+        if (m_algorithm == PairwiseMCSAlgorithm::CoreGrowth) {
+            const auto &firstCoreMatches = m_coreMatches.at(pair.getFirst());
+            const auto &secondCoreMatches = m_coreMatches.at(pair.getSecond());
+            if (!firstCoreMatches.empty() && !secondCoreMatches.empty()) {
+                return CoreSeededMCS::grow(firstMol, secondMol, firstCoreMatches.front(), secondCoreMatches, strict);
+            }
+        }
+
+        if (m_cache != nullptr) {
+            auto cachedMcs = m_cache->load(m_canonicalMolecules.at(pair.getFirst()),
+                                           m_canonicalMolecules.at(pair.getSecond()), strict, m_seed);
+            if (cachedMcs.has_value()) {
+                return cachedMcs.value();
+            }
+        }
+
+        // the result of the prescreen does not depend on the MCS parameters and is not written to the cache
+        if (m_prescreenThreshold > 0 && isPrescreened(pair)) {
+            return calculateSeedMCS(pair);
+        }
+
+        const RDKit::MOL_SPTR_VECT molPair{m_moleculesWithoutHs.at(pair.getFirst()),
+                                           m_moleculesWithoutHs.at(pair.getSecond())};
+        mcsParams.InitialSeed = m_seed;
+
+        PairwiseMCS pairwiseMcs;
+        const RDKit::MCSResult mcsResult = RDKit::findMCS(molPair, &mcsParams);
+        if (mcsResult.QueryMol == nullptr) {
+            spdlog::error("no {} mcs found between {} and {}", strict ? "strict" : "relaxed",
+                          m_canonicalMolecules.at(pair.getFirst()).smiles,
+                          m_canonicalMolecules.at(pair.getSecond()).smiles);
+        } else {
+            // finds atom pair matches of the molecule pair
+            const RDKit::SubstructMatchParameters substructMatchParams = get_optimizer_substruct_params();
+            auto firstMatches = RDKit::SubstructMatch(firstMol, *mcsResult.QueryMol, substructMatchParams);
+            auto secondMatches = RDKit::SubstructMatch(secondMol, *mcsResult.QueryMol, substructMatchParams);
+
+            if (!firstMatches.empty() && !secondMatches.empty()) {
+                pairwiseMcs = std::make_tuple(firstMatches.at(0), secondMatches.at(0), mcsResult.SmartsString);
+            }
+        }
+
+        // a search that hit the timeout may find a larger MCS in the next run
+        if (m_cache != nullptr && !mcsResult.Canceled) {
+            m_cache->store(m_canonicalMolecules.at(pair.getFirst()), m_canonicalMolecules.at(pair.getSecond()), strict,
+                           m_seed, pairwiseMcs);
+        }
+
+        return pairwiseMcs;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSCalculator::setPrescreenThreshold(double threshold) { m_prescreenThreshold = threshold; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSCalculator::setAlgorithm(PairwiseMCSAlgorithm algorithm,
+                                             std::vector<std::vector<RDKit::MatchVectType>> coreMatches) {
+        assert(algorithm != PairwiseMCSAlgorithm::CoreGrowth || coreMatches.size() == m_molecules.size());
+        m_algorithm = algorithm;
+        m_coreMatches = std::move(coreMatches);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned PairwiseMCSCalculator::getNumPrescreened() const noexcept { return m_numPrescreened; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool PairwiseMCSCalculator::isPrescreened(const multialign::LigandPair &pair) const {
+        const std::size_t pairIndex = get_pair_index(pair, m_molecules.size());
+        std::call_once(m_prescreenOnce.at(pairIndex), [this, &pair, pairIndex]() {
+            // the tier 1 similarity is a cheap upper bound of the RASCAL similarity. No pair reaches a similarity
+            // above one, so RASCAL returns after the bound without searching the MCES, which the MCS search that
+            // follows for pairs above the threshold would not use.
+            RDKit::RascalMCES::RascalOptions options;
+            options.similarityThreshold = RASCAL_BOUND_ONLY_THRESHOLD;
+            options.returnEmptyMCES = true;
+            const auto results = RDKit::RascalMCES::rascalMCES(*m_moleculesWithoutHs.at(pair.getFirst()),
+                                                               *m_moleculesWithoutHs.at(pair.getSecond()), options);
+
+            const bool belowThreshold = !results.empty() && results.front().getTier1Sim() < m_prescreenThreshold;
+            m_prescreenResults.at(pairIndex) = belowThreshold ? 1 : 0;
+            if (belowThreshold) {
+                m_numPrescreened++;
+            }
+        });
+
+        return m_prescreenResults.at(pairIndex) != 0;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    PairwiseMCS PairwiseMCSCalculator::calculateSeedMCS(const multialign::LigandPair &pair) const {
+        if (m_seedQuery == nullptr) {
+            return {};
+        }
+
+        const RDKit::SubstructMatchParameters substructMatchParams = get_optimizer_substruct_params();
+        auto firstMatches = RDKit::SubstructMatch(getMolecule(pair.getFirst()), *m_seedQuery, substructMatchParams);
+        auto secondMatches = RDKit::SubstructMatch(getMolecule(pair.getSecond()), *m_seedQuery, substructMatchParams);
+        if (firstMatches.empty() || secondMatches.empty()) {
+            return {};
+        }
+
+        return std::make_tuple(firstMatches.at(0), secondMatches.at(0), m_seed);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::pair<PairwiseMCSMap, PairwiseMCSMap> PairwiseMCSCalculator::calculateAll() const {
+        std::vector<Task> tasks;
+        for (multialign::LigandID first = 0; first < getNumLigands(); first++) {
+            for (multialign::LigandID second = first + 1; second < getNumLigands(); second++) {
+                const unsigned cost = m_moleculesWithoutHs.at(first)->getNumAtoms()
+                                      * m_moleculesWithoutHs.at(second)->getNumAtoms();
+                tasks.push_back({multialign::LigandPair(first, second), true, cost});
+                tasks.push_back({multialign::LigandPair(first, second), false, cost});
+            }
+        }
+
+        std::pair<PairwiseMCSMap, PairwiseMCSMap> maps;
+        calculateTasks(std::move(tasks), maps.first, maps.second);
+        return maps;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    PairwiseMCSMap PairwiseMCSCalculator::calculateAll(bool strict) const {
+        std::vector<Task> tasks;
+        for (multialign::LigandID first = 0; first < getNumLigands(); first++) {
+            for (multialign::LigandID second = first + 1; second < getNumLigands(); second++) {
+                const unsigned cost = m_moleculesWithoutHs.at(first)->getNumAtoms()
+                                      * m_moleculesWithoutHs.at(second)->getNumAtoms();
+                tasks.push_back({multialign::LigandPair(first, second), strict, cost});
+            }
+        }
+
+        PairwiseMCSMap strictMap;
+        PairwiseMCSMap relaxedMap;
+        calculateTasks(std::move(tasks), strictMap, relaxedMap);
+        return strict ? strictMap : relaxedMap;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSCalculator::calculateTasks(std::vector<Task> tasks, PairwiseMCSMap &strictMap,
+                                               PairwiseMCSMap &relaxedMap) const {
+        // the runtime of a MCS search grows with the size of both molecules, starting with the largest pairs keeps
+        // threads from idling on a few expensive pairs at the end
+        std::stable_sort(tasks.begin(), tasks.end(),
+                         [](const Task &lhs, const Task &rhs) { return lhs.cost > rhs.cost; });
+
+        // every task writes only to its own slot, no locking needed
+        std::vector<PairwiseMCS> results(tasks.size());
+
+#pragma omp parallel shared(tasks, results) default(none)
+        {
+            RDKit::MCSParameters strictParams = Matcher::getStrictMCSParams();
+            RDKit::MCSParameters relaxedParams = Matcher::getRelaxedMCSParams();
+
+#pragma omp for schedule(dynamic, 1)
+            for (std::size_t taskId = 0; taskId < tasks.size(); taskId++) {
+                const auto &task = tasks.at(taskId);
+                results.at(taskId) = calculate(task.pair, task.strict, task.strict ? strictParams : relaxedParams);
+            }
+        }
+
+        for (std::size_t taskId = 0; taskId < tasks.size(); taskId++) {
+            auto &map = tasks.at(taskId).strict ? strictMap : relaxedMap;
+            map.emplace(tasks.at(taskId).pair, std::move(results.at(taskId)));
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned PairwiseMCSCalculator::getNumLigands() const noexcept { return m_molecules.size(); }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    const RDKit::ROMol &PairwiseMCSCalculator::getMolecule(multialign::LigandID id) const {
+        return *m_molecules.at(id);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    const RDKit::ROMol &PairwiseMCSCalculator::getMoleculeWithoutHs(multialign::LigandID id) const {
+        return *m_moleculesWithoutHs.at(id);
+    }
+}  // namespace coaler::core
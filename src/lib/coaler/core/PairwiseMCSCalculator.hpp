@@ -0,0 +1,147 @@
+#pragma once
+
+#include <GraphMol/FMCS/FMCS.h>
+#include <GraphMol/ROMol.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Matcher.hpp"
+#include "coaler/io/CanonicalMolecule.hpp"
+#include "coaler/multialign/models/Forward.hpp"
+
+/**
+ * @file PairwiseMCSCalculator.hpp
+ * @brief This file contains the PairwiseMCSCalculator class which calculates the MCS of ligand pairs.
+ */
+namespace coaler::core {
+
+    /**
+     * Algorithm used to calculate the MCS of a ligand pair.
+     */
+    enum class PairwiseMCSAlgorithm {
+        // RDKit::findMCS seeded with the core SMARTS
+        FMCS,
+        // side chain growth from the core correspondence of both ligands, see CoreSeededMCS
+        CoreGrowth,
+    };
+
+    /**
+     * The PairwiseMCSCalculator class calculates strict and relaxed MCS of ligand pairs.
+     *
+     * Hydrogen free copies and the canonical forms of all ligands are prepared once on construction, so the
+     * concurrent tasks only read the ligands. All (pair, strictness) tasks are
+     * calculated in a single flattened pass that is scheduled dynamically, largest pairs first, so the triangle of
+     * ligand pairs does not lead to an unbalanced load. Every thread uses its own MCS parameter objects and writes
+     * to its own result slot.
+     */
+    class PairwiseMCSCalculator {
+      public:
+        /**
+         * @param ligands The ligands to calculate pairwise MCS for.
+         * @param seed SMARTS the MCS searches are seeded with (usually the core).
+         * @param cache Optional persistent cache to look up and store the pairwise MCS in.
+         */
+        PairwiseMCSCalculator(const multialign::LigandVector& ligands, std::string seed,
+                              io::PairwiseMCSCache* cache = nullptr);
+
+        /**
+         * Calculate the MCS of a single ligand pair.
+         * @param pair The ligand pair.
+         * @param strict Whether to use strict or relaxed MCS parameters.
+         * @param mcsParams The parameter object to use, the initial seed is set by this function. Must not be
+         * shared between threads.
+         * @return The MCS with matches in order (pair.getFirst(), pair.getSecond()), empty if none was found.
+         */
+        PairwiseMCS calculate(const multialign::LigandPair& pair, bool strict, RDKit::MCSParameters& mcsParams) const;
+
+        /**
+         * Enable the RASCAL similarity prescreen. Pairs whose RASCAL similarity bound is below @param threshold are
+         * resolved with the matches of the seed instead of a MCS search. A threshold of 0 disables the prescreen.
+         */
+        void setPrescreenThreshold(double threshold);
+
+        /**
+         * Select the algorithm of the MCS calculation. Core growth falls back to findMCS for pairs without core
+         * matches. It neither uses the cache nor the prescreen: its results are cheap to recompute and a grown MCS
+         * always contains the seed matches the prescreen would resolve a pair with.
+         * @param coreMatches All matches of the seed in every ligand, the correspondences the core growth starts from
+         * (e.g. the matches of ConformerEmbedder::getCoreMatches()). Only used by core growth.
+         */
+        void setAlgorithm(PairwiseMCSAlgorithm algorithm,
+                          std::vector<std::vector<RDKit::MatchVectType>> coreMatches = {});
+
+        /**
+         * @return The number of pairs resolved by the prescreen.
+         */
+        [[nodiscard]] unsigned getNumPrescreened() const noexcept;
+
+        /**
+         * Calculate the strict and relaxed MCS of all ligand pairs in a single pass.
+         * @return maps of the strict and the relaxed pairwise MCS
+         */
+        [[nodiscard]] std::pair<PairwiseMCSMap, PairwiseMCSMap> calculateAll() const;
+
+        /**
+         * Calculate either the strict or the relaxed MCS of all ligand pairs.
+         * @return map of the pairwise MCS
+         */
+        [[nodiscard]] PairwiseMCSMap calculateAll(bool strict) const;
+
+        /**
+         * @return The number of ligands.
+         */
+        [[nodiscard]] unsigned getNumLigands() const noexcept;
+
+        /**
+         * @return The ligand with @param id with hydrogens.
+         */
+        [[nodiscard]] const RDKit::ROMol& getMolecule(multialign::LigandID id) const;
+
+        /**
+         * @return The ligand with @param id without hydrogens.
+         */
+        [[nodiscard]] const RDKit::ROMol& getMoleculeWithoutHs(multialign::LigandID id) const;
+
+      private:
+        struct Task {
+            multialign::LigandPair pair;
+            bool strict;
+            unsigned cost;
+        };
+
+        void calculateTasks(std::vector<Task> tasks, PairwiseMCSMap& strictMap, PairwiseMCSMap& relaxedMap) const;
+
+        /**
+         * @return Whether the RASCAL similarity bound of @param pair is below the prescreen threshold. Evaluated
+         * once per pair.
+         */
+        [[nodiscard]] bool isPrescreened(const multialign::LigandPair& pair) const;
+
+        /**
+         * @return The matches of the seed in both ligands of @param pair, empty if there is no seed or no match.
+         */
+        [[nodiscard]] PairwiseMCS calculateSeedMCS(const multialign::LigandPair& pair) const;
+
+        std::vector<RDKit::ROMOL_SPTR> m_molecules;
+        std::vector<RDKit::ROMOL_SPTR> m_moleculesWithoutHs;
+        // canonical SMILES and ranks of the ligands with hydrogens, they key the cache and name the ligands in logs
+        std::vector<io::CanonicalMolecule> m_canonicalMolecules;
+        std::string m_seed;
+        RDKit::ROMOL_SPTR m_seedQuery;
+        io::PairwiseMCSCache* m_cache;
+
+        PairwiseMCSAlgorithm m_algorithm{PairwiseMCSAlgorithm::FMCS};
+        // all matches of the seed in each ligand, only set for core growth
+        std::vector<std::vector<RDKit::MatchVectType>> m_coreMatches;
+
+        double m_prescreenThreshold{0};
+        mutable std::vector<std::once_flag> m_prescreenOnce;
+        // one entry per pair, written once under m_prescreenOnce
+        mutable std::vector<char> m_prescreenResults;
+        mutable std::atomic<unsigned> m_numPrescreened{0};
+    };
+}  // namespace coaler::core
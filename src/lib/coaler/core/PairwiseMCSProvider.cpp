@@ -0,0 +1,159 @@
+#include "PairwiseMCSProvider.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <unordered_map>
+#include <utility>
+
+#include "coaler/multialign/models/LigandPair.hpp"
+
+namespace {
+    coaler::core::PairwiseMCSFeasibility calculate_feasibility(const RDKit::ROMol &first, const RDKit::ROMol &second,
+                                                               const coaler::core::PairwiseMCS &relaxedMcs) {
+        const auto &[firstMatch, secondMatch, mcsString] = relaxedMcs;
+        coaler::core::PairwiseMCSFeasibility feasibility;
+        feasibility.firstCoverage = static_cast<double>(firstMatch.size()) / first.getNumAtoms();
+        feasibility.secondCoverage = static_cast<double>(secondMatch.size()) / second.getNumAtoms();
+
+        std::unordered_map<int, int> secondByQueryId(secondMatch.begin(), secondMatch.end());
+        for (const auto &[queryId, firstId] : firstMatch) {
+            const auto secondId = secondByQueryId.find(queryId);
+            if (secondId == secondByQueryId.end()) {
+                continue;
+            }
+            const auto firstTag = first.getAtomWithIdx(firstId)->getChiralTag();
+            const auto secondTag = second.getAtomWithIdx(secondId->second)->getChiralTag();
+            if (firstTag == secondTag) {
+                continue;
+            }
+            // a chiral atom of the embedding target has to keep its tag in the embedded ligand
+            if (secondTag != RDKit::Atom::CHI_UNSPECIFIED) {
+                feasibility.firstChiralityCompatible = false;
+            }
+            if (firstTag != RDKit::Atom::CHI_UNSPECIFIED) {
+                feasibility.secondChiralityCompatible = false;
+            }
+        }
+        return feasibility;
+    }
+}  // namespace
+
+namespace coaler::core {
+    PairwiseMCSProvider::PairwiseMCSProvider(const multialign::LigandVector &ligands, std::string seed,
+                                             io::PairwiseMCSCache *cache)
+        : m_calculator(ligands, std::move(seed), cache),
+          m_numLigands(ligands.size()),
+          // one strict and one relaxed slot per pair
+          m_slots(ligands.size() * (ligands.size() - 1)) {}
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSProvider::computeAll() {
+        auto [strictMap, relaxedMap] = m_calculator.calculateAll();
+
+        const auto store = [this](PairwiseMCSMap &map, bool strict) {
+            for (auto &entry : map) {
+                auto &slot = m_slots.at(getSlotIndex(entry.first, strict));
+                std::call_once(slot.computed, [this, &slot, &entry, strict]() {
+                    storeMcs(slot, entry.first, strict, std::move(entry.second));
+                });
+            }
+        };
+        store(strictMap, true);
+        store(relaxedMap, false);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSProvider::setPrescreenThreshold(double threshold) { m_calculator.setPrescreenThreshold(threshold); }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSProvider::setAlgorithm(PairwiseMCSAlgorithm algorithm,
+                                           std::vector<std::vector<RDKit::MatchVectType>> coreMatches) {
+        m_calculator.setAlgorithm(algorithm, std::move(coreMatches));
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    const PairwiseMCS &PairwiseMCSProvider::get(const multialign::LigandPair &pair, bool strict) const {
+        auto &slot = m_slots.at(getSlotIndex(pair, strict));
+        slot.requested = true;
+        std::call_once(slot.computed, [&slot, &pair, strict, this]() {
+            RDKit::MCSParameters mcsParams = strict ? Matcher::getStrictMCSParams() : Matcher::getRelaxedMCSParams();
+            storeMcs(slot, pair, strict, m_calculator.calculate(pair, strict, mcsParams));
+        });
+
+        return slot.mcs;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    const PairwiseMCSFeasibility &PairwiseMCSProvider::getFeasibility(const multialign::LigandPair &pair) const {
+        get(pair, false);
+        return m_slots.at(getSlotIndex(pair, false)).feasibility;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSProvider::storeMcs(Slot &slot, const multialign::LigandPair &pair, bool strict,
+                                       PairwiseMCS mcs) const {
+        slot.mcs = std::move(mcs);
+        if (!strict) {
+            slot.feasibility = calculate_feasibility(m_calculator.getMolecule(pair.getFirst()),
+                                                     m_calculator.getMolecule(pair.getSecond()), slot.mcs);
+        }
+        m_numComputed++;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::size_t PairwiseMCSProvider::getSlotIndex(const multialign::LigandPair &pair, bool strict) const {
+        // index of the pair in the upper triangle of the ligand matrix (without the diagonal)
+        const std::size_t first = pair.getFirst();
+        const std::size_t second = pair.getSecond();
+        const std::size_t pairIndex = first * m_numLigands - first * (first + 1) / 2 + (second - first - 1);
+        return 2 * pairIndex + (strict ? 0 : 1);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned PairwiseMCSProvider::getNumPairs() const noexcept { return m_slots.size() / 2; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned PairwiseMCSProvider::getNumRequested() const {
+        unsigned numRequested = 0;
+        for (const auto &slot : m_slots) {
+            numRequested += slot.requested ? 1 : 0;
+        }
+        return numRequested;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned PairwiseMCSProvider::getNumComputed() const noexcept { return m_numComputed; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned PairwiseMCSProvider::getNumUnusedPairs() const {
+        unsigned numUnused = 0;
+        for (std::size_t slotId = 0; slotId < m_slots.size(); slotId += 2) {
+            if (!m_slots.at(slotId).requested && !m_slots.at(slotId + 1).requested) {
+                numUnused++;
+            }
+        }
+        return numUnused;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSProvider::logStatistics() const {
+        spdlog::info("pairwise MCS: {} of {} strict/relaxed MCS requested, {} computed, {} of {} pairs never needed",
+                     getNumRequested(), m_slots.size(), getNumComputed(), getNumUnusedPairs(), getNumPairs());
+        if (m_calculator.getNumPrescreened() > 0) {
+            spdlog::info("pairwise MCS: {} pairs resolved by the similarity prescreen",
+                         m_calculator.getNumPrescreened());
+        }
+    }
+}  // namespace coaler::core
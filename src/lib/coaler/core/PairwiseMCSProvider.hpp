@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Matcher.hpp"
+#include "PairwiseMCSCalculator.hpp"
+
+/**
+ * @file PairwiseMCSProvider.hpp
+ * @brief This file contains the PairwiseMCSProvider class which provides the pairwise MCS of ligand pairs on demand.
+ */
+namespace coaler::core {
+
+    /**
+     * Embedding feasibility of a ligand pair, derived from its relaxed MCS.
+     */
+    struct PairwiseMCSFeasibility {
+        // fraction of the atoms of the first/second ligand covered by the relaxed MCS
+        double firstCoverage{0};
+        double secondCoverage{0};
+        // whether the first/second ligand can be embedded onto the other one, i.e. whether all chiral atoms of the
+        // other ligand are mapped onto atoms with the same chiral tag. Otherwise the embedding takes long and fails.
+        bool firstChiralityCompatible{true};
+        bool secondChiralityCompatible{true};
+    };
+
+    /**
+     * The PairwiseMCSProvider class provides the strict and relaxed MCS of ligand pairs.
+     *
+     * The MCS of a pair is calculated the first time it is requested and memoized afterwards, so pairs the optimizer
+     * never regenerates poses for are never calculated. Requests are thread-safe, concurrent requests of the same pair
+     * wait for a single calculation. computeAll() calculates all pairs up front instead.
+     */
+    class PairwiseMCSProvider {
+      public:
+        /**
+         * @param ligands The ligands to provide pairwise MCS for.
+         * @param seed SMARTS the MCS searches are seeded with (usually the core).
+         * @param cache Optional persistent cache to look up and store the pairwise MCS in.
+         */
+        PairwiseMCSProvider(const multialign::LigandVector& ligands, std::string seed,
+                            io::PairwiseMCSCache* cache = nullptr);
+
+        /**
+         * Calculate the MCS of all pairs up front in a single parallel pass (eager mode).
+         */
+        void computeAll();
+
+        /**
+         * Enable the RASCAL similarity prescreen, see PairwiseMCSCalculator::setPrescreenThreshold().
+         */
+        void setPrescreenThreshold(double threshold);
+
+        /**
+         * Select the algorithm of the MCS calculation, see PairwiseMCSCalculator::setAlgorithm().
+         */
+        void setAlgorithm(PairwiseMCSAlgorithm algorithm,
+                          std::vector<std::vector<RDKit::MatchVectType>> coreMatches = {});
+
+        /**
+         * Get the MCS of a ligand pair, calculates it if it was not requested before.
+         * @param pair The ligand pair.
+         * @param strict Whether to get the strict or the relaxed MCS.
+         * @return The MCS with matches in order (pair.getFirst(), pair.getSecond()), empty if none was found.
+         */
+        const PairwiseMCS& get(const multialign::LigandPair& pair, bool strict) const;
+
+        /**
+         * Get the embedding feasibility of a ligand pair, calculated once together with the relaxed MCS.
+         * @param pair The ligand pair.
+         * @return The feasibility in order (pair.getFirst(), pair.getSecond()).
+         */
+        const PairwiseMCSFeasibility& getFeasibility(const multialign::LigandPair& pair) const;
+
+        /**
+         * @return The number of ligand pairs.
+         */
+        [[nodiscard]] unsigned getNumPairs() const noexcept;
+
+        /**
+         * @return The number of strict and relaxed MCS that were requested.
+         */
+        [[nodiscard]] unsigned getNumRequested() const;
+
+        /**
+         * @return The number of strict and relaxed MCS that were calculated (or loaded from the cache).
+         */
+        [[nodiscard]] unsigned getNumComputed() const noexcept;
+
+        /**
+         * @return The number of ligand pairs whose MCS was never requested.
+         */
+        [[nodiscard]] unsigned getNumUnusedPairs() const;
+
+        /**
+         * Log the request statistics.
+         */
+        void logStatistics() const;
+
+      private:
+        struct Slot {
+            std::once_flag computed;
+            std::atomic<bool> requested{false};
+            PairwiseMCS mcs;
+            // only set for relaxed slots
+            PairwiseMCSFeasibility feasibility;
+        };
+
+        [[nodiscard]] std::size_t getSlotIndex(const multialign::LigandPair& pair, bool strict) const;
+
+        void storeMcs(Slot& slot, const multialign::LigandPair& pair, bool strict, PairwiseMCS mcs) const;
+
+        PairwiseMCSCalculator m_calculator;
+        unsigned m_numLigands;
+        mutable std::vector<Slot> m_slots;
+        mutable std::atomic<unsigned> m_numComputed{0};
+    };
+}  // namespace coaler::core
@@ -0,0 +1,117 @@
+#include "TaskGraph.hpp"
+
+#include <array>
+#include <cassert>
+#include <exception>
+#include <utility>
+
+namespace coaler::core {
+    TaskGraph::TaskID TaskGraph::addTask(std::function<void()> work, const std::vector<TaskID> &dependencies,
+                                         int priority, Stage stage) {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        const TaskID id = m_tasks.size();
+        Task task;
+        task.work = std::move(work);
+        task.priority = priority;
+        task.stage = stage;
+        for (const TaskID dependency : dependencies) {
+            assert(dependency < id);
+            if (!m_tasks.at(dependency).finished) {
+                m_tasks.at(dependency).dependents.push_back(id);
+                task.numDependencies++;
+            }
+        }
+        m_tasks.push_back(std::move(task));
+        m_numUnfinished++;
+
+        if (m_tasks.at(id).numDependencies == 0) {
+            m_ready.insert(id);
+            m_changed.notify_all();
+        }
+        return id;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void TaskGraph::run(const ThreadBudget &budget) {
+        std::array<int, static_cast<std::size_t>(Stage::Count)> numRunning{};
+        // the first ready task whose stage has a free thread, m_ready.end() if there is none
+        const auto nextTask = [&]() {
+            for (auto task = m_ready.begin(); task != m_ready.end(); task++) {
+                const Stage stage = m_tasks.at(*task).stage;
+                if (numRunning.at(static_cast<std::size_t>(stage)) < budget.getThreads(stage)) {
+                    return task;
+                }
+            }
+            return m_ready.end();
+        };
+
+        std::exception_ptr error;
+
+#pragma omp parallel num_threads(budget.getTotal()) shared(numRunning, nextTask, error)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true) {
+                // after an error no further tasks are started, the running ones finish before the region ends
+                m_changed.wait(lock, [&]() { return nextTask() != m_ready.end() || m_numUnfinished == 0 || error; });
+                if (m_numUnfinished == 0 || error) {
+                    break;
+                }
+
+                const auto task = nextTask();
+                const TaskID id = *task;
+                m_ready.erase(task);
+                const auto stageIndex = static_cast<std::size_t>(m_tasks.at(id).stage);
+                numRunning.at(stageIndex)++;
+                // the task can add tasks to m_tasks while it runs, so its work is taken out first
+                const std::function<void()> work = std::move(m_tasks.at(id).work);
+                lock.unlock();
+
+                std::exception_ptr taskError;
+                try {
+                    work();
+                } catch (...) {
+                    taskError = std::current_exception();
+                }
+
+                lock.lock();
+                m_numUnfinished--;
+                numRunning.at(stageIndex)--;
+                if (taskError && !error) {
+                    error = taskError;
+                }
+                m_tasks.at(id).finished = true;
+                for (const TaskID dependent : m_tasks.at(id).dependents) {
+                    if (--m_tasks.at(dependent).numDependencies == 0) {
+                        m_ready.insert(dependent);
+                    }
+                }
+                m_changed.notify_all();
+            }
+            m_changed.notify_all();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void TaskGraph::run(int numThreads) { this->run(ThreadBudget(numThreads)); }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::size_t TaskGraph::getNumTasks() const noexcept { return m_tasks.size(); }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool TaskGraph::ReadyOrder::operator()(TaskID lhs, TaskID rhs) const {
+        const int lhsPriority = graph->m_tasks.at(lhs).priority;
+        const int rhsPriority = graph->m_tasks.at(rhs).priority;
+        if (lhsPriority != rhsPriority) {
+            return lhsPriority > rhsPriority;
+        }
+        return lhs < rhs;
+    }
+}  // namespace coaler::core
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "ThreadBudget.hpp"
+
+/**
+ * @file TaskGraph.hpp
+ * @brief This file contains the TaskGraph class which runs tasks as soon as their dependencies are finished.
+ */
+namespace coaler::core {
+
+    /**
+     * The TaskGraph class runs a set of tasks with dependencies on a pool of threads.
+     *
+     * A task is started as soon as all tasks it depends on are finished, so independent stages overlap instead of
+     * waiting for each other. Among the ready tasks, the ones with the highest priority (and then the ones added
+     * first) are started first. Every task belongs to a stage and no more tasks of a stage run at once than the
+     * ThreadBudget grants it. Tasks can add further tasks while the graph runs, e.g. when the work that depends on
+     * them is only known once they are finished.
+     */
+    class TaskGraph {
+      public:
+        using TaskID = std::size_t;
+
+        TaskGraph() = default;
+        TaskGraph(const TaskGraph&) = delete;
+        TaskGraph& operator=(const TaskGraph&) = delete;
+
+        /**
+         * Add a task to the graph, also from within a running task. The graph keeps running until the added tasks
+         * are finished as well.
+         * @param work The work of the task.
+         * @param dependencies Tasks that have to be finished before this one starts, they have to be added before.
+         * Dependencies that are already finished are ignored.
+         * @param priority Ready tasks with higher priority are started first.
+         * @param stage The stage whose threads the task runs on.
+         * @return The id of the task.
+         */
+        TaskID addTask(std::function<void()> work, const std::vector<TaskID>& dependencies = {}, int priority = 0,
+                       Stage stage = Stage::Core);
+
+        /**
+         * Run all tasks on the total threads of @param budget and wait for them. At most as many tasks of a stage run
+         * at once as @param budget grants the stage.
+         *
+         * @note If a task throws, no further tasks are started and the first exception is rethrown after the running
+         * tasks are finished.
+         */
+        void run(const ThreadBudget& budget);
+
+        /**
+         * @overload
+         *
+         * Run all tasks on @param numThreads threads shared by all stages.
+         */
+        void run(int numThreads);
+
+        /**
+         * @return The number of tasks in the graph.
+         */
+        [[nodiscard]] std::size_t getNumTasks() const noexcept;
+
+      private:
+        struct Task {
+            std::function<void()> work;
+            std::vector<TaskID> dependents;
+            // dependencies that are not finished yet
+            unsigned numDependencies{0};
+            int priority{0};
+            Stage stage{Stage::Core};
+            bool finished{false};
+        };
+
+        // highest priority first, then the task added first
+        struct ReadyOrder {
+            const TaskGraph* graph;
+            bool operator()(TaskID lhs, TaskID rhs) const;
+        };
+
+        // all members are guarded by m_mutex while the graph runs
+        std::vector<Task> m_tasks;
+        std::set<TaskID, ReadyOrder> m_ready{ReadyOrder{this}};
+        std::size_t m_numUnfinished{0};
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+    };
+}  // namespace coaler::core
@@ -0,0 +1,62 @@
+#include "ThreadBudget.hpp"
+
+#include <omp.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace {
+    const char *get_stage_name(coaler::core::Stage stage) {
+        switch (stage) {
+            case coaler::core::Stage::Core:
+                return "core";
+            case coaler::core::Stage::Embedding:
+                return "embedding";
+            case coaler::core::Stage::PairwiseMCS:
+                return "pairwise MCS";
+            case coaler::core::Stage::Scoring:
+                return "scoring";
+            case coaler::core::Stage::Optimization:
+                return "optimization";
+            default:
+                return "unknown";
+        }
+    }
+}  // namespace
+
+namespace coaler::core {
+    ThreadBudget::ThreadBudget(int numThreads) : m_total(std::max(numThreads, 1)), m_stageThreads() {
+        m_stageThreads.fill(m_total);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ThreadBudget::setThreads(Stage stage, int numThreads) {
+        if (numThreads > m_total) {
+            spdlog::warn("{} stage limited to {} threads, only {} threads available", get_stage_name(stage), numThreads,
+                         m_total);
+        }
+        m_stageThreads.at(static_cast<std::size_t>(stage)) = numThreads <= 0 ? m_total : std::min(numThreads, m_total);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    int ThreadBudget::getThreads(Stage stage) const { return m_stageThreads.at(static_cast<std::size_t>(stage)); }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    int ThreadBudget::getTotal() const noexcept { return m_total; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ThreadBudget::enterStage(Stage stage) const { omp_set_num_threads(getThreads(stage)); }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    int ThreadBudget::getNestedShare(int numThreads) {
+        if (!omp_in_parallel()) {
+            return std::max(numThreads, 1);
+        }
+        return std::max(numThreads / omp_get_num_threads(), 1);
+    }
+}  // namespace coaler::core
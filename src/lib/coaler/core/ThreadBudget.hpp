@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+
+/**
+ * @file ThreadBudget.hpp
+ * @brief This file contains the ThreadBudget class which distributes the threads of a run among its stages.
+ */
+namespace coaler::core {
+
+    /**
+     * The stages of an alignment run that use threads.
+     */
+    enum class Stage { Core, Embedding, PairwiseMCS, Scoring, Optimization, Count };
+
+    /**
+     * The ThreadBudget class owns the number of threads of a run and the share of every stage.
+     *
+     * Every stage uses all threads unless it is limited with setThreads(). OpenMP regions without an explicit thread
+     * count use the threads of the stage entered last, see enterStage(). Calls that are nested in a parallel region
+     * and would start threads of their own (e.g. RDKit embeddings or substructure searches) request their share
+     * with getNestedShare(), so nested parallelism never oversubscribes the budget.
+     */
+    class ThreadBudget {
+      public:
+        /**
+         * @param numThreads The total number of threads, at least 1.
+         */
+        explicit ThreadBudget(int numThreads);
+
+        /**
+         * Limit @param stage to @param numThreads threads, 0 (or more than the total) uses all threads.
+         */
+        void setThreads(Stage stage, int numThreads);
+
+        /**
+         * @return The number of threads of @param stage.
+         */
+        [[nodiscard]] int getThreads(Stage stage) const;
+
+        /**
+         * @return The total number of threads.
+         */
+        [[nodiscard]] int getTotal() const noexcept;
+
+        /**
+         * Use the threads of @param stage for OpenMP regions without an explicit thread count.
+         */
+        void enterStage(Stage stage) const;
+
+        /**
+         * @return The share of @param numThreads threads that a call may use from within the current OpenMP team,
+         * @param numThreads outside of parallel regions and at least 1.
+         */
+        static int getNestedShare(int numThreads);
+
+      private:
+        int m_total;
+        std::array<int, static_cast<std::size_t>(Stage::Count)> m_stageThreads;
+    };
+}  // namespace coaler::core
@@ -0,0 +1,94 @@
+#include "ConformerBudget.hpp"
+
+#include <GraphMol/Descriptors/Lipinski.h>
+#include <GraphMol/MolOps.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+    // rotatable bonds dominate, a flexible ring adds about half as many conformations
+    const double FLEXIBLE_RING_WEIGHT = 0.5;
+    // rings with less atoms are rigid
+    const unsigned MIN_FLEXIBLE_RING_SIZE = 5;
+    const unsigned SCALE_SEARCH_ITERATIONS = 64;
+}  // namespace
+
+namespace coaler::embedder {
+    ConformerBudget::ConformerBudget(unsigned long maxPosePairs, unsigned minConformers, unsigned maxConformers)
+        : m_maxPosePairs(maxPosePairs), m_minConformers(minConformers), m_maxConformers(maxConformers) {
+        assert(minConformers <= maxConformers);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    double ConformerBudget::getFlexibility(const RDKit::ROMol &mol, unsigned numCoreMatches) {
+        if (!mol.getRingInfo()->isInitialized()) {
+            RDKit::MolOps::findSSSR(mol);
+        }
+
+        unsigned numFlexibleRings = 0;
+        for (const auto &ring : mol.getRingInfo()->bondRings()) {
+            const bool isAromatic = std::any_of(ring.begin(), ring.end(), [&](int bondId) {
+                return mol.getBondWithIdx(bondId)->getIsAromatic();
+            });
+            if (!isAromatic && ring.size() >= MIN_FLEXIBLE_RING_SIZE) {
+                numFlexibleRings++;
+            }
+        }
+
+        const unsigned numRotatableBonds = RDKit::Descriptors::calcNumRotatableBonds(mol);
+        return std::max(numCoreMatches, 1U)
+               * (1.0 + numRotatableBonds + FLEXIBLE_RING_WEIGHT * numFlexibleRings);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::vector<unsigned> ConformerBudget::distribute(const std::vector<double> &flexibilities) const {
+        const std::vector<unsigned> minimal = this->scale(flexibilities, 0);
+        if (countPosePairs(minimal) >= m_maxPosePairs || flexibilities.empty()) {
+            return minimal;
+        }
+
+        // the number of pose pairs grows monotonically with the factor, bisect the largest one within the target
+        const double minFlexibility = *std::min_element(flexibilities.begin(), flexibilities.end());
+        double lower = 0;
+        double upper = m_maxConformers / std::max(minFlexibility, 1e-6);
+        for (unsigned i = 0; i < SCALE_SEARCH_ITERATIONS; i++) {
+            const double factor = (lower + upper) / 2;
+            if (countPosePairs(this->scale(flexibilities, factor)) <= m_maxPosePairs) {
+                lower = factor;
+            } else {
+                upper = factor;
+            }
+        }
+        return this->scale(flexibilities, lower);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned long ConformerBudget::countPosePairs(const std::vector<unsigned> &numConformers) {
+        // sum_{i<j} k_i * k_j = ((sum k_i)^2 - sum k_i^2) / 2
+        unsigned long sum = 0;
+        unsigned long sumOfSquares = 0;
+        for (const unsigned count : numConformers) {
+            sum += count;
+            sumOfSquares += static_cast<unsigned long>(count) * count;
+        }
+        return (sum * sum - sumOfSquares) / 2;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::vector<unsigned> ConformerBudget::scale(const std::vector<double> &flexibilities, double factor) const {
+        std::vector<unsigned> numConformers;
+        numConformers.reserve(flexibilities.size());
+        for (const double flexibility : flexibilities) {
+            const double count = std::round(factor * flexibility);
+            numConformers.push_back(static_cast<unsigned>(
+                std::clamp(count, static_cast<double>(m_minConformers), static_cast<double>(m_maxConformers))));
+        }
+        return numConformers;
+    }
+}  // namespace coaler::embedder
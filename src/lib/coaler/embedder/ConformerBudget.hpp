@@ -0,0 +1,55 @@
+#pragma once
+
+#include <GraphMol/ROMol.h>
+
+#include <vector>
+
+/**
+ * @file ConformerBudget.hpp
+ * @brief This file contains the ConformerBudget class which distributes conformers among ligands by flexibility.
+ */
+namespace coaler::embedder {
+
+    /**
+     * The ConformerBudget class sets the number of conformers of every ligand proportional to its flexibility.
+     *
+     * Every pose pair of two ligands is scored, so the cost of the alignment grows with sum_{i<j} k_i * k_j for k_i
+     * conformers of ligand i. Instead of a fixed count for every ligand, the counts are scaled with the flexibility
+     * so that this sum stays below a target. Rigid ligands get few conformers, flexible ones get more.
+     */
+    class ConformerBudget {
+      public:
+        /**
+         * @param maxPosePairs Target for the total number of pose pairs of all ligand pairs.
+         * @param minConformers Minimal number of conformers of a ligand.
+         * @param maxConformers Maximal number of conformers of a ligand.
+         */
+        ConformerBudget(unsigned long maxPosePairs, unsigned minConformers, unsigned maxConformers);
+
+        /**
+         * @param mol The ligand.
+         * @param numCoreMatches Number of distinct core matches of the ligand.
+         * @return The relative flexibility of the ligand, based on its rotatable bonds, its flexible (non aromatic,
+         * at least 5 membered) rings and the number of core matches.
+         */
+        static double getFlexibility(const RDKit::ROMol& mol, unsigned numCoreMatches);
+
+        /**
+         * @param flexibilities The flexibility of every ligand, see getFlexibility().
+         * @return The number of conformers of every ligand, at least minConformers even if the target is exceeded.
+         */
+        [[nodiscard]] std::vector<unsigned> distribute(const std::vector<double>& flexibilities) const;
+
+        /**
+         * @return The number of pose pairs of all ligand pairs for @param numConformers conformers per ligand.
+         */
+        static unsigned long countPosePairs(const std::vector<unsigned>& numConformers);
+
+      private:
+        [[nodiscard]] std::vector<unsigned> scale(const std::vector<double>& flexibilities, double factor) const;
+
+        unsigned long m_maxPosePairs;
+        unsigned m_minConformers;
+        unsigned m_maxConformers;
+    };
+}  // namespace coaler::embedder
@@ -1,20 +1,53 @@
 #include "ConformerEmbedder.hpp"
 
+#include <DistGeom/BoundsMatrix.h>
+#include <DistGeom/TriangleSmooth.h>
+#include <ForceField/ForceField.h>
 #include <GraphMol/Atom.h>
+#include <GraphMol/DistGeomHelpers/BoundsMatrixBuilder.h>
 #include <GraphMol/DistGeomHelpers/Embedder.h>
 #include <GraphMol/FMCS/FMCS.h>
+#include <GraphMol/ForceFieldHelpers/UFF/AtomTyper.h>
+#include <GraphMol/ForceFieldHelpers/UFF/Builder.h>
 #include <GraphMol/ForceFieldHelpers/UFF/UFF.h>
 #include <GraphMol/MolAlign/AlignMolecules.h>
 #include <GraphMol/SmilesParse/SmartsWrite.h>
 #include <GraphMol/SmilesParse/SmilesWrite.h>
 #include <GraphMol/Substruct/SubstructMatch.h>
+#include <Numerics/Alignment/AlignPoints.h>
 #include <spdlog/spdlog.h>
 
+#include <boost/functional/hash.hpp>
+#include <chrono>
+#include <exception>
+#include <limits>
+#include <numeric>
 #include <utility>
 
+#include "ConformerFilter.hpp"
+#include "KabschSuperposer.hpp"
+#include "SubstructureAnalyzer.hpp"
+#include "TorsionDriver.hpp"
+
 const unsigned SEED = 42;
 const float FORCE_TOL = 0.0135;
 const unsigned BRUTEFORCE_CONFS = 500;
+const unsigned TRANSPLANT_MAX_ITERATIONS = 200;
+// kcal/mol a transplanted pose may be above the conformer it was built from
+const double TRANSPLANT_ENERGY_WINDOW = 50.0;
+const unsigned SUPERPOSED_POSES_PER_TARGET = 2;
+const std::string CORE_MATCHES_PROP = "_coalerCoreMatches";
+const std::string BOUNDS_MATRIX_PROP = "_coalerBoundsMatrix";
+const std::string UFF_PARAMS_PROP = "_coalerUFFParams";
+// defaults of RDKit::UFF::UFFOptimizeMoleculeConfs
+const unsigned UFF_MAX_ITERATIONS = 1000;
+const double UFF_VDW_THRESHOLD = 10.0;
+// smoothing tolerance of bounds with coordinate constraints, as used by RDKit
+const double COORD_MAP_SMOOTHING_TOL = 0.05;
+// conformers per embedding task of embedConformers()
+const unsigned EMBEDDING_BATCH_SIZE = 5;
+// new poses within this heavy atom rmsd (without superposition) of an existing pose are duplicates
+const double DUPLICATE_POSE_RMSD = 0.1;
 
 namespace {
     RDKit::SubstructMatchParameters get_optimizer_substruct_params() {
@@ -30,16 +63,162 @@ namespace {
 
     /*----------------------------------------------------------------------------------------------------------------*/
 
-    RDKit::DGeomHelpers::EmbedParameters get_embed_params_for_optimizer_generation() {
+    RDKit::DGeomHelpers::EmbedParameters get_embed_params_for_optimizer_generation(int seed) {
         RDKit::DGeomHelpers::EmbedParameters params;
         params = RDKit::DGeomHelpers::srETKDGv3;
         params.optimizerForceTol = FORCE_TOL;
-        params.randomSeed = SEED;
+        params.randomSeed = seed;
         params.useRandomCoords = true;
         params.numThreads = 1;
         params.clearConfs = false;
         return params;
     }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // the topological bounds of the molecule with the distances between the atoms of the coordinate map fixed,
+    // triangle smoothed. nullptr if the constraints are inconsistent with the topology.
+    boost::shared_ptr<const DistGeom::BoundsMatrix> get_constrained_bounds(
+        const RDKit::ROMol &mol, const coaler::embedder::CoreAtomMapping &coordMap) {
+        DistGeom::BoundsMatPtr bounds(
+            new DistGeom::BoundsMatrix(*coaler::embedder::ConformerEmbedder::getTopologicalBounds(mol)));
+        for (auto first = coordMap.begin(); first != coordMap.end(); first++) {
+            for (auto second = std::next(first); second != coordMap.end(); second++) {
+                const double distance = (first->second - second->second).length();
+                bounds->setUpperBound(first->first, second->first, distance);
+                bounds->setLowerBound(first->first, second->first, distance);
+            }
+        }
+        if (!DistGeom::triangleSmoothBounds(bounds, COORD_MAP_SMOOTHING_TOL)) {
+            return nullptr;
+        }
+        return bounds;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // the UFF atom types of the molecule, stored like the other topology data, see precomputeTopology()
+    std::shared_ptr<const RDKit::UFF::AtomicParamVect> get_uff_params(const RDKit::ROMol &mol) {
+        if (mol.hasProp(UFF_PARAMS_PROP)) {
+            return mol.getProp<std::shared_ptr<const RDKit::UFF::AtomicParamVect>>(UFF_PARAMS_PROP);
+        }
+
+        auto [types, complete] = RDKit::UFF::getAtomTypes(mol);
+        if (!complete) {
+            // writing SMILES sets properties, the shared molecule is only read
+            spdlog::warn("missing UFF parameters for {}", RDKit::MolToSmiles(RDKit::ROMol(mol)));
+        }
+        std::shared_ptr<const RDKit::UFF::AtomicParamVect> result
+            = std::make_shared<const RDKit::UFF::AtomicParamVect>(std::move(types));
+        mol.setProp(UFF_PARAMS_PROP, result);
+        return result;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    /**
+     * Thrown by the embed callback to cancel an embedding whose deadline passed.
+     */
+    struct EmbedTimeout : std::exception {};
+
+    const auto NO_DEADLINE = std::chrono::steady_clock::time_point::max();
+
+    // the embedding of every thread runs single threaded, so the deadline is the cancellation token of the thread
+    thread_local std::chrono::steady_clock::time_point embed_deadline = NO_DEADLINE;
+
+    // RDKit calls the callback on every embedding iteration and ignores it otherwise, so the only way to cancel the
+    // embedding is to throw through it
+    void check_embed_deadline(unsigned /* iteration */) {
+        if (std::chrono::steady_clock::now() > embed_deadline) {
+            throw EmbedTimeout();
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    double signed_volume(const RDKit::Conformer &conformer, unsigned center, const std::vector<unsigned> &neighbors) {
+        const RDGeom::Point3D &centerPos = conformer.getAtomPos(center);
+        const RDGeom::Point3D first = conformer.getAtomPos(neighbors.at(0)) - centerPos;
+        const RDGeom::Point3D second = conformer.getAtomPos(neighbors.at(1)) - centerPos;
+        const RDGeom::Point3D third = conformer.getAtomPos(neighbors.at(2)) - centerPos;
+        return first.dotProduct(second.crossProduct(third));
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // whether all chiral centers of mol have the same handedness in both conformers
+    bool same_chirality(const RDKit::ROMol &mol, const RDKit::Conformer &first, const RDKit::Conformer &second) {
+        for (const auto *atom : mol.atoms()) {
+            if (atom->getChiralTag() == RDKit::Atom::CHI_UNSPECIFIED || atom->getDegree() < 3) {
+                continue;
+            }
+            std::vector<unsigned> neighbors;
+            for (const auto &neighborId : boost::make_iterator_range(mol.getAtomNeighbors(atom))) {
+                neighbors.push_back(neighborId);
+            }
+            if (signed_volume(first, atom->getIdx(), neighbors) * signed_volume(second, atom->getIdx(), neighbors)
+                < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::size_t hash_positions(const RDGeom::POINT3D_VECT &positions) {
+        std::size_t hash = 0;
+        for (const auto &pos : positions) {
+            boost::hash_combine(hash, pos.x);
+            boost::hash_combine(hash, pos.y);
+            boost::hash_combine(hash, pos.z);
+        }
+        return hash;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // deterministic seed of an embedding onto a target, different for every generation attempt
+    int get_generation_seed(std::uint64_t attemptSeed, coaler::multialign::LigandID ligandID,
+                            coaler::multialign::LigandID targetID) {
+        std::size_t seed = SEED;
+        boost::hash_combine(seed, attemptSeed);
+        boost::hash_combine(seed, ligandID);
+        boost::hash_combine(seed, targetID);
+        // negative seeds make RDKit use a random one
+        return static_cast<int>(seed % static_cast<std::size_t>(std::numeric_limits<int>::max()));
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // whether a conformer is within DUPLICATE_POSE_RMSD of another conformer of the molecule, without superposition
+    bool is_duplicate_pose(const RDKit::ROMol &mol, int confId) {
+        const RDKit::Conformer &conformer = mol.getConformer(confId);
+        std::vector<unsigned> heavyAtoms;
+        for (const auto *atom : mol.atoms()) {
+            if (atom->getAtomicNum() != 1) {
+                heavyAtoms.push_back(atom->getIdx());
+            }
+        }
+        const double maxSquaredDeviation = DUPLICATE_POSE_RMSD * DUPLICATE_POSE_RMSD * heavyAtoms.size();
+
+        for (auto other = mol.beginConformers(); other != mol.endConformers(); other++) {
+            if (static_cast<int>((*other)->getId()) == confId) {
+                continue;
+            }
+            double squaredDeviation = 0;
+            for (const auto atomId : heavyAtoms) {
+                squaredDeviation += (conformer.getAtomPos(atomId) - (*other)->getAtomPos(atomId)).lengthSq();
+                if (squaredDeviation >= maxSquaredDeviation) {
+                    break;
+                }
+            }
+            if (squaredDeviation < maxSquaredDeviation) {
+                return true;
+            }
+        }
+        return false;
+    }
 }  // namespace
 
 namespace coaler::embedder {
@@ -48,44 +227,326 @@ namespace coaler::embedder {
         : m_core(std::move(result)), m_threads(threads), m_divideConformersByMatches(divideConformersByMatches) {}
 
     void ConformerEmbedder::embedConformers(const RDKit::ROMOL_SPTR &mol, unsigned numConfs) {
-        // firstMatch molecule and core
-        RDKit::SubstructMatchParameters substructMatchParams;
-        substructMatchParams.uniquify = false;
-        substructMatchParams.useChirality = false;
-        substructMatchParams.useQueryQueryMatches = false;
-        substructMatchParams.maxMatches = 1000;
-        substructMatchParams.numThreads = m_threads;
+        this->embedConformers(RDKit::MOL_SPTR_VECT{mol}, {numConfs});
+    }
 
-        auto matches = RDKit::SubstructMatch(*mol, *m_core.core, substructMatchParams);
+    /*----------------------------------------------------------------------------------------------------------------*/
 
-        assert(!matches.empty());
+    void ConformerEmbedder::embedConformers(const RDKit::MOL_SPTR_VECT &mols, const std::vector<unsigned> &numConfs) {
+        const EmbeddingPlan plan = this->planEmbedding(mols, numConfs);
 
-        spdlog::debug("number of Core Matches: {}", matches.size());
+        // all tasks share one pool, so neither few large nor many small molecules leave threads idle
+        std::vector<EmbeddingBatch> batches(plan.tasks.size());
+#pragma omp parallel for schedule(dynamic) num_threads(m_threads) default(none) shared(plan, batches)
+        for (unsigned i = 0; i < plan.tasks.size(); i++) {
+            batches.at(i) = this->runEmbeddingTask(*plan.mols.at(plan.tasks.at(i).molIndex), plan.tasks.at(i));
+        }
+
+#pragma omp parallel for schedule(dynamic) num_threads(m_threads) default(none) shared(plan, batches)
+        for (unsigned molIndex = 0; molIndex < plan.mols.size(); molIndex++) {
+            this->mergeEmbedding(plan, molIndex, batches);
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    EmbeddingPlan ConformerEmbedder::planEmbedding(const RDKit::MOL_SPTR_VECT &mols,
+                                                   const std::vector<unsigned> &numConfs) {
+        assert(mols.size() == numConfs.size());
 
-        unsigned matchCounter = 0;
-        if (m_divideConformersByMatches && (numConfs / (float)matches.size()) < 5) {
-            spdlog::warn("adding more conformers to get at least 5 per match");
+        EmbeddingPlan plan;
+        plan.mols = mols;
+        plan.coreSmarts = m_conformerCache != nullptr ? RDKit::MolToSmarts(*m_core.core) : "";
+        plan.cacheParameters.resize(mols.size());
+        plan.isCached.resize(mols.size(), false);
+        plan.numConfsTotal.resize(mols.size(), 0);
+
+        for (unsigned molIndex = 0; molIndex < mols.size(); molIndex++) {
+            const RDKit::ROMOL_SPTR &mol = mols.at(molIndex);
+            this->precomputeTopology(*mol);
+
+            if (m_conformerCache != nullptr) {
+                plan.cacheParameters.at(molIndex) = this->getConformerCacheParameters(numConfs.at(molIndex));
+                if (m_conformerCache->load(*mol, plan.coreSmarts, plan.cacheParameters.at(molIndex))) {
+                    spdlog::debug("loaded {} cached conformers for {}", mol->getNumConformers(),
+                                  RDKit::MolToSmiles(*mol));
+                    plan.isCached.at(molIndex) = true;
+                    continue;
+                }
+            }
+
+            const CoreMatches &matches = *getCoreMatches(*mol);
+            assert(!matches.empty());
+            spdlog::debug("number of Core Matches: {}", matches.size());
+
+            unsigned molNumConfs = numConfs.at(molIndex);
+            if (m_divideConformersByMatches && (molNumConfs / (float)matches.size()) < 5) {
+                spdlog::warn("adding more conformers to get at least 5 per match");
+
+                molNumConfs = matches.size() * 5;
+            }
+
+            for (unsigned matchIndex = 0; matchIndex < matches.size(); matchIndex++) {
+                unsigned numConfsMatch = molNumConfs;
+                if (m_divideConformersByMatches) {
+                    numConfsMatch = (matchIndex < molNumConfs % matches.size())
+                                        ? (int(molNumConfs / matches.size()) + 1)
+                                        : (int(molNumConfs / matches.size()));
+                }
+                plan.numConfsTotal.at(molIndex) += numConfsMatch;
 
-            numConfs = matches.size() * 5;
+                for (unsigned batch = 0; batch * EMBEDDING_BATCH_SIZE < numConfsMatch; batch++) {
+                    const unsigned numConfsBatch
+                        = std::min(EMBEDDING_BATCH_SIZE, numConfsMatch - batch * EMBEDDING_BATCH_SIZE);
+                    plan.tasks.push_back({molIndex, matchIndex, batch, numConfsBatch});
+                }
+            }
         }
+        return plan;
+    }
 
-        for (auto const &match : matches) {
-            auto params = this->getEmbeddingParameters();
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::mergeEmbedding(const EmbeddingPlan &plan, unsigned molIndex,
+                                           std::vector<EmbeddingBatch> &batches) {
+        assert(batches.size() == plan.tasks.size());
+        if (plan.isCached.at(molIndex)) {
+            return;
+        }
+
+        // tasks are ordered by molecule, match and batch, so the conformer ids are in the same order as if the
+        // matches were embedded one after the other
+        RDKit::ROMol &mol = *plan.mols.at(molIndex);
+        std::map<int, std::pair<int, double>> energyById;
+        for (unsigned i = 0; i < plan.tasks.size(); i++) {
+            if (plan.tasks.at(i).molIndex != molIndex) {
+                continue;
+            }
+            EmbeddingBatch &batch = batches.at(i);
+            for (unsigned j = 0; j < batch.conformers.size(); j++) {
+                const int confId = static_cast<int>(mol.addConformer(batch.conformers.at(j).release(), true));
+                energyById[confId] = batch.energies.at(j);
+            }
+        }
+
+        // embeddings can fail, e.g. for strained molecules, the molecule keeps the conformers that were produced
+        if (mol.getNumConformers() < plan.numConfsTotal.at(molIndex)) {
+            spdlog::warn("only {} of {} embeddings of {} succeeded", mol.getNumConformers(),
+                         plan.numConfsTotal.at(molIndex), RDKit::MolToSmiles(mol));
+        }
+        assert(mol.getNumConformers() <= plan.numConfsTotal.at(molIndex));
+        this->finishEmbedding(mol, energyById);
+
+        if (m_conformerCache != nullptr) {
+            m_conformerCache->store(mol, plan.coreSmarts, plan.cacheParameters.at(molIndex));
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    EmbeddingBatch ConformerEmbedder::runEmbeddingTask(const RDKit::ROMol &mol, const EmbeddingTask &task) const {
+        const CoreMatch &match = getCoreMatches(mol)->at(task.matchIndex);
+
+        // the task embeds into a private copy, the tasks of a molecule never share its conformers
+        RDKit::ROMol copy(mol);
+        copy.clearConformers();
+
+        auto params = this->getEmbeddingParameters();
+        params.numThreads = 1;
+        // the first batch of every match keeps the seed of the unbatched embedding, so matches that fit into one
+        // batch get the same conformers as before
+        if (task.batch > 0) {
+            std::size_t seed = SEED;
+            boost::hash_combine(seed, task.matchIndex);
+            boost::hash_combine(seed, task.batch);
+            params.randomSeed = static_cast<int>(seed % static_cast<std::size_t>(std::numeric_limits<int>::max()));
+        }
+
+        // tether the core atoms to the reference core, so every conformer has its geometry
+        CoreAtomMapping coordMap;
+        if (m_coreTethered) {
+            const RDKit::Conformer &refConformer = m_core.ref->getConformer();
+            for (const auto &[molId, refId] : match.alignmentMap) {
+                coordMap[molId] = refConformer.getAtomPos(refId);
+            }
+            params.coordMap = &coordMap;
+        }
+
+        std::vector<int> confs = RDKit::DGeomHelpers::EmbedMultipleConfs(copy, task.numConfs, params);
+
+        // distance geometry only approximates the core coordinates, the tethered conformers get them exactly and keep
+        // them during the minimization
+        std::vector<unsigned> tetheredAtoms;
+        if (m_coreTethered) {
+            for (const auto &[molId, pos] : coordMap) {
+                tetheredAtoms.push_back(molId);
+            }
+            for (auto const confId : confs) {
+                RDKit::MolAlign::alignMol(copy, *m_core.ref, confId, 0, &match.alignmentMap);
+                for (const auto &[molId, pos] : coordMap) {
+                    copy.getConformer(confId).setAtomPos(molId, pos);
+                }
+            }
+        }
+        EmbeddingBatch batch;
+        batch.energies = minimizeConformers(copy, confs, 1, tetheredAtoms);
+
+        if (m_coreTethered && confs.size() < task.numConfs) {
+            spdlog::warn("only {} of {} core tethered embeddings of {} succeeded, embedding the rest without core",
+                         confs.size(), task.numConfs, RDKit::MolToSmiles(copy));
+            params.coordMap = nullptr;
+            const std::vector<int> untethered
+                = RDKit::DGeomHelpers::EmbedMultipleConfs(copy, task.numConfs - confs.size(), params);
+            const auto untetheredEnergies = minimizeConformers(copy, untethered, 1);
+            confs.insert(confs.end(), untethered.begin(), untethered.end());
+            batch.energies.insert(batch.energies.end(), untetheredEnergies.begin(), untetheredEnergies.end());
+        }
+
+        for (auto const confId : confs) {
+            auto score = RDKit::MolAlign::alignMol(copy, *m_core.ref, confId, 0, &match.alignmentMap);
+            spdlog::debug("aligned conformer {} with score {}", confId, score);
+            batch.conformers.push_back(std::make_unique<RDKit::Conformer>(copy.getConformer(confId)));
+        }
+        return batch;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::finishEmbedding(RDKit::ROMol &mol,
+                                            const std::map<int, std::pair<int, double>> &energyById) {
+        std::map<int, std::pair<int, double>> energies = energyById;
 
-            std::vector<int> confs;
-            if (m_divideConformersByMatches) {
-                auto numConfsMatch = (matchCounter < numConfs % matches.size()) ? (int(numConfs / matches.size()) + 1)
-                                                                                : (int(numConfs / matches.size()));
-                confs = RDKit::DGeomHelpers::EmbedMultipleConfs(*mol, numConfsMatch, params);
+        if (m_torsionExpansion > 0) {
+            // the atoms of all core matches stay fixed, so the new conformers stay aligned to the reference core
+            std::vector<unsigned> coreAtoms;
+            for (const auto &match : *getCoreMatches(mol)) {
+                for (const auto &[queryId, molId] : match.match) {
+                    coreAtoms.push_back(molId);
+                }
+            }
+            const TorsionDriver torsionDriver(mol, coreAtoms);
+            const unsigned numAdded = torsionDriver.expand(mol, m_torsionExpansion);
+            spdlog::debug("added {} conformers by driving {} torsions", numAdded, torsionDriver.getNumTorsions());
 
-                matchCounter++;
-            } else {
-                confs = RDKit::DGeomHelpers::EmbedMultipleConfs(*mol, numConfs, params);
+            // the driven conformers are minimized like the embedded ones before all of them are filtered
+            std::vector<int> addedIds;
+            for (auto conformer = mol.beginConformers(); conformer != mol.endConformers(); conformer++) {
+                if (energies.count(static_cast<int>((*conformer)->getId())) == 0) {
+                    addedIds.push_back(static_cast<int>((*conformer)->getId()));
+                }
             }
+            const auto addedEnergies = minimizeConformers(mol, addedIds, m_threads, coreAtoms);
+            for (unsigned i = 0; i < addedIds.size(); i++) {
+                energies[addedIds.at(i)] = addedEnergies.at(i);
+            }
+        }
+
+        if (m_conformerFilter.isEnabled()) {
+            std::vector<std::pair<int, double>> orderedEnergies;
+            for (auto conformer = mol.beginConformers(); conformer != mol.endConformers(); conformer++) {
+                orderedEnergies.push_back(energies.at(static_cast<int>((*conformer)->getId())));
+            }
+            const unsigned numConformers = mol.getNumConformers();
+            const unsigned numKept = m_conformerFilter.filter(mol, orderedEnergies);
+            spdlog::info("kept {} of {} conformers of {}", numKept, numConformers, RDKit::MolToSmiles(mol));
+
+            const std::lock_guard<std::mutex> lock(m_filterCountsMutex);
+            m_filterCounts.emplace_back(numConformers, numKept);
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::vector<std::pair<int, double>> ConformerEmbedder::minimizeConformers(RDKit::ROMol &mol,
+                                                                              const std::vector<int> &confIds,
+                                                                              int threads,
+                                                                              const std::vector<unsigned> &fixedAtoms) {
+        std::vector<std::pair<int, double>> results(confIds.size(), {0, 0.0});
+        if (confIds.empty()) {
+            return results;
+        }
+
+        const std::shared_ptr<const RDKit::UFF::AtomicParamVect> atomParams = get_uff_params(mol);
+
+        // the force field terms are built once, every thread minimizes copies with the positions of its conformers
+        const std::unique_ptr<ForceFields::ForceField> forceField(
+            RDKit::UFF::constructForceField(mol, *atomParams, UFF_VDW_THRESHOLD, confIds.front()));
+        for (const auto atomId : fixedAtoms) {
+            forceField->fixedPoints().push_back(atomId);
+        }
+
+        const int numThreads = core::ThreadBudget::getNestedShare(threads);
+#pragma omp parallel for num_threads(numThreads) default(none) \
+    shared(mol, confIds, forceField, results, UFF_MAX_ITERATIONS)
+        for (unsigned i = 0; i < confIds.size(); i++) {
+            ForceFields::ForceField conformerForceField(*forceField);
+            RDKit::Conformer &conformer = mol.getConformer(confIds.at(i));
+            conformerForceField.positions().clear();
+            for (unsigned atomId = 0; atomId < mol.getNumAtoms(); atomId++) {
+                conformerForceField.positions().push_back(&conformer.getAtomPos(atomId));
+            }
+            conformerForceField.initialize();
+            const int needsMore = conformerForceField.minimize(UFF_MAX_ITERATIONS);
+            results.at(i) = {needsMore, conformerForceField.calcEnergy()};
+        }
+        return results;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::precomputeTopology(const RDKit::ROMol &mol) const {
+        getCoreMatches(mol);
+        getTopologicalBounds(mol);
+        get_uff_params(mol);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    boost::shared_ptr<const DistGeom::BoundsMatrix> ConformerEmbedder::getTopologicalBounds(const RDKit::ROMol &mol) {
+        if (mol.hasProp(BOUNDS_MATRIX_PROP)) {
+            return mol.getProp<boost::shared_ptr<const DistGeom::BoundsMatrix>>(BOUNDS_MATRIX_PROP);
+        }
+
+        const RDKit::DGeomHelpers::EmbedParameters params = get_embed_params_for_optimizer_generation(SEED);
+        const unsigned numAtoms = mol.getNumAtoms();
+        DistGeom::BoundsMatPtr bounds(new DistGeom::BoundsMatrix(numAtoms));
+        RDKit::DGeomHelpers::initBoundsMat(bounds);
+        RDKit::DGeomHelpers::setTopolBounds(mol, bounds, true, false, params.useMacrocycle14config,
+                                            params.forceTransAmides);
+
+        boost::shared_ptr<const DistGeom::BoundsMatrix> result = bounds;
+        mol.setProp(BOUNDS_MATRIX_PROP, result);
+        return result;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::shared_ptr<const CoreMatches> ConformerEmbedder::getCoreMatches(const RDKit::ROMol &mol) const {
+        if (mol.hasProp(CORE_MATCHES_PROP)) {
+            return mol.getProp<std::shared_ptr<const CoreMatches>>(CORE_MATCHES_PROP);
+        }
+
+        RDKit::SubstructMatchParameters substructMatchParams;
+        substructMatchParams.uniquify = false;
+        substructMatchParams.useChirality = false;
+        substructMatchParams.useQueryQueryMatches = false;
+        substructMatchParams.maxMatches = 1000;
+        substructMatchParams.numThreads = core::ThreadBudget::getNestedShare(m_threads);
 
-            std::vector<std::pair<int, double>> result;
-            RDKit::UFF::UFFOptimizeMoleculeConfs(*mol, result, m_threads);
+        std::vector<RDKit::MatchVectType> matches = RDKit::SubstructMatch(mol, *m_core.core, substructMatchParams);
+        if (m_collapseMatches) {
+            // matches that place the substituents identically would only yield duplicate conformers
+            std::vector<RDKit::MatchVectType> distinctMatches;
+            for (const auto &group : SubstructureAnalyzer::groupSymmetryEquivalentMatches(mol, matches)) {
+                distinctMatches.push_back(std::move(matches.at(group.front())));
+            }
+            spdlog::debug("collapsed {} core matches to {} distinct placements", matches.size(),
+                          distinctMatches.size());
+            matches = std::move(distinctMatches);
+        }
 
+        auto coreMatches = std::make_shared<CoreMatches>();
+        for (auto &match : matches) {
             // This is somewhat unintuitive:
             // We use a reference molecule (m_core.ref) to have a "real" conformer, as we cannot generate
             // chemically sensible conformers from m_core.core, as it contains smarts queries. So we get the
@@ -97,18 +558,36 @@ namespace coaler::embedder {
             for (const auto &[queryId, molId] : match) {
                 matchReverse.emplace_back(std::make_pair(molId, m_core.core_to_ref.at(queryId)));
             }
-
-            for (auto const confId : confs) {
-                auto score = RDKit::MolAlign::alignMol(*mol, *m_core.ref, confId, 0, &matchReverse);
-                spdlog::debug("aligned conformer {} with score {}", confId, score);
-            }
+            coreMatches->push_back({std::move(match), std::move(matchReverse)});
         }
 
-        if (m_divideConformersByMatches) {
-            assert(mol->getNumConformers() == numConfs);
-        } else {
-            assert(mol->getNumConformers() == numConfs * matches.size());
+        std::shared_ptr<const CoreMatches> result = std::move(coreMatches);
+        mol.setProp(CORE_MATCHES_PROP, result);
+        return result;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::setConformerCache(std::shared_ptr<io::ConformerCache> cache) {
+        m_conformerCache = std::move(cache);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::string ConformerEmbedder::getConformerCacheParameters(unsigned numConfs) const {
+        // the conformers are aligned to the reference core, so its coordinates are part of the key as well
+        std::string refCoords;
+        const RDKit::Conformer &refConformer = m_core.ref->getConformer();
+        for (unsigned coreAtomId = 0; coreAtomId < m_core.core->getNumAtoms(); coreAtomId++) {
+            const RDGeom::Point3D &pos = refConformer.getAtomPos(m_core.core_to_ref.at(static_cast<int>(coreAtomId)));
+            refCoords += fmt::format("{:.3f},{:.3f},{:.3f};", pos.x, pos.y, pos.z);
         }
+
+        return fmt::format(
+            "srETKDGv3;seed={};batch={};forceTol={};uff=1;confs={};divide={};torsions={};collapse={};filter={},{};"
+            "tethered={};ref={}",
+            SEED, EMBEDDING_BATCH_SIZE, FORCE_TOL, numConfs, m_divideConformersByMatches, m_torsionExpansion,
+            m_collapseMatches, m_energyWindow, m_rmsdThreshold, m_coreTethered, refCoords);
     }
 
     /*----------------------------------------------------------------------------------------------------------------*/
@@ -116,7 +595,7 @@ namespace coaler::embedder {
     RDKit::DGeomHelpers::EmbedParameters ConformerEmbedder::getEmbeddingParameters() const {
         auto params = RDKit::DGeomHelpers::srETKDGv3;
         params.randomSeed = SEED;
-        params.numThreads = m_threads;
+        params.numThreads = core::ThreadBudget::getNestedShare(m_threads);
         params.optimizerForceTol = FORCE_TOL;
         params.clearConfs = false;
         return params;
@@ -127,10 +606,10 @@ namespace coaler::embedder {
     std::vector<multialign::PoseID> ConformerEmbedder::generateNewPosesForAssemblyLigand(
         const multialign::Ligand &worstLigand, const multialign::LigandVector &targets,
         const std::unordered_map<multialign::LigandID, multialign::PoseID> &conformerIDs,
-        const core::PairwiseMCSMap &pairwiseStrictMCSMap, const core::PairwiseMCSMap &pairwiseRelaxedMCSMap,
-        bool enforceGeneration) {
+        const core::PairwiseMCSProvider &pairwiseMCS, bool enforceGeneration, std::uint64_t attemptSeed) {
         std::vector<unsigned> newIds;
         auto *ligandMol = (RDKit::ROMol *)worstLigand.getMoleculePtr();
+        m_numGenerationAttempts++;
 
         for (const multialign::Ligand &target : targets) {
             // find mcs
@@ -139,6 +618,8 @@ namespace coaler::embedder {
                 continue;
             }
 
+            m_numTargets++;
+
             const multialign::PoseID targetConformerID = conformerIDs.at(targetID);
             const RDKit::ROMol targetMol = target.getMolecule();
             RDKit::Conformer targetConformer;
@@ -158,107 +639,102 @@ namespace coaler::embedder {
             std::string mcsStringStrict;
             const multialign::LigandPair ligandPair(worstLigand.getID(), targetID);
 
-            // since mcs maps are accessed via ligand pair, i.e. smaller id first, we have to check in which
-            // order ligand and target are.
-            if (worstLigand.getID() < targetID) {
-                std::tie(ligandMatchRelaxed, targetMatchRelaxed, mcsStringRelaxed)
-                    = pairwiseRelaxedMCSMap.at(ligandPair);
-                std::tie(ligandMatchStrict, targetMatchStrict, mcsStringStrict) = pairwiseStrictMCSMap.at(ligandPair);
-            } else {
-                std::tie(targetMatchRelaxed, ligandMatchRelaxed, mcsStringRelaxed)
-                    = pairwiseRelaxedMCSMap.at(ligandPair);
-                std::tie(targetMatchStrict, ligandMatchStrict, mcsStringStrict) = pairwiseStrictMCSMap.at(ligandPair);
-            }
-
-            CoreAtomMapping ligandMcsCoords;
-            RDKit::DGeomHelpers::EmbedParameters params = get_embed_params_for_optimizer_generation();
-            int addedID = -1;
+            // since mcs are accessed via ligand pair, i.e. smaller id first, we have to check in which
+            // order ligand and target are. The strict mcs is only requested if the relaxed one fails.
+            const bool ligandIsFirst = worstLigand.getID() < targetID;
+            const auto unpackMcs = [ligandIsFirst](const core::PairwiseMCS &mcs, RDKit::MatchVectType &ligandMatch,
+                                                   RDKit::MatchVectType &targetMatch, std::string &mcsString) {
+                if (ligandIsFirst) {
+                    std::tie(ligandMatch, targetMatch, mcsString) = mcs;
+                } else {
+                    std::tie(targetMatch, ligandMatch, mcsString) = mcs;
+                }
+            };
 
-            double relaxedMcsSizeFactor = (double)ligandMatchRelaxed.size() / ligandMol->getNumAtoms();
+            // size and chirality of the relaxed mcs are checked once per pair by the provider
+            const core::PairwiseMCSFeasibility &feasibility = pairwiseMCS.getFeasibility(ligandPair);
+            const double relaxedMcsSizeFactor = ligandIsFirst ? feasibility.firstCoverage : feasibility.secondCoverage;
             if (!(relaxedMcsSizeFactor > 0.2 || enforceGeneration)) {
-                spdlog::debug("skipped due to small mcs, {} / {} = {}", ligandMatchRelaxed.size(),
-                              ligandMol->getNumAtoms(), relaxedMcsSizeFactor);
+                spdlog::debug("skipped due to small mcs, {} of the atoms of {}", relaxedMcsSizeFactor,
+                              RDKit::MolToSmiles(*ligandMol));
+                m_numSkippedInfeasible++;
                 continue;
             }
-
-            // check whether mapped chiral atoms match. Otherwise the embedder will take very long and then fail.
-            bool invalidChiral = false;
-            for (const auto &[targetMcsAtomID, targetAtomID] : targetMatchRelaxed) {
-                auto targetChiralTag = targetMol.getAtomWithIdx(targetAtomID)->getChiralTag();
-                if (targetChiralTag != RDKit::Atom::CHI_UNSPECIFIED) {
-                    int matchingLigandAtomID = -1;
-                    for (const auto &[ligandMcsAtomID, ligandAtomID] : ligandMatchRelaxed) {
-                        if (ligandMcsAtomID == targetMcsAtomID) {
-                            matchingLigandAtomID = ligandAtomID;
-                            break;
-                        }
-                    }
-                    assert(matchingLigandAtomID != -1);
-                    auto ligandChiralTag = ligandMol->getAtomWithIdx(matchingLigandAtomID)->getChiralTag();
-                    // todo sometimes chiral vs no chiral is not caught here, not sure why.
-                    // embedding often fails in this case
-                    // CHI_UNSPECIFIED (=0) sollte eigentlich bei anderen CHI tags != auswerten, idk was da falsch läuft
-                    if (ligandChiralTag != targetChiralTag) {
-                        spdlog::debug(
-                            "chirality mismatch: \n"
-                            "{}\n{}",
-                            RDKit::MolToSmiles(*worstLigand.getMoleculePtr()), RDKit::MolToSmiles(targetMol));
-                        invalidChiral = true;
-                        break;
-                    }
-                }
+            if (!(ligandIsFirst ? feasibility.firstChiralityCompatible : feasibility.secondChiralityCompatible)) {
+                spdlog::debug("chirality mismatch: \n{}\n{}", RDKit::MolToSmiles(*ligandMol),
+                              RDKit::MolToSmiles(targetMol));
+                m_numSkippedInfeasible++;
+                continue;
             }
-            if (invalidChiral) {
+
+            // a different seed rarely rescues an embedding onto the same target conformer, so failures are not retried
+            const FailedEmbedding embedding{worstLigand.getID(), targetID, targetConformerID,
+                                            hash_positions(targetConformer.getPositions())};
+            if (isKnownFailure(embedding)) {
+                m_numSkippedKnownFailures++;
                 continue;
             }
 
-            // try relaxed mcs first
+            unpackMcs(pairwiseMCS.get(ligandPair, false), ligandMatchRelaxed, targetMatchRelaxed, mcsStringRelaxed);
+
+            CoreAtomMapping ligandMcsCoords;
+            const int seed = get_generation_seed(attemptSeed, worstLigand.getID(), targetID);
+            RDKit::DGeomHelpers::EmbedParameters params = get_embed_params_for_optimizer_generation(seed);
+            int addedID = -1;
+            bool timedOut = false;
+
+            // try relaxed mcs first, transplanted onto an existing conformer if enabled. Every embedding runs under
+            // the embed timeout, the fallbacks are the strict mcs and finally only the core atoms of the mcs as a
+            // reduced coordinate map.
             if (!ligandMatchRelaxed.empty() && !targetMatchRelaxed.empty()) {
                 ligandMcsCoords = getLigandMcsAtomCoordsFromTargetMatch(targetConformer.getPositions(),
                                                                         ligandMatchRelaxed, targetMatchRelaxed);
-                params.coordMap = &ligandMcsCoords;
-                try {
-                    auto start = std::chrono::high_resolution_clock::now();
-                    addedID = RDKit::DGeomHelpers::EmbedMolecule(*ligandMol, params);
-                    auto end = std::chrono::high_resolution_clock::now();
-                    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-                    if (duration > 5000) {
-                        spdlog::debug("relaxed mcs confgen took {} ms", duration);
-                        spdlog::debug("mol1: {} \nmol2: {}\n mcs: {}",
-                                      RDKit::MolToSmiles(*worstLigand.getMoleculePtr()), RDKit::MolToSmiles(targetMol),
-                                      mcsStringRelaxed);
-                        spdlog::debug("success: {}", addedID > 0 ? "true\n" : "false\n");
-                    }
-                } catch (const std::runtime_error &e) {
-                    spdlog::debug(e.what());
+                if (m_transplantPoses) {
+                    addedID = transplantPose(*ligandMol, ligandMcsCoords);
+                }
+                if (addedID < 0) {
+                    params.coordMap = &ligandMcsCoords;
+                    addedID = embedWithTimeout(*ligandMol, params, worstLigand.getID(), false, timedOut);
                 }
             }
 
             // if relaxed mcs params didnt yield valid embedding, reattempt with strict mcs.
+            if (addedID < 0) {
+                unpackMcs(pairwiseMCS.get(ligandPair, true), ligandMatchStrict, targetMatchStrict, mcsStringStrict);
+            }
             if (addedID < 0 && !ligandMatchStrict.empty() && !targetMatchStrict.empty()) {
                 spdlog::debug("flexible approach failed. Trying strict approach.");
                 ligandMcsCoords = getLigandMcsAtomCoordsFromTargetMatch(targetConformer.getPositions(),
                                                                         ligandMatchStrict, targetMatchStrict);
                 params.coordMap = &ligandMcsCoords;
-                try {
-                    auto start = std::chrono::high_resolution_clock::now();
-                    addedID = RDKit::DGeomHelpers::EmbedMolecule(*ligandMol, params);
-                    auto end = std::chrono::high_resolution_clock::now();
-                    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-                    if (duration > 5000) {
-                        spdlog::debug("strict mcs confgen took {} ms", duration);
-                        spdlog::debug("mol1: {} \nmol2: {}\n mcs: {}\n",
-                                      RDKit::MolToSmiles(*worstLigand.getMoleculePtr()), RDKit::MolToSmiles(targetMol),
-                                      mcsStringStrict);
-                    }
-                } catch (const std::runtime_error &e) {
-                    spdlog::debug(e.what());
+                addedID = embedWithTimeout(*ligandMol, params, worstLigand.getID(), true, timedOut);
+            }
+
+            if (addedID < 0) {
+                CoreAtomMapping reducedCoords = reduceToCoreAtoms(*ligandMol, ligandMcsCoords);
+                if (!reducedCoords.empty() && reducedCoords.size() < ligandMcsCoords.size()) {
+                    spdlog::debug("strict approach failed. Trying reduced coordinate map.");
+                    params.coordMap = &reducedCoords;
+                    addedID = embedWithTimeout(*ligandMol, params, worstLigand.getID(), true, timedOut);
                 }
             }
+
             if (addedID < 0) {
                 spdlog::debug("strict mcs confgen failed. mcs: {}, target: {}, mol {}", mcsStringStrict,
                               RDKit::MolToSmiles(*worstLigand.getMoleculePtr()), RDKit::MolToSmiles(targetMol));
                 spdlog::debug("target conformer {}/{}: no viable pose generated.", targetID, targets.size());
+                // a timed out embedding might succeed another time, only embeddings that failed on their own are
+                // never retried
+                if (!timedOut) {
+                    recordFailure(embedding);
+                }
+                continue;
+            }
+
+            // e.g. transplants onto an unchanged target pose reproduce an earlier pose, it would score the same
+            if (is_duplicate_pose(*ligandMol, addedID)) {
+                ligandMol->removeConformer(addedID);
+                m_numDuplicatePoses++;
                 continue;
             }
             const auto addedIDUnsigned = static_cast<unsigned>(addedID);
@@ -269,40 +745,340 @@ namespace coaler::embedder {
 
     /*----------------------------------------------------------------------------------------------------------------*/
 
-    std::vector<multialign::PoseID> ConformerEmbedder::generateNewPosesForAssemblyLigand(
-        const multialign::Ligand &worstLigand, const unsigned numConfs) {
-        RDKit::SubstructMatchParameters substructMatchParams;
-        substructMatchParams.uniquify = false;
-        substructMatchParams.useChirality = false;
-        substructMatchParams.useQueryQueryMatches = false;
-        substructMatchParams.maxMatches = 1000;
-        substructMatchParams.numThreads = m_threads;
+    int ConformerEmbedder::embedWithTimeout(RDKit::ROMol &mol, RDKit::DGeomHelpers::EmbedParameters &params,
+                                            multialign::LigandID ligandID, bool isFallback, bool &timedOut) {
+        int addedID = -1;
+        bool embeddingTimedOut = false;
+        const auto start = std::chrono::steady_clock::now();
+        embed_deadline = m_embedTimeout.count() > 0 ? start + m_embedTimeout : NO_DEADLINE;
+        params.callback = m_embedTimeout.count() > 0 ? check_embed_deadline : nullptr;
+        // only the coordinate constraints are applied per embedding, RDKit builds the bounds itself if they fail
+        params.boundsMat = params.coordMap != nullptr ? get_constrained_bounds(mol, *params.coordMap) : nullptr;
+        try {
+            addedID = RDKit::DGeomHelpers::EmbedMolecule(mol, params);
+        } catch (const EmbedTimeout &) {
+            embeddingTimedOut = true;
+        } catch (const std::runtime_error &e) {
+            spdlog::debug(e.what());
+        }
+        timedOut |= embeddingTimedOut;
+        embed_deadline = NO_DEADLINE;
+        params.callback = nullptr;
+        params.boundsMat = nullptr;
+
+        const auto duration
+            = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        if (embeddingTimedOut) {
+            spdlog::debug("embedding of {} timed out after {} ms", RDKit::MolToSmiles(mol), duration.count());
+        }
+
+        const std::lock_guard<std::mutex> lock(m_timeoutStatisticsMutex);
+        EmbedTimeoutStatistics &statistics = m_timeoutStatistics[ligandID];
+        statistics.numEmbeddings++;
+        statistics.numTimeouts += embeddingTimedOut ? 1 : 0;
+        statistics.numFallbackSuccesses += isFallback && addedID >= 0 ? 1 : 0;
+        statistics.maxDuration = std::max(statistics.maxDuration, duration);
+        return addedID;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    int ConformerEmbedder::transplantPose(RDKit::ROMol &mol, const CoreAtomMapping &coordMap) {
+        if (mol.getNumConformers() == 0 || coordMap.size() < 3) {
+            return -1;
+        }
+
+        RDGeom::Point3DConstPtrVect mcsPoints;
+        for (const auto &[atomId, pos] : coordMap) {
+            mcsPoints.push_back(&pos);
+        }
+
+        // the existing conformer that fits the mcs coordinates best provides the positions of the other atoms
+        const RDKit::Conformer *source = nullptr;
+        RDGeom::Transform3D sourceTransform;
+        double bestRmsd = std::numeric_limits<double>::max();
+        for (auto conformer = mol.beginConformers(); conformer != mol.endConformers(); conformer++) {
+            RDGeom::Point3DConstPtrVect conformerPoints;
+            for (const auto &[atomId, pos] : coordMap) {
+                conformerPoints.push_back(&(*conformer)->getAtomPos(atomId));
+            }
+            RDGeom::Transform3D transform;
+            const double rmsd = RDNumeric::Alignments::AlignPoints(mcsPoints, conformerPoints, transform);
+            if (rmsd < bestRmsd) {
+                bestRmsd = rmsd;
+                source = conformer->get();
+                sourceTransform = transform;
+            }
+        }
+
+        auto *transplant = new RDKit::Conformer(*source);
+        for (unsigned atomId = 0; atomId < mol.getNumAtoms(); atomId++) {
+            sourceTransform.TransformPoint(transplant->getAtomPos(atomId));
+        }
+        for (const auto &[atomId, pos] : coordMap) {
+            transplant->setAtomPos(atomId, pos);
+        }
+        const auto sourceId = static_cast<int>(source->getId());
+        const auto confId = static_cast<int>(mol.addConformer(transplant, true));
+
+        // relax the side chains around the fixed mcs atoms
+        const std::shared_ptr<const RDKit::UFF::AtomicParamVect> atomParams = get_uff_params(mol);
+        std::unique_ptr<ForceFields::ForceField> forceField(
+            RDKit::UFF::constructForceField(mol, *atomParams, UFF_VDW_THRESHOLD, confId));
+        for (const auto &[atomId, pos] : coordMap) {
+            forceField->fixedPoints().push_back(atomId);
+        }
+        forceField->initialize();
+        forceField->minimize(TRANSPLANT_MAX_ITERATIONS, FORCE_TOL);
+        const double energy = forceField->calcEnergy();
+
+        std::unique_ptr<ForceFields::ForceField> sourceForceField(
+            RDKit::UFF::constructForceField(mol, *atomParams, UFF_VDW_THRESHOLD, sourceId));
+        sourceForceField->initialize();
+        const double sourceEnergy = sourceForceField->calcEnergy();
+
+        if (energy - sourceEnergy > TRANSPLANT_ENERGY_WINDOW
+            || !same_chirality(mol, mol.getConformer(sourceId), mol.getConformer(confId))) {
+            spdlog::debug("transplanted pose rejected, energy {} (source {})", energy, sourceEnergy);
+            mol.removeConformer(confId);
+            m_numTransplantFailures++;
+            return -1;
+        }
+
+        m_numTransplanted++;
+        return confId;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    CoreAtomMapping ConformerEmbedder::reduceToCoreAtoms(const RDKit::ROMol &mol,
+                                                         const CoreAtomMapping &coordMap) const {
+        const std::shared_ptr<const CoreMatches> coreMatches = getCoreMatches(mol);
+        CoreAtomMapping reduced;
+        if (coreMatches->empty()) {
+            return reduced;
+        }
+        for (const auto &[queryId, atomId] : coreMatches->front().match) {
+            const auto coords = coordMap.find(atomId);
+            if (coords != coordMap.end()) {
+                reduced.insert(*coords);
+            }
+        }
+        return reduced;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::setEmbedTimeout(std::chrono::milliseconds timeout) { m_embedTimeout = timeout; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::setPoseTransplant(bool enabled) { m_transplantPoses = enabled; }
 
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::setTorsionExpansion(unsigned numConfs) { m_torsionExpansion = numConfs; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::setCollapseMatches(bool enabled) { m_collapseMatches = enabled; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::setCoreTethered(bool enabled) { m_coreTethered = enabled; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::setConformerFilter(double energyWindow, double rmsdThreshold) {
+        m_energyWindow = energyWindow;
+        m_rmsdThreshold = rmsdThreshold;
+        m_conformerFilter = ConformerFilter(energyWindow, rmsdThreshold);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::logFilterStatistics() const {
+        const std::lock_guard<std::mutex> lock(m_filterCountsMutex);
+        if (m_filterCounts.empty()) {
+            return;
+        }
+
+        // every pose pair of two ligands is scored
+        unsigned long numPairsBefore = 0;
+        unsigned long numPairsAfter = 0;
+        unsigned long numConformersBefore = 0;
+        unsigned long numConformersAfter = 0;
+        for (unsigned first = 0; first < m_filterCounts.size(); first++) {
+            numConformersBefore += m_filterCounts.at(first).first;
+            numConformersAfter += m_filterCounts.at(first).second;
+            for (unsigned second = first + 1; second < m_filterCounts.size(); second++) {
+                numPairsBefore += static_cast<unsigned long>(m_filterCounts.at(first).first)
+                                  * m_filterCounts.at(second).first;
+                numPairsAfter += static_cast<unsigned long>(m_filterCounts.at(first).second)
+                                 * m_filterCounts.at(second).second;
+            }
+        }
+        spdlog::info("conformer filter kept {} of {} conformers, {} instead of {} pose pairs to score",
+                     numConformersAfter, numConformersBefore, numPairsAfter, numPairsBefore);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::map<multialign::LigandID, EmbedTimeoutStatistics> ConformerEmbedder::getTimeoutStatistics() const {
+        const std::lock_guard<std::mutex> lock(m_timeoutStatisticsMutex);
+        return m_timeoutStatistics;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    PoseGenerationStatistics ConformerEmbedder::getPoseGenerationStatistics() const {
+        return {m_numGenerationAttempts.load(), m_numTargets.load(), m_numSkippedInfeasible.load(),
+                m_numSkippedKnownFailures.load(), m_numFailedEmbeddings.load()};
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool ConformerEmbedder::isKnownFailure(const FailedEmbedding &embedding) const {
+        const std::lock_guard<std::mutex> lock(m_failedEmbeddingsMutex);
+        return m_failedEmbeddings.count(embedding) > 0;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::recordFailure(const FailedEmbedding &embedding) {
+        const std::lock_guard<std::mutex> lock(m_failedEmbeddingsMutex);
+        m_failedEmbeddings.insert(embedding);
+        m_numFailedEmbeddings++;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerEmbedder::logStatistics() const {
+        const unsigned numSkipped = m_numSkippedInfeasible + m_numSkippedKnownFailures;
+        spdlog::info("pose generation: {} attempts on {} targets, {} skipped as infeasible, {} as known failures",
+                     m_numGenerationAttempts.load(), m_numTargets.load(), m_numSkippedInfeasible.load(),
+                     m_numSkippedKnownFailures.load());
+        spdlog::info("pose generation: {} rigidly superposed candidate poses, {} duplicate poses discarded",
+                     m_numSuperposed.load(), m_numDuplicatePoses.load());
+        if (m_transplantPoses) {
+            spdlog::info("pose generation: {} poses transplanted, {} transplants rejected", m_numTransplanted.load(),
+                         m_numTransplantFailures.load());
+        }
+        if (m_numTargets > 0) {
+            const unsigned numEmbedded = m_numTargets - numSkipped;
+            spdlog::info("pose generation: skip rate {:.2f}, failure rate {:.2f} ({} of {} embeddings failed)",
+                         static_cast<double>(numSkipped) / m_numTargets,
+                         numEmbedded > 0 ? static_cast<double>(m_numFailedEmbeddings) / numEmbedded : 0.0,
+                         m_numFailedEmbeddings.load(), numEmbedded);
+        }
+
+        for (const auto &[ligandID, statistics] : getTimeoutStatistics()) {
+            if (statistics.numTimeouts == 0) {
+                continue;
+            }
+            spdlog::info("ligand {}: {} of {} embeddings timed out, {} fallbacks succeeded, longest took {} ms",
+                         ligandID, statistics.numTimeouts, statistics.numEmbeddings, statistics.numFallbackSuccesses,
+                         statistics.maxDuration.count());
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::vector<multialign::PoseID> ConformerEmbedder::superposeExistingPoses(
+        const multialign::Ligand &worstLigand, const multialign::LigandVector &targets,
+        const std::unordered_map<multialign::LigandID, multialign::PoseID> &conformerIDs,
+        const core::PairwiseMCSProvider &pairwiseMCS) {
+        auto *ligandMol = (RDKit::ROMol *)worstLigand.getMoleculePtr();
+        std::vector<const RDKit::Conformer *> sources;
+        for (auto conformer = ligandMol->beginConformers(); conformer != ligandMol->endConformers(); conformer++) {
+            sources.push_back(conformer->get());
+        }
+
+        // the rigid copies are created after all targets are processed, so only existing conformers are superposed
+        std::vector<std::pair<const RDKit::Conformer *, RigidTransform>> superpositions;
+        for (const multialign::Ligand &target : targets) {
+            const multialign::LigandID targetID = target.getID();
+            if (conformerIDs.count(targetID) == 0 || sources.empty()) {
+                continue;
+            }
+
+            const multialign::LigandPair ligandPair(worstLigand.getID(), targetID);
+            const bool ligandIsFirst = worstLigand.getID() < targetID;
+            const auto &[firstMatch, secondMatch, mcsString] = pairwiseMCS.get(ligandPair, false);
+            const RDKit::MatchVectType &ligandMatch = ligandIsFirst ? firstMatch : secondMatch;
+            const RDKit::MatchVectType &targetMatch = ligandIsFirst ? secondMatch : firstMatch;
+            if (ligandMatch.size() < 3) {
+                continue;
+            }
+
+            const CoreAtomMapping mcsCoords = getLigandMcsAtomCoordsFromTargetMatch(
+                target.getMoleculePtr()->getConformer(static_cast<int>(conformerIDs.at(targetID))).getPositions(),
+                ligandMatch, targetMatch);
+            RDGeom::POINT3D_VECT reference;
+            for (const auto &[atomId, pos] : mcsCoords) {
+                reference.push_back(pos);
+            }
+
+            KabschSuperposer superposer(reference);
+            for (const auto *source : sources) {
+                RDGeom::POINT3D_VECT probe;
+                for (const auto &[atomId, pos] : mcsCoords) {
+                    probe.push_back(source->getAtomPos(atomId));
+                }
+                superposer.addProbe(probe);
+            }
+
+            std::vector<RigidTransform> transforms = superposer.superpose();
+            std::vector<unsigned> order(transforms.size());
+            std::iota(order.begin(), order.end(), 0);
+            const unsigned numBest = std::min<unsigned>(SUPERPOSED_POSES_PER_TARGET, order.size());
+            std::partial_sort(order.begin(), order.begin() + numBest, order.end(),
+                              [&](unsigned a, unsigned b) { return transforms.at(a).rmsd < transforms.at(b).rmsd; });
+            for (unsigned i = 0; i < numBest; i++) {
+                superpositions.emplace_back(sources.at(order.at(i)), transforms.at(order.at(i)));
+            }
+        }
+
+        std::vector<multialign::PoseID> newIds;
+        for (const auto &[source, transform] : superpositions) {
+            auto *conformer = new RDKit::Conformer(*source);
+            transform.apply(*conformer);
+            newIds.push_back(ligandMol->addConformer(conformer, true));
+        }
+        m_numSuperposed += newIds.size();
+        return newIds;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::vector<multialign::PoseID> ConformerEmbedder::generateNewPosesForAssemblyLigand(
+        const multialign::Ligand &worstLigand, const unsigned numConfs, std::uint64_t attemptSeed) {
         const unsigned numConfsBefore = worstLigand.getMoleculePtr()->getNumConformers();
-        auto matches = RDKit::SubstructMatch(*worstLigand.getMoleculePtr(), *m_core.core, substructMatchParams);
+        const std::shared_ptr<const CoreMatches> coreMatches = getCoreMatches(*worstLigand.getMoleculePtr());
+        const CoreMatches &matches = *coreMatches;
 
         assert(!matches.empty());
 
         spdlog::debug("number of Core Matches: {}", matches.size());
 
         std::vector<multialign::PoseID> confs;
-        for (auto const &match : matches) {
+        for (unsigned matchIndex = 0; matchIndex < matches.size(); matchIndex++) {
+            const CoreMatch &match = matches.at(matchIndex);
+            // every match gets its own conformers, the same seed would embed identical ones for every match
+            std::size_t matchSeed = attemptSeed;
+            boost::hash_combine(matchSeed, matchIndex);
             auto params = this->getEmbeddingParameters();
+            params.randomSeed = get_generation_seed(matchSeed, worstLigand.getID(), worstLigand.getID());
             std::vector<int> newConfs = RDKit::DGeomHelpers::EmbedMultipleConfs(
                 *(RDKit::ROMol *)worstLigand.getMoleculePtr(), numConfs, params);
             confs.insert(confs.end(), newConfs.begin(), newConfs.end());
 
-            std::vector<std::pair<int, double>> result;
-            RDKit::UFF::UFFOptimizeMoleculeConfs(*(RDKit::ROMol *)worstLigand.getMoleculePtr(), result, m_threads);
-
-            RDKit::MatchVectType matchReverse;
-            for (const auto &[queryId, molId] : match) {
-                matchReverse.emplace_back(std::make_pair(molId, m_core.core_to_ref.at(queryId)));
-            }
+            minimizeConformers(*(RDKit::ROMol *)worstLigand.getMoleculePtr(), newConfs, m_threads);
 
-            for (auto const confId : confs) {
+            // the conformers of the previous matches are already aligned to their own match
+            for (auto const confId : newConfs) {
                 auto score = RDKit::MolAlign::alignMol(*(RDKit::ROMol *)worstLigand.getMoleculePtr(), *m_core.ref,
-                                                       confId, 0, &matchReverse);
+                                                       confId, 0, &match.alignmentMap);
                 spdlog::debug("aligned conformer {} with score {}", confId, score);
             }
         }
@@ -3,10 +3,24 @@
  */
 
 #pragma once
+#include <DistGeom/BoundsMatrix.h>
 #include <GraphMol/DistGeomHelpers/Embedder.h>
 #include <GraphMol/ROMol.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "ConformerFilter.hpp"
 #include "coaler/core/Forward.hpp"
+#include "coaler/io/ConformerCache.hpp"
 #include "coaler/multialign/models/Forward.hpp"
 /**
  * @file ConformerEmbedder.hpp
@@ -15,6 +29,76 @@
 namespace coaler::embedder {
     using CoreAtomMapping = std::map<int, RDGeom::Point3D>;
 
+    /**
+     * Match of the core in a molecule.
+     */
+    struct CoreMatch {
+        // (core atom, molecule atom)
+        RDKit::MatchVectType match;
+        // (molecule atom, reference atom) as required by RDKit::MolAlign::alignMol
+        RDKit::MatchVectType alignmentMap;
+    };
+
+    using CoreMatches = std::vector<CoreMatch>;
+
+    /**
+     * Timeout statistics of the constrained embeddings of a ligand.
+     */
+    struct EmbedTimeoutStatistics {
+        unsigned numEmbeddings{0};
+        unsigned numTimeouts{0};
+        // embeddings with the strict mcs or the reduced coordinate map that succeeded
+        unsigned numFallbackSuccesses{0};
+        std::chrono::milliseconds maxDuration{0};
+    };
+
+    /**
+     * Statistics of the pose generation of generateNewPosesForAssemblyLigand().
+     */
+    struct PoseGenerationStatistics {
+        unsigned numAttempts{0};
+        unsigned numTargets{0};
+        // targets whose MCS is too small or has a chirality mismatch
+        unsigned numSkippedInfeasible{0};
+        // target conformers whose embedding failed before
+        unsigned numSkippedKnownFailures{0};
+        unsigned numFailedEmbeddings{0};
+    };
+
+    /**
+     * A batch of conformers of one core match of a molecule, the independent unit of work of embedConformers().
+     */
+    struct EmbeddingTask {
+        unsigned molIndex;
+        unsigned matchIndex;
+        unsigned batch;
+        unsigned numConfs;
+    };
+
+    /**
+     * The minimized and aligned conformers of an EmbeddingTask with their (1 if not converged, energy).
+     */
+    struct EmbeddingBatch {
+        std::vector<std::unique_ptr<RDKit::Conformer>> conformers;
+        std::vector<std::pair<int, double>> energies;
+    };
+
+    /**
+     * The embedding of a set of molecules split into tasks, see ConformerEmbedder::planEmbedding().
+     */
+    struct EmbeddingPlan {
+        RDKit::MOL_SPTR_VECT mols;
+        // ordered by molecule, match and batch
+        std::vector<EmbeddingTask> tasks;
+        // molecules whose conformers were loaded from the conformer cache, they have no tasks
+        std::vector<bool> isCached;
+        std::vector<std::string> cacheParameters;
+        // conformers planned per molecule, at least 5 per match when dividing them by the matches. Failed embeddings
+        // leave fewer.
+        std::vector<unsigned> numConfsTotal;
+        std::string coreSmarts;
+    };
+
     /**
      * The ConformerEmbedder class provides functionality for the generation of conformers for
      * a given molecule with contrained core coordinates.
@@ -35,6 +119,81 @@ namespace coaler::embedder {
          */
         void embedConformers(const RDKit::ROMOL_SPTR& mol, unsigned numConfs);
 
+        /**
+         * @overload
+         *
+         * Embed the conformers of all @param mols at once. Every core match of every molecule is embedded in
+         * independent batches of conformers on private copies of the molecule, all batches are distributed over the
+         * threads of the embedder and merged into the molecules afterwards. The conformer ids are ordered by match
+         * like in the sequential embedding.
+         * @param numConfs The number of conformers of every molecule.
+         */
+        void embedConformers(const RDKit::MOL_SPTR_VECT& mols, const std::vector<unsigned>& numConfs);
+
+        /**
+         * The steps of embedConformers() for callers that schedule the tasks themselves (e.g. the AlignmentPipeline).
+         * Plan the embedding of @param mols: precompute their topology, load cached conformers and split the
+         * remaining conformers into tasks. Not thread safe, call it before the tasks are run.
+         * @param numConfs The number of conformers of every molecule.
+         */
+        EmbeddingPlan planEmbedding(const RDKit::MOL_SPTR_VECT& mols, const std::vector<unsigned>& numConfs);
+
+        /**
+         * Embed the conformers of @param task into a private copy of @param mol on the calling thread. Tasks can run
+         * concurrently.
+         */
+        [[nodiscard]] EmbeddingBatch runEmbeddingTask(const RDKit::ROMol& mol, const EmbeddingTask& task) const;
+
+        /**
+         * Add the conformers of all tasks of the molecule @param molIndex of @param plan to it, in the order of the
+         * tasks, then expand, filter and cache them. The molecules of a plan can be merged concurrently.
+         * @param batches The batches of all tasks of @param plan by task index, the ones of the molecule are moved
+         * out of it.
+         */
+        void mergeEmbedding(const EmbeddingPlan& plan, unsigned molIndex, std::vector<EmbeddingBatch>& batches);
+
+        /**
+         * Use @param cache to load conformers of previously embedded molecules in embedConformers() and to store
+         * the conformers of newly embedded ones.
+         */
+        void setConformerCache(std::shared_ptr<io::ConformerCache> cache);
+
+        /**
+         * Add up to @param numConfs conformers per molecule in embedConformers() by driving the torsions of the
+         * rotatable bonds outside of the core, see TorsionDriver. The new conformers are minimized with the core atoms
+         * fixed before the conformer filter is applied. 0 disables the expansion.
+         */
+        void setTorsionExpansion(unsigned numConfs);
+
+        /**
+         * Only keep one of the core matches that are related by an automorphism of the molecule, they place the
+         * molecule identically onto the core, see SubstructureAnalyzer::groupSymmetryEquivalentMatches(). E.g. the
+         * 12 matches of benzene in toluene collapse to 6.
+         * Must be set before the first core matches are calculated.
+         */
+        void setCollapseMatches(bool enabled);
+
+        /**
+         * Embed the conformers of embedConformers() with the core atoms of each match constrained to the reference
+         * core coordinates instead of embedding them freely and aligning them afterwards, so every conformer has the
+         * core geometry. The core atoms are set to the reference coordinates and stay fixed during the minimization.
+         * Matches whose tethered embeddings fail get unconstrained conformers instead.
+         */
+        void setCoreTethered(bool enabled);
+
+        /**
+         * Filter the minimized conformers of embedConformers() after the torsion expansion, see ConformerFilter.
+         * @param energyWindow Maximum UFF energy above the lowest conformer (kcal/mol), 0 disables the window.
+         * @param rmsdThreshold Heavy atom RMSD (Angstrom) below which conformers are duplicates, 0 keeps duplicates.
+         */
+        void setConformerFilter(double energyWindow, double rmsdThreshold);
+
+        /**
+         * Log how many conformers the filter kept in all embedConformers() calls and the resulting number of pose
+         * pairs to score.
+         */
+        void logFilterStatistics() const;
+
         // std::vector<RDKit::MatchVectType> filterMatches(const std::vector<RDKit::MatchVectType>& matches);
 
         /**
@@ -42,25 +201,82 @@ namespace coaler::embedder {
          * @param worstLigand ligand new conformers are embedded into
          * @param targets all target ligands of the assembly
          * @param conformerIDs maps the conformerIDs to the ligands
-         * @param pairwiseStrictMCSMap MCSMap of ligand pairs with strict params
-         * @param pairwiseRelaxedMCSMap MCSMap of ligand pairs with relaxed params
+         * @param pairwiseMCS provider of the strict and relaxed MCS of ligand pairs
          * @return IDs of conformers added to @param worstLigand
+         *
+         * @note Targets whose MCS is too small or maps chiral atoms onto different tags are skipped. Embeddings onto a
+         * target conformer that failed before are not retried, unless they timed out. Every embedding runs under the
+         * embed timeout, failed embeddings fall back from the relaxed MCS to the strict MCS and then to the core atoms
+         * of the MCS. With the pose transplant enabled, the relaxed MCS is transplanted before it is embedded. New
+         * poses that duplicate an existing conformer of @param worstLigand are discarded.
+         *
+         * @param attemptSeed Identifies the generation attempt (e.g. assembly and attempt number), the embeddings are
+         * seeded with it, the ligand and the target so repeated attempts do not reproduce the same poses.
          */
-        static std::vector<multialign::PoseID> generateNewPosesForAssemblyLigand(
+        std::vector<multialign::PoseID> generateNewPosesForAssemblyLigand(
             const multialign::Ligand& worstLigand, const multialign::LigandVector& targets,
             const std::unordered_map<multialign::LigandID, multialign::PoseID>& conformerIDs,
-            const core::PairwiseMCSMap& pairwiseStrictMCSMap, const core::PairwiseMCSMap& pairwiseRelaxedMCSMap,
-            bool enforceGeneration = false);
+            const core::PairwiseMCSProvider& pairwiseMCS, bool enforceGeneration = false,
+            std::uint64_t attemptSeed = 0);
+
+        /**
+         * Create candidate poses of the worst ligand of an assembly by rigidly superposing its existing conformers
+         * onto each target over the relaxed pairwise MCS atoms. The best superpositions of every target are added
+         * as new conformers, their internal geometry is unchanged.
+         * @param worstLigand ligand new conformers are added to
+         * @param targets all target ligands of the assembly
+         * @param conformerIDs maps the conformerIDs to the ligands
+         * @param pairwiseMCS provider of the strict and relaxed MCS of ligand pairs
+         * @return IDs of conformers added to @param worstLigand
+         */
+        std::vector<multialign::PoseID> superposeExistingPoses(
+            const multialign::Ligand& worstLigand, const multialign::LigandVector& targets,
+            const std::unordered_map<multialign::LigandID, multialign::PoseID>& conformerIDs,
+            const core::PairwiseMCSProvider& pairwiseMCS);
 
         /**
          * @overload
          *
          * Embed new conformers into the worst ligand of an assembly using the core structure
          * @param worstLigand ligand new conformers are embedded into
+         * @param attemptSeed Identifies the generation attempt, see the overload above.
          * @return IDs of conformers added to @param worstLigand
          */
         std::vector<multialign::PoseID> generateNewPosesForAssemblyLigand(const multialign::Ligand& worstLigand,
-                                                                          const unsigned numConfs);
+                                                                          const unsigned numConfs,
+                                                                          std::uint64_t attemptSeed = 0);
+
+        /**
+         * Minimize the conformers @param confIds of @param mol with UFF, distributed over @param threads threads. The
+         * UFF atom types are determined once per molecule and shared by its copies.
+         * @param fixedAtoms Atoms that keep their positions during the minimization.
+         * @return (1 if not converged, energy) of every conformer, in the order of @param confIds.
+         */
+        static std::vector<std::pair<int, double>> minimizeConformers(RDKit::ROMol& mol,
+                                                                      const std::vector<int>& confIds, int threads,
+                                                                      const std::vector<unsigned>& fixedAtoms = {});
+
+        /**
+         * Calculate the core matches, the topological bounds and the UFF atom types of @param mol. They only depend on
+         * the topology, so they are calculated once per molecule and stored as private properties of the molecule:
+         * copies of it (e.g. the embedding tasks and the ligands of the optimizer) share them and they are not written
+         * to files. Setting the properties is not thread safe, so planEmbedding() calls this for every molecule
+         * before any parallel region, including molecules loaded from the conformer cache. Afterwards the getters only
+         * read the properties.
+         */
+        void precomputeTopology(const RDKit::ROMol& mol) const;
+
+        /**
+         * Get all matches of the core in @param mol, see precomputeTopology().
+         *
+         * @note The stored matches belong to the core of this embedder.
+         */
+        [[nodiscard]] std::shared_ptr<const CoreMatches> getCoreMatches(const RDKit::ROMol& mol) const;
+
+        /**
+         * Get the unsmoothed topological distance bounds of @param mol, see precomputeTopology().
+         */
+        static boost::shared_ptr<const DistGeom::BoundsMatrix> getTopologicalBounds(const RDKit::ROMol& mol);
 
         /**
          * Get the coordinates of the ligand MCS atoms from the target match
@@ -74,11 +290,107 @@ namespace coaler::embedder {
                                                                      const RDKit::MatchVectType& ligandMcsMatch,
                                                                      const RDKit::MatchVectType& targetMcsMatch);
 
+        /**
+         * Cancel constrained embeddings of generateNewPosesForAssemblyLigand() after @param timeout, 0 disables the
+         * timeout.
+         */
+        void setEmbedTimeout(std::chrono::milliseconds timeout);
+
+        /**
+         * Generate new poses by transplanting the target MCS coordinates onto an existing conformer before falling
+         * back to distance geometry, see transplantPose().
+         */
+        void setPoseTransplant(bool enabled);
+
+        /**
+         * @return The timeout statistics of the constrained embeddings by ligand.
+         */
+        [[nodiscard]] std::map<multialign::LigandID, EmbedTimeoutStatistics> getTimeoutStatistics() const;
+
+        /**
+         * @return The statistics of all generateNewPosesForAssemblyLigand() calls.
+         */
+        [[nodiscard]] PoseGenerationStatistics getPoseGenerationStatistics() const;
+
+        /**
+         * Log how many pose generation targets were skipped, how many embeddings failed and which ligands timed out.
+         */
+        void logStatistics() const;
+
       private:
+        /**
+         * Expand and filter the merged conformers of @param mol, see setTorsionExpansion() and setConformerFilter().
+         */
+        void finishEmbedding(RDKit::ROMol& mol, const std::map<int, std::pair<int, double>>& energyById);
+
+        // (ligand, target, target conformer, hash of the target conformer coordinates), conformer ids are reused
+        // after conformers are removed, so the coordinates are part of the key
+        using FailedEmbedding = std::tuple<multialign::LigandID, multialign::LigandID, multialign::PoseID, std::size_t>;
+
         core::CoreResult m_core;
         int m_threads;
         bool m_divideConformersByMatches;
+        std::shared_ptr<io::ConformerCache> m_conformerCache{nullptr};
+        unsigned m_torsionExpansion{0};
+        bool m_collapseMatches{false};
+        bool m_coreTethered{false};
+        double m_energyWindow{0};
+        double m_rmsdThreshold{0};
+        ConformerFilter m_conformerFilter{0, 0};
+        mutable std::mutex m_filterCountsMutex;
+        // (before, after) conformer counts of every filtered molecule
+        std::vector<std::pair<unsigned, unsigned>> m_filterCounts;
+
+        mutable std::mutex m_failedEmbeddingsMutex;
+        std::set<FailedEmbedding> m_failedEmbeddings;
+        std::atomic<unsigned> m_numGenerationAttempts{0};
+        std::atomic<unsigned> m_numTargets{0};
+        std::atomic<unsigned> m_numSkippedInfeasible{0};
+        std::atomic<unsigned> m_numSkippedKnownFailures{0};
+        std::atomic<unsigned> m_numFailedEmbeddings{0};
+
+        std::atomic<unsigned> m_numSuperposed{0};
+        std::atomic<unsigned> m_numDuplicatePoses{0};
+        bool m_transplantPoses{false};
+        std::atomic<unsigned> m_numTransplanted{0};
+        std::atomic<unsigned> m_numTransplantFailures{0};
+
+        std::chrono::milliseconds m_embedTimeout{0};
+        mutable std::mutex m_timeoutStatisticsMutex;
+        std::map<multialign::LigandID, EmbedTimeoutStatistics> m_timeoutStatistics;
+
+        [[nodiscard]] bool isKnownFailure(const FailedEmbedding& embedding) const;
+
+        void recordFailure(const FailedEmbedding& embedding);
+
+        /**
+         * Embed a conformer into @param mol with the coordinate map of @param params, cancelled after the embed
+         * timeout.
+         * @param timedOut Set if the embedding timed out, left unchanged otherwise.
+         * @return The id of the new conformer, -1 if the embedding failed or timed out.
+         */
+        int embedWithTimeout(RDKit::ROMol& mol, RDKit::DGeomHelpers::EmbedParameters& params,
+                             multialign::LigandID ligandID, bool isFallback, bool& timedOut);
+
+        /**
+         * Build a pose from the existing conformer of @param mol that superposes best onto the MCS coordinates in
+         * @param coordMap. The MCS atoms are set to their target coordinates and the remaining atoms are relaxed
+         * with a short UFF minimization that keeps the MCS atoms fixed.
+         * @return The id of the new conformer, -1 if the pose is too strained or inverts a chiral center.
+         */
+        int transplantPose(RDKit::ROMol& mol, const CoreAtomMapping& coordMap);
+
+        /**
+         * @return The entries of @param coordMap that belong to the core match of @param mol.
+         */
+        [[nodiscard]] CoreAtomMapping reduceToCoreAtoms(const RDKit::ROMol& mol, const CoreAtomMapping& coordMap) const;
 
         [[nodiscard]] RDKit::DGeomHelpers::EmbedParameters getEmbeddingParameters() const;
+
+        /**
+         * @return description of everything besides the molecule and core that determines the conformers generated
+         * by embedConformers(), used as part of the conformer cache key.
+         */
+        [[nodiscard]] std::string getConformerCacheParameters(unsigned numConfs) const;
     };
 }  // namespace coaler::embedder
@@ -0,0 +1,125 @@
+#include "ConformerFilter.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace {
+    // heavy atom coordinates of all conformers in a structure of arrays layout
+    struct HeavyAtomCoordinates {
+        unsigned numAtoms{0};
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+    };
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    HeavyAtomCoordinates get_heavy_atom_coordinates(const RDKit::ROMol &mol,
+                                                    const std::vector<const RDKit::Conformer *> &conformers) {
+        std::vector<unsigned> heavyAtoms;
+        for (const auto *atom : mol.atoms()) {
+            if (atom->getAtomicNum() != 1) {
+                heavyAtoms.push_back(atom->getIdx());
+            }
+        }
+
+        HeavyAtomCoordinates coordinates;
+        coordinates.numAtoms = heavyAtoms.size();
+        for (const auto *conformer : conformers) {
+            for (const auto atomId : heavyAtoms) {
+                const RDGeom::Point3D &pos = conformer->getAtomPos(atomId);
+                coordinates.x.push_back(pos.x);
+                coordinates.y.push_back(pos.y);
+                coordinates.z.push_back(pos.z);
+            }
+        }
+        return coordinates;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // whether the rmsd of two conformers (without superposition) is below the threshold
+    bool is_within_rmsd(const HeavyAtomCoordinates &coordinates, unsigned first, unsigned second,
+                        double maxSquaredDeviation) {
+        const unsigned n = coordinates.numAtoms;
+        const double *firstX = coordinates.x.data() + first * n;
+        const double *firstY = coordinates.y.data() + first * n;
+        const double *firstZ = coordinates.z.data() + first * n;
+        const double *secondX = coordinates.x.data() + second * n;
+        const double *secondY = coordinates.y.data() + second * n;
+        const double *secondZ = coordinates.z.data() + second * n;
+
+        double squaredDeviation = 0;
+#pragma omp simd reduction(+ : squaredDeviation)
+        for (unsigned i = 0; i < n; i++) {
+            const double dx = firstX[i] - secondX[i];
+            const double dy = firstY[i] - secondY[i];
+            const double dz = firstZ[i] - secondZ[i];
+            squaredDeviation += dx * dx + dy * dy + dz * dz;
+        }
+        return squaredDeviation < maxSquaredDeviation;
+    }
+}  // namespace
+
+namespace coaler::embedder {
+    ConformerFilter::ConformerFilter(double energyWindow, double rmsdThreshold)
+        : m_energyWindow(energyWindow), m_rmsdThreshold(rmsdThreshold) {}
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool ConformerFilter::isEnabled() const noexcept { return m_energyWindow > 0 || m_rmsdThreshold > 0; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned ConformerFilter::filter(RDKit::ROMol &mol, const std::vector<std::pair<int, double>> &energies) const {
+        assert(energies.size() == mol.getNumConformers());
+
+        std::vector<const RDKit::Conformer *> conformers;
+        for (auto conformer = mol.beginConformers(); conformer != mol.endConformers(); conformer++) {
+            conformers.push_back(conformer->get());
+        }
+
+        std::vector<unsigned> order(conformers.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](unsigned a, unsigned b) { return energies.at(a).second < energies.at(b).second; });
+
+        const HeavyAtomCoordinates coordinates = get_heavy_atom_coordinates(mol, conformers);
+        const double maxSquaredDeviation = m_rmsdThreshold * m_rmsdThreshold * coordinates.numAtoms;
+        const double minEnergy = order.empty() ? 0 : energies.at(order.front()).second;
+
+        std::vector<unsigned> kept;
+        std::vector<bool> isKept(conformers.size(), false);
+        for (const unsigned conformerId : order) {
+            if (m_energyWindow > 0 && energies.at(conformerId).second - minEnergy > m_energyWindow) {
+                break;
+            }
+            if (m_rmsdThreshold > 0
+                && std::any_of(kept.begin(), kept.end(), [&](unsigned keptId) {
+                       return is_within_rmsd(coordinates, conformerId, keptId, maxSquaredDeviation);
+                   })) {
+                continue;
+            }
+            kept.push_back(conformerId);
+            isKept.at(conformerId) = true;
+        }
+
+        std::vector<unsigned> removedIds;
+        for (unsigned i = 0; i < conformers.size(); i++) {
+            if (!isKept.at(i)) {
+                removedIds.push_back(conformers.at(i)->getId());
+            }
+        }
+        for (const unsigned removedId : removedIds) {
+            mol.removeConformer(removedId);
+        }
+
+        // pose ids are expected to be 0..n-1
+        unsigned newId = 0;
+        for (auto conformer = mol.beginConformers(); conformer != mol.endConformers(); conformer++) {
+            (*conformer)->setId(newId++);
+        }
+        return mol.getNumConformers();
+    }
+}  // namespace coaler::embedder
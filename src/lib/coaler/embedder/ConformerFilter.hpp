@@ -0,0 +1,48 @@
+#pragma once
+
+#include <GraphMol/ROMol.h>
+
+#include <utility>
+#include <vector>
+
+/**
+ * @file ConformerFilter.hpp
+ * @brief This file contains the ConformerFilter class which prunes high energy and duplicate conformers.
+ */
+namespace coaler::embedder {
+
+    /**
+     * The ConformerFilter class removes conformers whose energy is above an energy window and conformers that are
+     * near duplicates of lower energy ones.
+     *
+     * The conformers are expected to be aligned to the same reference, so duplicates are detected with the heavy atom
+     * RMSD of the coordinates as they are, without superposition. Conformers are visited in order of increasing
+     * energy and kept if they are not within the RMSD threshold of an already kept conformer.
+     */
+    class ConformerFilter {
+      public:
+        /**
+         * @param energyWindow Maximum energy above the lowest energy conformer (kcal/mol), 0 keeps all energies.
+         * @param rmsdThreshold Conformers within this heavy atom RMSD (Angstrom) of a kept conformer are removed, 0
+         * keeps duplicates.
+         */
+        ConformerFilter(double energyWindow, double rmsdThreshold);
+
+        /**
+         * Remove the filtered conformers from @param mol and renumber the remaining ones to 0..n-1.
+         * @param energies The (not converged, energy) results of the UFF minimization of all conformers of @param mol,
+         * in the order of the conformers.
+         * @return The number of remaining conformers.
+         */
+        unsigned filter(RDKit::ROMol& mol, const std::vector<std::pair<int, double>>& energies) const;
+
+        /**
+         * @return Whether the filter removes any conformers.
+         */
+        [[nodiscard]] bool isEnabled() const noexcept;
+
+      private:
+        double m_energyWindow;
+        double m_rmsdThreshold;
+    };
+}  // namespace coaler::embedder
@@ -2,3 +2,7 @@
 
 #include "ConformerEmbedder.hpp"
 #include "SubstructureAnalyzer.hpp"
+#include "TorsionDriver.hpp"
+#include "KabschSuperposer.hpp"
+#include "ConformerFilter.hpp"
+#include "ConformerBudget.hpp"
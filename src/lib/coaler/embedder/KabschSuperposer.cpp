@@ -0,0 +1,191 @@
+#include "KabschSuperposer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+    const unsigned JACOBI_MAX_SWEEPS = 50;
+    const double JACOBI_TOLERANCE = 1e-14;
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    using Matrix4 = std::array<std::array<double, 4>, 4>;
+
+    /**
+     * Cyclic Jacobi eigenvalue iteration for a symmetric 4x4 matrix.
+     * @return The eigenvector of the largest eigenvalue and the eigenvalue.
+     */
+    std::pair<std::array<double, 4>, double> largest_eigenpair(Matrix4 matrix) {
+        Matrix4 vectors{};
+        for (unsigned i = 0; i < 4; i++) {
+            vectors[i][i] = 1;
+        }
+
+        for (unsigned sweep = 0; sweep < JACOBI_MAX_SWEEPS; sweep++) {
+            double offDiagonal = 0;
+            for (unsigned p = 0; p < 3; p++) {
+                for (unsigned q = p + 1; q < 4; q++) {
+                    offDiagonal += matrix[p][q] * matrix[p][q];
+                }
+            }
+            if (offDiagonal < JACOBI_TOLERANCE) {
+                break;
+            }
+
+            for (unsigned p = 0; p < 3; p++) {
+                for (unsigned q = p + 1; q < 4; q++) {
+                    if (std::abs(matrix[p][q]) < 1e-300) {
+                        continue;
+                    }
+                    // rotation that zeroes matrix[p][q]
+                    const double theta = (matrix[q][q] - matrix[p][p]) / (2 * matrix[p][q]);
+                    const double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+                    const double c = 1 / std::sqrt(t * t + 1);
+                    const double s = t * c;
+
+                    for (unsigned k = 0; k < 4; k++) {
+                        const double kp = matrix[k][p];
+                        const double kq = matrix[k][q];
+                        matrix[k][p] = c * kp - s * kq;
+                        matrix[k][q] = s * kp + c * kq;
+                    }
+                    for (unsigned k = 0; k < 4; k++) {
+                        const double pk = matrix[p][k];
+                        const double qk = matrix[q][k];
+                        matrix[p][k] = c * pk - s * qk;
+                        matrix[q][k] = s * pk + c * qk;
+                    }
+                    for (unsigned k = 0; k < 4; k++) {
+                        const double kp = vectors[k][p];
+                        const double kq = vectors[k][q];
+                        vectors[k][p] = c * kp - s * kq;
+                        vectors[k][q] = s * kp + c * kq;
+                    }
+                }
+            }
+        }
+
+        unsigned best = 0;
+        for (unsigned i = 1; i < 4; i++) {
+            if (matrix[i][i] > matrix[best][best]) {
+                best = i;
+            }
+        }
+        return {{vectors[0][best], vectors[1][best], vectors[2][best], vectors[3][best]}, matrix[best][best]};
+    }
+}  // namespace
+
+namespace coaler::embedder {
+    void RigidTransform::apply(RDKit::Conformer &conformer) const {
+        for (auto &pos : conformer.getPositions()) {
+            const RDGeom::Point3D old = pos;
+            pos.x = rotation[0] * old.x + rotation[1] * old.y + rotation[2] * old.z + translation.x;
+            pos.y = rotation[3] * old.x + rotation[4] * old.y + rotation[5] * old.z + translation.y;
+            pos.z = rotation[6] * old.x + rotation[7] * old.y + rotation[8] * old.z + translation.z;
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    KabschSuperposer::KabschSuperposer(const RDGeom::POINT3D_VECT &reference) : m_numPoints(reference.size()) {
+        for (const auto &pos : reference) {
+            m_referenceCentroid += pos;
+        }
+        m_referenceCentroid /= std::max(1u, m_numPoints);
+
+        for (const auto &pos : reference) {
+            const RDGeom::Point3D centered = pos - m_referenceCentroid;
+            m_referenceX.push_back(centered.x);
+            m_referenceY.push_back(centered.y);
+            m_referenceZ.push_back(centered.z);
+            m_referenceNormSq += centered.lengthSq();
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void KabschSuperposer::addProbe(const RDGeom::POINT3D_VECT &probe) {
+        assert(probe.size() == m_numPoints);
+        for (const auto &pos : probe) {
+            m_probeX.push_back(pos.x);
+            m_probeY.push_back(pos.y);
+            m_probeZ.push_back(pos.z);
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned KabschSuperposer::getNumProbes() const noexcept {
+        return m_numPoints == 0 ? 0 : m_probeX.size() / m_numPoints;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::vector<RigidTransform> KabschSuperposer::superpose() const {
+        std::vector<RigidTransform> transforms(getNumProbes());
+        const double *refX = m_referenceX.data();
+        const double *refY = m_referenceY.data();
+        const double *refZ = m_referenceZ.data();
+
+        for (unsigned probeId = 0; probeId < transforms.size(); probeId++) {
+            const double *probeX = m_probeX.data() + probeId * m_numPoints;
+            const double *probeY = m_probeY.data() + probeId * m_numPoints;
+            const double *probeZ = m_probeZ.data() + probeId * m_numPoints;
+
+            double sumX = 0;
+            double sumY = 0;
+            double sumZ = 0;
+#pragma omp simd reduction(+ : sumX, sumY, sumZ)
+            for (unsigned i = 0; i < m_numPoints; i++) {
+                sumX += probeX[i];
+                sumY += probeY[i];
+                sumZ += probeZ[i];
+            }
+            const RDGeom::Point3D centroid(sumX / m_numPoints, sumY / m_numPoints, sumZ / m_numPoints);
+
+            // covariance of the centered probe (rows) and the centered reference (columns), the reference is
+            // centered, so the probe centroid does not have to be subtracted from the probe coordinates
+            double sxx = 0, sxy = 0, sxz = 0, syx = 0, syy = 0, syz = 0, szx = 0, szy = 0, szz = 0;
+            double probeNormSq = 0;
+#pragma omp simd reduction(+ : sxx, sxy, sxz, syx, syy, syz, szx, szy, szz, probeNormSq)
+            for (unsigned i = 0; i < m_numPoints; i++) {
+                sxx += probeX[i] * refX[i];
+                sxy += probeX[i] * refY[i];
+                sxz += probeX[i] * refZ[i];
+                syx += probeY[i] * refX[i];
+                syy += probeY[i] * refY[i];
+                syz += probeY[i] * refZ[i];
+                szx += probeZ[i] * refX[i];
+                szy += probeZ[i] * refY[i];
+                szz += probeZ[i] * refZ[i];
+                probeNormSq += probeX[i] * probeX[i] + probeY[i] * probeY[i] + probeZ[i] * probeZ[i];
+            }
+            probeNormSq -= m_numPoints * centroid.lengthSq();
+
+            const Matrix4 quaternionMatrix{{{sxx + syy + szz, syz - szy, szx - sxz, sxy - syx},
+                                            {syz - szy, sxx - syy - szz, sxy + syx, szx + sxz},
+                                            {szx - sxz, sxy + syx, -sxx + syy - szz, syz + szy},
+                                            {sxy - syx, szx + sxz, syz + szy, -sxx - syy + szz}}};
+            const auto [q, eigenvalue] = largest_eigenpair(quaternionMatrix);
+
+            RigidTransform &transform = transforms.at(probeId);
+            transform.rotation = {q[0] * q[0] + q[1] * q[1] - q[2] * q[2] - q[3] * q[3],
+                                  2 * (q[1] * q[2] - q[0] * q[3]),
+                                  2 * (q[1] * q[3] + q[0] * q[2]),
+                                  2 * (q[1] * q[2] + q[0] * q[3]),
+                                  q[0] * q[0] - q[1] * q[1] + q[2] * q[2] - q[3] * q[3],
+                                  2 * (q[2] * q[3] - q[0] * q[1]),
+                                  2 * (q[1] * q[3] - q[0] * q[2]),
+                                  2 * (q[2] * q[3] + q[0] * q[1]),
+                                  q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]};
+            const auto &r = transform.rotation;
+            transform.translation = m_referenceCentroid
+                                    - RDGeom::Point3D(r[0] * centroid.x + r[1] * centroid.y + r[2] * centroid.z,
+                                                      r[3] * centroid.x + r[4] * centroid.y + r[5] * centroid.z,
+                                                      r[6] * centroid.x + r[7] * centroid.y + r[8] * centroid.z);
+            transform.rmsd = std::sqrt(std::max(0.0, (probeNormSq + m_referenceNormSq - 2 * eigenvalue) / m_numPoints));
+        }
+        return transforms;
+    }
+}  // namespace coaler::embedder
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <GraphMol/Conformer.h>
+
+#include <array>
+#include <vector>
+
+/**
+ * @file KabschSuperposer.hpp
+ * @brief This file contains the KabschSuperposer class which superposes batches of point sets onto a reference.
+ */
+namespace coaler::embedder {
+
+    /**
+     * Rigid transform x -> rotation * x + translation.
+     */
+    struct RigidTransform {
+        // row major
+        std::array<double, 9> rotation{1, 0, 0, 0, 1, 0, 0, 0, 1};
+        RDGeom::Point3D translation;
+        // rmsd of the superposed points
+        double rmsd{0};
+
+        /**
+         * Transform all atom positions of @param conformer.
+         */
+        void apply(RDKit::Conformer& conformer) const;
+    };
+
+    /**
+     * The KabschSuperposer class calculates the optimal rigid superposition of many probe point sets onto one
+     * reference point set.
+     *
+     * The probes are stored in a structure of arrays layout, so the covariance of each probe is accumulated in a
+     * single vectorizable pass. The rotation is the eigenvector of the largest eigenvalue of the 4x4 quaternion
+     * matrix (Horn's closed form of the Kabsch problem), which avoids a 3x3 SVD and never yields reflections.
+     */
+    class KabschSuperposer {
+      public:
+        /**
+         * @param reference The points the probes are superposed onto.
+         */
+        explicit KabschSuperposer(const RDGeom::POINT3D_VECT& reference);
+
+        /**
+         * Add a probe with the same number of points as the reference, point i corresponds to reference point i.
+         */
+        void addProbe(const RDGeom::POINT3D_VECT& probe);
+
+        /**
+         * @return The transforms that superpose the probes onto the reference, in the order they were added.
+         */
+        [[nodiscard]] std::vector<RigidTransform> superpose() const;
+
+        [[nodiscard]] unsigned getNumProbes() const noexcept;
+
+      private:
+        unsigned m_numPoints;
+        RDGeom::Point3D m_referenceCentroid;
+        // centered reference coordinates
+        std::vector<double> m_referenceX;
+        std::vector<double> m_referenceY;
+        std::vector<double> m_referenceZ;
+        double m_referenceNormSq{0};
+        // probe coordinates, m_numPoints per probe
+        std::vector<double> m_probeX;
+        std::vector<double> m_probeY;
+        std::vector<double> m_probeZ;
+    };
+}  // namespace coaler::embedder
@@ -3,6 +3,9 @@
 #include <GraphMol/Substruct/SubstructMatch.h>
 #include <GraphMol/new_canon.h>
 
+#include <algorithm>
+#include <map>
+
 namespace {
     struct HasDegreeTwo {
         bool operator()(RDKit::Atom* atom) { return atom->getDegree() == 2; }
@@ -93,3 +96,32 @@ unsigned coaler::embedder::SubstructureAnalyzer::getNumberOfRingRotations(const
 
     return nofRotations;
 }
+
+/*----------------------------------------------------------------------------------------------------------------*/
+
+std::vector<std::vector<unsigned>> coaler::embedder::SubstructureAnalyzer::groupSymmetryEquivalentMatches(
+    const RDKit::ROMol& molecule, const std::vector<RDKit::MatchVectType>& matches) {
+    // atoms with the same rank (without tie breaking) are symmetry equivalent
+    std::vector<unsigned> ranks;
+    RDKit::Canon::rankMolAtoms(molecule, ranks, false, true, false);
+
+    std::map<std::vector<unsigned>, unsigned> groupIdBySignature;
+    std::vector<std::vector<unsigned>> groups;
+    for (unsigned matchId = 0; matchId < matches.size(); matchId++) {
+        // rank of the molecule atom on every core atom
+        RDKit::MatchVectType match = matches.at(matchId);
+        std::sort(match.begin(), match.end());
+        std::vector<unsigned> signature;
+        signature.reserve(match.size());
+        for (const auto& [queryId, molId] : match) {
+            signature.push_back(ranks.at(molId));
+        }
+
+        const auto [group, isNew] = groupIdBySignature.emplace(std::move(signature), groups.size());
+        if (isNew) {
+            groups.emplace_back();
+        }
+        groups.at(group->second).push_back(matchId);
+    }
+    return groups;
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <GraphMol/ROMol.h>
+#include <GraphMol/Substruct/SubstructMatch.h>
+
+#include <vector>
 
 namespace coaler::embedder {
 
@@ -23,5 +26,21 @@ namespace coaler::embedder {
         static unsigned getNumberOfRingRotations(const RDKit::ROMol& molecule);
 
         static unsigned getNumberOfUniqueSubstructureMatches(const RDKit::ROMol& query, const RDKit::ROMol& molecule);
+
+        /**
+         * Group the matches of a core that are related by an automorphism of the molecule, e.g. the two matches of
+         * benzene in toluene that mirror the ring at the methyl group. Matches are equivalent if they map atoms with
+         * the same canonical rank onto every core atom. Symmetries of the core that are no symmetries of the molecule
+         * (e.g. the rotations of benzene that move the methyl group of toluene to another core atom) keep their
+         * matches apart, so each group corresponds to a distinct placement of the molecule on the core.
+         * c1ccccc1 in Cc1ccccc1 --> 6 groups of 2 matches
+         * c1ccccc1 in Cc1ccc(C)cc1 --> 3 groups of 4 matches
+         *
+         * @param molecule The molecule the matches belong to.
+         * @param matches Matches of the core in @param molecule, (core atom, molecule atom) pairs.
+         * @return Groups of indices into @param matches, ordered by their first match.
+         */
+        static std::vector<std::vector<unsigned>> groupSymmetryEquivalentMatches(
+            const RDKit::ROMol& molecule, const std::vector<RDKit::MatchVectType>& matches);
     };
 }  // namespace coaler::embedder
@@ -0,0 +1,176 @@
+#include "TorsionDriver.hpp"
+
+#include <GraphMol/MolOps.h>
+#include <GraphMol/MolTransforms/MolTransforms.h>
+#include <GraphMol/SmilesParse/SmilesParse.h>
+#include <GraphMol/Substruct/SubstructMatch.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <queue>
+#include <string>
+
+namespace {
+    // single, acyclic bonds between non terminal atoms that are not part of a triple bond
+    const std::string ROTATABLE_BOND_SMARTS = "[!$(*#*)&!D1]-&!@[!$(*#*)&!D1]";
+
+    // staggered torsions of sp3-sp3 bonds and the planar torsions of conjugated bonds
+    const std::vector<double> TORSION_LIBRARY_DEG = {180, 60, -60, 0, 120, -120};
+
+    // library values closer than this to the current torsion do not yield a new conformer
+    const double MIN_TORSION_CHANGE_DEG = 30;
+
+    const double CLASH_DISTANCE_HEAVY = 2.5;
+    const double CLASH_DISTANCE_HYDROGEN = 1.5;
+    const double MIN_CLASH_TOPOLOGICAL_DISTANCE = 3;
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // atoms on the side of third when the bond (second, third) is removed
+    std::vector<bool> get_moving_side(const RDKit::ROMol &mol, unsigned second, unsigned third) {
+        std::vector<bool> isMoving(mol.getNumAtoms(), false);
+        std::queue<unsigned> queue;
+        isMoving.at(third) = true;
+        queue.push(third);
+        while (!queue.empty()) {
+            const unsigned atomId = queue.front();
+            queue.pop();
+            for (const auto &neighborId :
+                 boost::make_iterator_range(mol.getAtomNeighbors(mol.getAtomWithIdx(atomId)))) {
+                if (isMoving.at(neighborId) || (atomId == third && neighborId == second)) {
+                    continue;
+                }
+                isMoving.at(neighborId) = true;
+                queue.push(neighborId);
+            }
+        }
+        return isMoving;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool contains_fixed_atom(const std::vector<bool> &isMoving, const std::vector<unsigned> &fixedAtoms) {
+        return std::any_of(fixedAtoms.begin(), fixedAtoms.end(), [&](unsigned atomId) { return isMoving.at(atomId); });
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // a neighbor of center other than exclude, heavy atoms are preferred to define the dihedral
+    unsigned get_dihedral_neighbor(const RDKit::ROMol &mol, unsigned center, unsigned exclude) {
+        int neighbor = -1;
+        for (const auto &neighborId : boost::make_iterator_range(mol.getAtomNeighbors(mol.getAtomWithIdx(center)))) {
+            if (neighborId == exclude) {
+                continue;
+            }
+            if (neighbor < 0 || mol.getAtomWithIdx(neighbor)->getAtomicNum() == 1) {
+                neighbor = static_cast<int>(neighborId);
+            }
+        }
+        return static_cast<unsigned>(neighbor);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    double wrap_degrees(double angle) {
+        angle = std::fmod(angle + 180.0, 360.0);
+        return angle < 0 ? angle + 180.0 : angle - 180.0;
+    }
+}  // namespace
+
+namespace coaler::embedder {
+    TorsionDriver::TorsionDriver(const RDKit::ROMol &mol, const std::vector<unsigned> &fixedAtoms)
+        : m_numAtoms(mol.getNumAtoms()) {
+        const double *distances = RDKit::MolOps::getDistanceMat(mol);
+        m_topologicalDistances.assign(distances, distances + m_numAtoms * m_numAtoms);
+        for (const auto *atom : mol.atoms()) {
+            m_isHydrogen.push_back(atom->getAtomicNum() == 1);
+        }
+
+        const std::unique_ptr<RDKit::RWMol> rotatableBond(RDKit::SmartsToMol(ROTATABLE_BOND_SMARTS));
+        for (const auto &match : RDKit::SubstructMatch(mol, *rotatableBond)) {
+            auto second = static_cast<unsigned>(match.at(0).second);
+            auto third = static_cast<unsigned>(match.at(1).second);
+
+            // move the side without fixed atoms
+            std::vector<bool> isMoving = get_moving_side(mol, second, third);
+            if (contains_fixed_atom(isMoving, fixedAtoms)) {
+                std::swap(second, third);
+                isMoving = get_moving_side(mol, second, third);
+                if (contains_fixed_atom(isMoving, fixedAtoms)) {
+                    continue;
+                }
+            }
+
+            m_torsions.push_back({get_dihedral_neighbor(mol, second, third), second, third,
+                                  get_dihedral_neighbor(mol, third, second), std::move(isMoving)});
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned TorsionDriver::expand(RDKit::ROMol &mol, unsigned maxNewConformers) const {
+        std::vector<int> sourceIds;
+        for (auto conformer = mol.beginConformers(); conformer != mol.endConformers(); conformer++) {
+            sourceIds.push_back(static_cast<int>((*conformer)->getId()));
+        }
+
+        unsigned numAdded = 0;
+        for (const double torsionValue : TORSION_LIBRARY_DEG) {
+            for (const Torsion &torsion : m_torsions) {
+                for (const int sourceId : sourceIds) {
+                    if (numAdded >= maxNewConformers) {
+                        return numAdded;
+                    }
+
+                    const RDKit::Conformer &source = mol.getConformer(sourceId);
+                    const double currentValue = MolTransforms::getDihedralDeg(source, torsion.first, torsion.second,
+                                                                              torsion.third, torsion.fourth);
+                    if (std::abs(wrap_degrees(currentValue - torsionValue)) < MIN_TORSION_CHANGE_DEG) {
+                        continue;
+                    }
+
+                    auto conformer = std::make_unique<RDKit::Conformer>(source);
+                    MolTransforms::setDihedralDeg(*conformer, torsion.first, torsion.second, torsion.third,
+                                                  torsion.fourth, torsionValue);
+                    if (hasClash(*conformer, torsion)) {
+                        continue;
+                    }
+
+                    mol.addConformer(conformer.release(), true);
+                    numAdded++;
+                }
+            }
+        }
+        return numAdded;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    unsigned TorsionDriver::getNumTorsions() const noexcept { return m_torsions.size(); }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool TorsionDriver::hasClash(const RDKit::Conformer &conformer, const Torsion &torsion) const {
+        // only distances between moved and unmoved atoms changed
+        for (unsigned movingId = 0; movingId < m_numAtoms; movingId++) {
+            if (!torsion.isMoving.at(movingId)) {
+                continue;
+            }
+            const RDGeom::Point3D &movingPos = conformer.getAtomPos(movingId);
+            for (unsigned fixedId = 0; fixedId < m_numAtoms; fixedId++) {
+                if (torsion.isMoving.at(fixedId)
+                    || m_topologicalDistances.at(movingId * m_numAtoms + fixedId) <= MIN_CLASH_TOPOLOGICAL_DISTANCE) {
+                    continue;
+                }
+                const double clashDistance = m_isHydrogen.at(movingId) || m_isHydrogen.at(fixedId)
+                                                 ? CLASH_DISTANCE_HYDROGEN
+                                                 : CLASH_DISTANCE_HEAVY;
+                if ((conformer.getAtomPos(fixedId) - movingPos).lengthSq() < clashDistance * clashDistance) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+}  // namespace coaler::embedder
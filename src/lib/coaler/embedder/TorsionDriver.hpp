@@ -0,0 +1,60 @@
+#pragma once
+
+#include <GraphMol/ROMol.h>
+
+#include <vector>
+
+/**
+ * @file TorsionDriver.hpp
+ * @brief This file contains the TorsionDriver class which expands conformers by rotating their rotatable bonds.
+ */
+namespace coaler::embedder {
+
+    /**
+     * The TorsionDriver class generates new conformers from existing (minimized) ones by setting the torsion of
+     * single rotatable bonds to the values of a discrete torsion library.
+     *
+     * Only the side of a bond without fixed atoms (usually the core) is rotated, so the new conformers stay aligned
+     * to the core. Conformers with clashes between the rotated and the remaining atoms are discarded. This is much
+     * cheaper than embedding and minimizing new conformers.
+     */
+    class TorsionDriver {
+      public:
+        /**
+         * @param mol The molecule whose conformers are expanded.
+         * @param fixedAtoms Atoms that must not move, bonds with fixed atoms on both sides are not rotated.
+         */
+        TorsionDriver(const RDKit::ROMol& mol, const std::vector<unsigned>& fixedAtoms);
+
+        /**
+         * Add up to @param maxNewConformers conformers to @param mol, which has to be the molecule of the
+         * constructor. The torsions of every library value are applied to all existing conformers before the next
+         * value is used.
+         * @return The number of added conformers.
+         */
+        unsigned expand(RDKit::ROMol& mol, unsigned maxNewConformers) const;
+
+        /**
+         * @return The number of rotatable bonds that can be driven.
+         */
+        [[nodiscard]] unsigned getNumTorsions() const noexcept;
+
+      private:
+        struct Torsion {
+            // dihedral (first, second, third, fourth), the atoms on the side of third are moved
+            unsigned first;
+            unsigned second;
+            unsigned third;
+            unsigned fourth;
+            std::vector<bool> isMoving;
+        };
+
+        [[nodiscard]] bool hasClash(const RDKit::Conformer& conformer, const Torsion& torsion) const;
+
+        unsigned m_numAtoms;
+        std::vector<Torsion> m_torsions;
+        std::vector<bool> m_isHydrogen;
+        // topological distances, atoms up to 3 bonds apart never clash
+        std::vector<double> m_topologicalDistances;
+    };
+}  // namespace coaler::embedder
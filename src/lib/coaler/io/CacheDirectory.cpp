@@ -0,0 +1,184 @@
+#include "CacheDirectory.hpp"
+
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/interprocess/file_mapping.hpp>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace {
+    // every entry file starts with this magic followed by the key length, the key and the payload
+    const std::string ENTRY_MAGIC = "COALERC1";
+    const std::string ENTRY_EXTENSION = ".bin";
+    const double EVICTION_TARGET_FRACTION = 0.9;
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // FNV-1a, used instead of std::hash because file names have to be stable across builds
+    std::uint64_t hash_key(const std::string& key) {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (const char c : key) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::uintmax_t get_directory_size(const std::filesystem::path& path) {
+        std::uintmax_t size = 0;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+            if (entry.is_regular_file(error) && entry.path().extension() == ENTRY_EXTENSION) {
+                size += entry.file_size(error);
+            }
+        }
+        return size;
+    }
+}  // namespace
+
+/*----------------------------------------------------------------------------------------------------------------*/
+
+namespace coaler::io {
+    CacheEntry::CacheEntry(boost::interprocess::mapped_region region, std::size_t payloadOffset)
+        : m_region(std::move(region)), m_payloadOffset(payloadOffset) {}
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    const char* CacheEntry::data() const noexcept {
+        return static_cast<const char*>(m_region.get_address()) + m_payloadOffset;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::size_t CacheEntry::size() const noexcept { return m_region.get_size() - m_payloadOffset; }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    CacheDirectory::CacheDirectory(const std::string& path, std::uintmax_t maxSizeBytes)
+        : m_path(path), m_maxSizeBytes(maxSizeBytes) {
+        std::filesystem::create_directories(m_path);
+        m_approximateSizeBytes = get_directory_size(m_path);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::filesystem::path CacheDirectory::getEntryPath(const std::string& key) const {
+        return m_path / (fmt::format("{:016x}", hash_key(key)) + ENTRY_EXTENSION);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::optional<CacheEntry> CacheDirectory::read(const std::string& key) const {
+        const std::filesystem::path entryPath = this->getEntryPath(key);
+        std::error_code error;
+        if (!std::filesystem::exists(entryPath, error)) {
+            return std::nullopt;
+        }
+
+        try {
+            // the mapping stays valid even if the file is evicted by another process while we read it
+            const boost::interprocess::file_mapping file(entryPath.c_str(), boost::interprocess::read_only);
+            boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+
+            const auto* bytes = static_cast<const char*>(region.get_address());
+            const std::size_t headerSize = ENTRY_MAGIC.size() + sizeof(std::uint64_t);
+            if (region.get_size() < headerSize || std::memcmp(bytes, ENTRY_MAGIC.data(), ENTRY_MAGIC.size()) != 0) {
+                spdlog::warn("ignoring corrupt cache entry {}", entryPath.string());
+                return std::nullopt;
+            }
+
+            std::uint64_t keySize = 0;
+            std::memcpy(&keySize, bytes + ENTRY_MAGIC.size(), sizeof(keySize));
+            if (region.get_size() < headerSize + keySize
+                || key.compare(0, std::string::npos, bytes + headerSize, keySize) != 0) {
+                // hash collision or truncated entry
+                return std::nullopt;
+            }
+
+            // refresh the modification time, it serves as access time for the LRU eviction
+            std::filesystem::last_write_time(entryPath, std::filesystem::file_time_type::clock::now(), error);
+
+            return CacheEntry(std::move(region), headerSize + keySize);
+        } catch (const boost::interprocess::interprocess_exception& e) {
+            spdlog::debug("failed to map cache entry {}: {}", entryPath.string(), e.what());
+            return std::nullopt;
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void CacheDirectory::write(const std::string& key, const std::string& payload) {
+        const std::filesystem::path entryPath = this->getEntryPath(key);
+
+        // write to a process and thread unique temporary file first and rename it afterwards. The rename is atomic,
+        // so readers never observe a partially written entry.
+        const std::filesystem::path tmpPath
+            = entryPath.string()
+              + fmt::format(".{}.{}.tmp", getpid(), std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                spdlog::warn("cannot write cache entry {}", tmpPath.string());
+                return;
+            }
+            const std::uint64_t keySize = key.size();
+            out.write(ENTRY_MAGIC.data(), static_cast<std::streamsize>(ENTRY_MAGIC.size()));
+            out.write(reinterpret_cast<const char*>(&keySize), sizeof(keySize));
+            out.write(key.data(), static_cast<std::streamsize>(key.size()));
+            out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tmpPath, entryPath, error);
+        if (error) {
+            spdlog::warn("cannot write cache entry {}: {}", entryPath.string(), error.message());
+            std::filesystem::remove(tmpPath, error);
+            return;
+        }
+
+        const std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_approximateSizeBytes += ENTRY_MAGIC.size() + sizeof(std::uint64_t) + key.size() + payload.size();
+        if (m_approximateSizeBytes > m_maxSizeBytes) {
+            this->evictLeastRecentlyUsed();
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void CacheDirectory::evictLeastRecentlyUsed() {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+        std::uintmax_t size = 0;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(m_path, error)) {
+            if (!entry.is_regular_file(error) || entry.path().extension() != ENTRY_EXTENSION) {
+                continue;
+            }
+            size += entry.file_size(error);
+            entries.emplace_back(entry.last_write_time(error), entry.path());
+        }
+
+        // evict slightly below the limit, so we do not have to rescan the directory on every write
+        const auto targetSize = static_cast<std::uintmax_t>(EVICTION_TARGET_FRACTION * m_maxSizeBytes);
+        std::sort(entries.begin(), entries.end());
+        unsigned evicted = 0;
+        for (const auto& [time, path] : entries) {
+            if (size <= targetSize) {
+                break;
+            }
+            const std::uintmax_t entrySize = std::filesystem::file_size(path, error);
+            if (std::filesystem::remove(path, error)) {
+                size -= std::min(size, entrySize);
+                evicted++;
+            }
+        }
+
+        spdlog::debug("evicted {} cache entries from {}", evicted, m_path.string());
+        m_approximateSizeBytes = size;
+    }
+}  // namespace coaler::io
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+
+/**
+ * @file CacheDirectory.hpp
+ * @brief This file contains the CacheDirectory class which stores binary cache entries on disk.
+ */
+namespace coaler::io {
+
+    /**
+     * A read-only, memory-mapped view of the payload of a single cache entry.
+     */
+    class CacheEntry {
+      public:
+        CacheEntry(boost::interprocess::mapped_region region, std::size_t payloadOffset);
+
+        /**
+         * @return Pointer to the first byte of the payload.
+         */
+        [[nodiscard]] const char* data() const noexcept;
+
+        /**
+         * @return Size of the payload in bytes.
+         */
+        [[nodiscard]] std::size_t size() const noexcept;
+
+      private:
+        boost::interprocess::mapped_region m_region;
+        std::size_t m_payloadOffset;
+    };
+
+    /**
+     * The CacheDirectory class provides a size bounded key/value store on disk. Every entry is one file whose name
+     * is derived from a hash of the key. The full key is stored in the file as well, so hash collisions are detected
+     * on read.
+     *
+     * Entries are written to a temporary file and renamed into place, so concurrent readers (threads or processes)
+     * only ever see complete entries. Reading an entry refreshes its modification time, which is used to evict the
+     * least recently used entries once the directory grows beyond its size limit.
+     */
+    class CacheDirectory {
+      public:
+        /**
+         * @param path Directory the entries are stored in. It is created if it does not exist.
+         * @param maxSizeBytes Upper bound for the accumulated size of all entries.
+         */
+        CacheDirectory(const std::string& path, std::uintmax_t maxSizeBytes);
+
+        /**
+         * Map the entry stored for @param key into memory.
+         * @return The entry or std::nullopt if there is no (valid) entry for the key.
+         */
+        [[nodiscard]] std::optional<CacheEntry> read(const std::string& key) const;
+
+        /**
+         * Store @param payload for @param key, replacing a previous entry. Evicts least recently used entries if
+         * the size limit is exceeded afterwards.
+         */
+        void write(const std::string& key, const std::string& payload);
+
+      private:
+        [[nodiscard]] std::filesystem::path getEntryPath(const std::string& key) const;
+
+        void evictLeastRecentlyUsed();
+
+        std::filesystem::path m_path;
+        std::uintmax_t m_maxSizeBytes;
+        std::uintmax_t m_approximateSizeBytes{0};
+        std::mutex m_writeMutex;
+    };
+}  // namespace coaler::io
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @file CanonicalMolecule.hpp
+ * @brief This file contains the CanonicalMolecule struct which identifies a molecule in the caches.
+ */
+namespace coaler::io {
+
+    /**
+     * The canonical SMILES and the canonical atom ranks of a molecule, which identify it in the PairwiseMCSCache.
+     */
+    struct CanonicalMolecule {
+        std::string smiles;
+        std::vector<unsigned> ranks;
+    };
+}  // namespace coaler::io
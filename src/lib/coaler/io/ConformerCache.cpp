@@ -0,0 +1,110 @@
+#include "ConformerCache.hpp"
+
+#include <GraphMol/Conformer.h>
+#include <GraphMol/SmilesParse/SmilesWrite.h>
+#include <GraphMol/new_canon.h>
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+    std::vector<unsigned> get_canonical_ranks(const RDKit::ROMol& mol) {
+        std::vector<unsigned> ranks;
+        RDKit::Canon::rankMolAtoms(mol, ranks, true, true, true);
+        return ranks;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    template <typename T>
+    void append_value(std::string& buffer, T value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    template <typename T>
+    T read_value(const char* data, std::size_t offset) {
+        T value;
+        std::memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+}  // namespace
+
+/*----------------------------------------------------------------------------------------------------------------*/
+
+namespace coaler::io {
+    ConformerCache::ConformerCache(const std::string& directory, std::uintmax_t maxSizeBytes)
+        : m_directory(directory, maxSizeBytes) {}
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::string ConformerCache::buildKey(const RDKit::ROMol& mol, const std::string& coreSmarts,
+                                         const std::string& parameters) {
+        return RDKit::MolToSmiles(mol) + "\n" + coreSmarts + "\n" + parameters;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool ConformerCache::load(RDKit::ROMol& mol, const std::string& coreSmarts, const std::string& parameters) const {
+        const auto entry = m_directory.read(buildKey(mol, coreSmarts, parameters));
+        if (!entry.has_value()) {
+            return false;
+        }
+
+        // layout: numAtoms (uint32), numConfs (uint32), numConfs * numAtoms * 3 floats in canonical rank order
+        const std::size_t headerSize = 2 * sizeof(std::uint32_t);
+        if (entry->size() < headerSize) {
+            return false;
+        }
+        const auto numAtoms = read_value<std::uint32_t>(entry->data(), 0);
+        const auto numConfs = read_value<std::uint32_t>(entry->data(), sizeof(std::uint32_t));
+        const std::size_t confSize = 3UL * numAtoms * sizeof(float);
+        if (numAtoms != mol.getNumAtoms() || entry->size() != headerSize + numConfs * confSize) {
+            spdlog::warn("ignoring cached conformers with unexpected size for {}", RDKit::MolToSmiles(mol));
+            return false;
+        }
+
+        const std::vector<unsigned> ranks = get_canonical_ranks(mol);
+        for (unsigned confIdx = 0; confIdx < numConfs; confIdx++) {
+            auto* conformer = new RDKit::Conformer(numAtoms);
+            const std::size_t confOffset = headerSize + confIdx * confSize;
+            for (unsigned atomIdx = 0; atomIdx < numAtoms; atomIdx++) {
+                const std::size_t atomOffset = confOffset + 3UL * ranks.at(atomIdx) * sizeof(float);
+                conformer->setAtomPos(atomIdx, RDGeom::Point3D(read_value<float>(entry->data(), atomOffset),
+                                                               read_value<float>(entry->data(), atomOffset + 4),
+                                                               read_value<float>(entry->data(), atomOffset + 8)));
+            }
+            mol.addConformer(conformer, true);
+        }
+
+        return true;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void ConformerCache::store(const RDKit::ROMol& mol, const std::string& coreSmarts, const std::string& parameters) {
+        const unsigned numAtoms = mol.getNumAtoms();
+        const std::vector<unsigned> ranks = get_canonical_ranks(mol);
+
+        std::string payload;
+        payload.reserve(2 * sizeof(std::uint32_t) + 3UL * numAtoms * mol.getNumConformers() * sizeof(float));
+        append_value<std::uint32_t>(payload, numAtoms);
+        append_value<std::uint32_t>(payload, mol.getNumConformers());
+
+        std::vector<float> coords(3UL * numAtoms);
+        for (auto conf = mol.beginConformers(); conf != mol.endConformers(); conf++) {
+            for (unsigned atomIdx = 0; atomIdx < numAtoms; atomIdx++) {
+                const RDGeom::Point3D& pos = (*conf)->getAtomPos(atomIdx);
+                const unsigned offset = 3 * ranks.at(atomIdx);
+                coords.at(offset) = static_cast<float>(pos.x);
+                coords.at(offset + 1) = static_cast<float>(pos.y);
+                coords.at(offset + 2) = static_cast<float>(pos.z);
+            }
+            payload.append(reinterpret_cast<const char*>(coords.data()), coords.size() * sizeof(float));
+        }
+
+        m_directory.write(buildKey(mol, coreSmarts, parameters), payload);
+    }
+}  // namespace coaler::io
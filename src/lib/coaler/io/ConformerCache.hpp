@@ -0,0 +1,54 @@
+#pragma once
+
+#include <GraphMol/ROMol.h>
+
+#include <string>
+
+#include "CacheDirectory.hpp"
+
+/**
+ * @file ConformerCache.hpp
+ * @brief This file contains the ConformerCache class which persists embedded conformers between runs.
+ */
+namespace coaler::io {
+
+    /**
+     * The ConformerCache class stores the conformers of embedded molecules on disk, so reruns on overlapping ligand
+     * sets can skip the embedding of molecules that were already embedded with the same core and parameters.
+     *
+     * Entries are keyed by the canonical SMILES of the molecule, the core SMARTS and a description of the embedding
+     * parameters (including the seed). Coordinates are stored as single precision floats in canonical atom rank order,
+     * so an entry remains valid if the atom order of the input molecule changes between runs.
+     */
+    class ConformerCache {
+      public:
+        /**
+         * @param directory Directory the cache entries are stored in.
+         * @param maxSizeBytes Size limit of the cache, least recently used entries are evicted beyond it.
+         */
+        ConformerCache(const std::string& directory, std::uintmax_t maxSizeBytes);
+
+        /**
+         * Add the cached conformers of @param mol to it.
+         * @param mol The molecule to load the conformers for. Existing conformers are kept.
+         * @param coreSmarts SMARTS of the core the conformers were aligned to.
+         * @param parameters Description of the embedding parameters.
+         * @return True if an entry was found and its conformers were added.
+         */
+        bool load(RDKit::ROMol& mol, const std::string& coreSmarts, const std::string& parameters) const;
+
+        /**
+         * Store all conformers of @param mol.
+         * @param mol The embedded molecule.
+         * @param coreSmarts SMARTS of the core the conformers were aligned to.
+         * @param parameters Description of the embedding parameters.
+         */
+        void store(const RDKit::ROMol& mol, const std::string& coreSmarts, const std::string& parameters);
+
+      private:
+        static std::string buildKey(const RDKit::ROMol& mol, const std::string& coreSmarts,
+                                    const std::string& parameters);
+
+        CacheDirectory m_directory;
+    };
+}  // namespace coaler::io
@@ -1,3 +1,7 @@
+#include "CacheDirectory.hpp"
+#include "CanonicalMolecule.hpp"
+#include "ConformerCache.hpp"
 #include "FileNotFoundException.hpp"
 #include "FileParser.hpp"
 #include "OutputWriter.hpp"
+#include "PairwiseMCSCache.hpp"
@@ -0,0 +1,143 @@
+#include "PairwiseMCSCache.hpp"
+
+#include <GraphMol/SmilesParse/SmilesWrite.h>
+#include <GraphMol/new_canon.h>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace {
+    const std::string KEY_VERSION = "pairwise-mcs-v1";
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // layout: number of atom pairs (uint32), followed by (query atom id, canonical rank) pairs (int32 each)
+    void append_match(std::string& buffer, const RDKit::MatchVectType& match, const std::vector<unsigned>& ranks) {
+        const auto size = static_cast<std::uint32_t>(match.size());
+        buffer.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        for (const auto& [queryId, molId] : match) {
+            const std::array<std::int32_t, 2> values = {queryId, static_cast<std::int32_t>(ranks.at(molId))};
+            buffer.append(reinterpret_cast<const char*>(values.data()), sizeof(values));
+        }
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    bool read_match(const char* data, std::size_t size, std::size_t& offset, const std::vector<unsigned>& ranks,
+                    RDKit::MatchVectType& match) {
+        std::uint32_t numPairs = 0;
+        if (offset + sizeof(numPairs) > size) {
+            return false;
+        }
+        std::memcpy(&numPairs, data + offset, sizeof(numPairs));
+        offset += sizeof(numPairs);
+
+        const std::size_t pairSize = 2 * sizeof(std::int32_t);
+        if (offset + numPairs * pairSize > size) {
+            return false;
+        }
+
+        std::vector<int> rankToAtom(ranks.size());
+        for (unsigned atomId = 0; atomId < ranks.size(); atomId++) {
+            rankToAtom.at(ranks.at(atomId)) = static_cast<int>(atomId);
+        }
+
+        match.clear();
+        for (std::uint32_t i = 0; i < numPairs; i++) {
+            std::array<std::int32_t, 2> values{};
+            std::memcpy(values.data(), data + offset, pairSize);
+            offset += pairSize;
+            if (values.at(1) < 0 || static_cast<std::size_t>(values.at(1)) >= rankToAtom.size()) {
+                return false;
+            }
+            match.emplace_back(values.at(0), rankToAtom.at(values.at(1)));
+        }
+        return true;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    // the key is independent of the order of the molecules, the entry is stored in canonical order.
+    std::pair<std::string, bool> build_key(const coaler::io::CanonicalMolecule& first,
+                                           const coaler::io::CanonicalMolecule& second, bool strict,
+                                           const std::string& seed) {
+        const std::string& firstSmiles = first.smiles;
+        const std::string& secondSmiles = second.smiles;
+        const bool swapped = secondSmiles < firstSmiles;
+        const std::string key = KEY_VERSION + "\n" + (swapped ? secondSmiles : firstSmiles) + "\n"
+                                + (swapped ? firstSmiles : secondSmiles) + "\n" + (strict ? "strict" : "relaxed")
+                                + "\n" + seed;
+        return {key, swapped};
+    }
+}  // namespace
+
+/*----------------------------------------------------------------------------------------------------------------*/
+
+namespace coaler::io {
+    PairwiseMCSCache::PairwiseMCSCache(const std::string& directory, std::uintmax_t maxSizeBytes)
+        : m_directory(directory, maxSizeBytes) {}
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    CanonicalMolecule PairwiseMCSCache::getCanonicalMolecule(const RDKit::ROMol& mol) {
+        CanonicalMolecule canonical;
+        canonical.smiles = RDKit::MolToSmiles(mol);
+        RDKit::Canon::rankMolAtoms(mol, canonical.ranks, true, true, true);
+        return canonical;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    std::optional<core::PairwiseMCS> PairwiseMCSCache::load(const CanonicalMolecule& first,
+                                                            const CanonicalMolecule& second, bool strict,
+                                                            const std::string& seed) const {
+        const auto [key, swapped] = build_key(first, second, strict, seed);
+        const auto entry = m_directory.read(key);
+        if (!entry.has_value()) {
+            return std::nullopt;
+        }
+
+        const CanonicalMolecule& canonicalFirst = swapped ? second : first;
+        const CanonicalMolecule& canonicalSecond = swapped ? first : second;
+
+        std::size_t offset = 0;
+        RDKit::MatchVectType canonicalFirstMatch;
+        RDKit::MatchVectType canonicalSecondMatch;
+        if (!read_match(entry->data(), entry->size(), offset, canonicalFirst.ranks, canonicalFirstMatch)
+            || !read_match(entry->data(), entry->size(), offset, canonicalSecond.ranks, canonicalSecondMatch)) {
+            spdlog::warn("ignoring corrupt pairwise mcs cache entry");
+            return std::nullopt;
+        }
+        std::string smarts(entry->data() + offset, entry->size() - offset);
+
+        if (swapped) {
+            return std::make_tuple(canonicalSecondMatch, canonicalFirstMatch, smarts);
+        }
+        return std::make_tuple(canonicalFirstMatch, canonicalSecondMatch, smarts);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void PairwiseMCSCache::store(const CanonicalMolecule& first, const CanonicalMolecule& second, bool strict,
+                                 const std::string& seed, const core::PairwiseMCS& mcs) {
+        const auto& [firstMatch, secondMatch, smarts] = mcs;
+        if (smarts.empty()) {
+            return;
+        }
+        const auto [key, swapped] = build_key(first, second, strict, seed);
+
+        std::string payload;
+        if (swapped) {
+            append_match(payload, secondMatch, second.ranks);
+            append_match(payload, firstMatch, first.ranks);
+        } else {
+            append_match(payload, firstMatch, first.ranks);
+            append_match(payload, secondMatch, second.ranks);
+        }
+        payload += smarts;
+
+        m_directory.write(key, payload);
+    }
+}  // namespace coaler::io
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <GraphMol/ROMol.h>
+
+#include <optional>
+#include <string>
+
+#include "CacheDirectory.hpp"
+#include "CanonicalMolecule.hpp"
+#include "coaler/core/Matcher.hpp"
+
+/**
+ * @file PairwiseMCSCache.hpp
+ * @brief This file contains the PairwiseMCSCache class which persists pairwise MCS results between runs.
+ */
+namespace coaler::io {
+
+    /**
+     * The PairwiseMCSCache class stores the result of a pairwise MCS calculation (atom matches of both molecules
+     * and the MCS SMARTS) on disk.
+     *
+     * Entries are keyed by the canonical SMILES of both molecules, the strictness of the MCS parameters and the seed
+     * SMARTS. Atom indices are stored as canonical atom ranks and mapped back to the atom indices of the molecules on
+     * load, so an entry remains valid if the atom order or the order of the two molecules changes between runs.
+     */
+    class PairwiseMCSCache {
+      public:
+        /**
+         * @param directory Directory the cache entries are stored in.
+         * @param maxSizeBytes Size limit of the cache, least recently used entries are evicted beyond it.
+         */
+        PairwiseMCSCache(const std::string& directory, std::uintmax_t maxSizeBytes);
+
+        /**
+         * @return The canonical SMILES and atom ranks of @param mol. Not thread safe for molecules that are shared.
+         */
+        static CanonicalMolecule getCanonicalMolecule(const RDKit::ROMol& mol);
+
+        /**
+         * Look up the MCS of @param first and @param second.
+         * @param strict Whether the MCS was calculated with strict or relaxed parameters.
+         * @param seed The seed SMARTS of the MCS search.
+         * @return The MCS with matches in the order (first, second) or std::nullopt if there is no entry.
+         */
+        [[nodiscard]] std::optional<core::PairwiseMCS> load(const CanonicalMolecule& first,
+                                                            const CanonicalMolecule& second, bool strict,
+                                                            const std::string& seed) const;
+
+        /**
+         * Store the MCS @param mcs of @param first and @param second. Empty results are not stored, so they are
+         * recalculated in the next run.
+         * @param strict Whether the MCS was calculated with strict or relaxed parameters.
+         * @param seed The seed SMARTS of the MCS search.
+         */
+        void store(const CanonicalMolecule& first, const CanonicalMolecule& second, bool strict,
+                   const std::string& seed, const core::PairwiseMCS& mcs);
+
+      private:
+        CacheDirectory m_directory;
+    };
+}  // namespace coaler::io
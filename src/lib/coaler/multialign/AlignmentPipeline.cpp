@@ -0,0 +1,141 @@
+#include "AlignmentPipeline.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cassert>
+#include <optional>
+
+#include "Constants.hpp"
+#include "MultiAligner.hpp"
+#include "PoseRegisterBuilder.hpp"
+#include "coaler/embedder/ConformerEmbedder.hpp"
+
+namespace {
+    // embeddings unblock the scoring tasks, the pairwise MCS is not needed before the optimization
+    constexpr int EMBEDDING_PRIORITY = 2;
+    constexpr int SCORING_PRIORITY = 1;
+    constexpr int MCS_PRIORITY = 0;
+}  // namespace
+
+namespace coaler::multialign {
+    AlignmentPipeline::AlignmentPipeline(embedder::ConformerEmbedder &embedder, const core::ThreadBudget &threads)
+        : m_embedder(embedder), m_threads(threads) {}
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    void AlignmentPipeline::setPairwiseMCS(const core::PairwiseMCSProvider *pairwiseMCS) {
+        m_pairwiseMCS = pairwiseMCS;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    AlignmentPipelineResult AlignmentPipeline::run(const RDKit::MOL_SPTR_VECT &mols,
+                                                   const std::vector<unsigned> &numConformers) {
+        assert(mols.size() == numConformers.size());
+
+        const unsigned numLigands = mols.size();
+        std::vector<std::optional<Ligand>> ligands(numLigands);
+        std::vector<PairwiseAlignments> scores(numLigands * numLigands);
+        std::vector<std::optional<PoseRegister>> registers(numLigands * numLigands);
+
+        // the topology and the conformer cache are not thread safe, so the tasks are planned before the graph runs
+        const embedder::EmbeddingPlan plan = m_embedder.planEmbedding(mols, numConformers);
+        std::vector<embedder::EmbeddingBatch> batches(plan.tasks.size());
+
+        core::TaskGraph graph;
+        std::vector<std::vector<core::TaskGraph::TaskID>> embeddingTasks(numLigands);
+        for (unsigned i = 0; i < plan.tasks.size(); i++) {
+            const embedder::EmbeddingTask &task = plan.tasks.at(i);
+            embeddingTasks.at(task.molIndex)
+                .push_back(graph.addTask(
+                    [this, &plan, &batches, i]() {
+                        batches.at(i) = m_embedder.runEmbeddingTask(*plan.mols.at(plan.tasks.at(i).molIndex),
+                                                                    plan.tasks.at(i));
+                    },
+                    {}, EMBEDDING_PRIORITY, core::Stage::Embedding));
+        }
+
+        std::vector<core::TaskGraph::TaskID> mergeTasks;
+        for (LigandID id = 0; id < numLigands; id++) {
+            mergeTasks.push_back(graph.addTask(
+                [this, &plan, &batches, &ligands, id]() {
+                    m_embedder.mergeEmbedding(plan, id, batches);
+
+                    const RDKit::ROMOL_SPTR &mol = plan.mols.at(id);
+                    UniquePoseSet poses;
+                    for (PoseID poseId = 0; poseId < mol->getNumConformers(); poseId++) {
+                        poses.emplace(id, poseId);
+                    }
+                    ligands.at(id).emplace(*mol, poses, id);
+                },
+                embeddingTasks.at(id), EMBEDDING_PRIORITY, core::Stage::Embedding));
+        }
+
+        // the scoring blocks of a pair are added once both ligands are merged, only then their conformers are known
+        std::vector<std::vector<PairwiseAlignments>> blockScores(numLigands * numLigands);
+        for (LigandID first = 0; first < numLigands; first++) {
+            for (LigandID second = first + 1; second < numLigands; second++) {
+                const unsigned pairIndex = first * numLigands + second;
+                graph.addTask(
+                    [&graph, &ligands, &scores, &blockScores, &registers, first, second, pairIndex]() {
+                        const unsigned numPoses = ligands.at(first)->getNumPoses();
+                        const unsigned numBlocks
+                            = (numPoses + constants::SCORING_POSE_BLOCK_SIZE - 1) / constants::SCORING_POSE_BLOCK_SIZE;
+                        blockScores.at(pairIndex).resize(numBlocks);
+
+                        std::vector<core::TaskGraph::TaskID> scoringTasks;
+                        for (unsigned block = 0; block < numBlocks; block++) {
+                            const PoseID begin = block * constants::SCORING_POSE_BLOCK_SIZE;
+                            scoringTasks.push_back(graph.addTask(
+                                [&ligands, &blockScores, first, second, pairIndex, block, begin]() {
+                                    blockScores.at(pairIndex).at(block) = MultiAligner::calculateAlignmentScores(
+                                        *ligands.at(first), *ligands.at(second), begin,
+                                        begin + constants::SCORING_POSE_BLOCK_SIZE);
+                                },
+                                {}, SCORING_PRIORITY, core::Stage::Scoring));
+                        }
+
+                        // the register needs all scores of the pair
+                        graph.addTask(
+                            [&ligands, &scores, &blockScores, &registers, first, second, pairIndex]() {
+                                for (PairwiseAlignments &block : blockScores.at(pairIndex)) {
+                                    scores.at(pairIndex).insert(block.begin(), block.end());
+                                }
+                                blockScores.at(pairIndex).clear();
+                                registers.at(pairIndex) = PoseRegisterBuilder::buildPoseRegister(
+                                    scores.at(pairIndex), *ligands.at(first), *ligands.at(second));
+                            },
+                            scoringTasks, SCORING_PRIORITY, core::Stage::Scoring);
+                    },
+                    {mergeTasks.at(first), mergeTasks.at(second)}, SCORING_PRIORITY, core::Stage::Scoring);
+
+                if (m_pairwiseMCS != nullptr) {
+                    graph.addTask(
+                        [this, first, second]() {
+                            const LigandPair pair(first, second);
+                            m_pairwiseMCS->get(pair, true);
+                            m_pairwiseMCS->get(pair, false);
+                        },
+                        {}, MCS_PRIORITY, core::Stage::PairwiseMCS);
+                }
+            }
+        }
+
+        spdlog::info("running embedding, scoring and pairwise MCS tasks on {} threads.", m_threads.getTotal());
+        graph.run(m_threads);
+        spdlog::info("finished {} embedding, scoring and pairwise MCS tasks.", graph.getNumTasks());
+
+        AlignmentPipelineResult result;
+        for (auto &ligand : ligands) {
+            result.ligands.push_back(std::move(*ligand));
+        }
+        for (LigandID first = 0; first < numLigands; first++) {
+            for (LigandID second = first + 1; second < numLigands; second++) {
+                const unsigned pairIndex = first * numLigands + second;
+                result.scores.insert(scores.at(pairIndex).begin(), scores.at(pairIndex).end());
+                result.registers.addRegister(*registers.at(pairIndex));
+            }
+        }
+        return result;
+    }
+}  // namespace coaler::multialign
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "PoseRegisterCollection.hpp"
+#include "coaler/core/Forward.hpp"
+#include "coaler/core/ThreadBudget.hpp"
+#include "coaler/embedder/Forward.hpp"
+#include "models/Forward.hpp"
+
+/**
+ * @file AlignmentPipeline.hpp
+ * @brief This file contains the AlignmentPipeline class which overlaps embedding, pairwise MCS and scoring.
+ */
+namespace coaler::multialign {
+
+    /**
+     * @brief The ligands, pairwise alignment scores and pose registers the MultiAligner starts from.
+     */
+    struct AlignmentPipelineResult {
+        LigandVector ligands;
+        PairwiseAlignments scores;
+        PoseRegisterCollection registers;
+    };
+
+    /**
+     * @brief The AlignmentPipeline class runs the conformer embedding, the pairwise MCS and the pairwise scoring as
+     * one task graph instead of one stage after the other.
+     *
+     * The nodes of the graph are the embedding tasks of ConformerEmbedder::planEmbedding() (one per molecule, core
+     * match and batch), the merge of the conformers of every molecule, the scoring of blocks of pose pairs and the
+     * pose register of every ligand pair. The blocks of a ligand pair are added to the graph as soon as both of its
+     * ligands are merged, so they cover the conformers the ligands actually got and scoring starts while slow ligands
+     * are still being embedded. The pairwise MCS only needs the topology of the ligands and fills the remaining
+     * threads. Every node runs on the threads of its stage in the ThreadBudget.
+     */
+    class AlignmentPipeline {
+      public:
+        /**
+         * @param embedder The embedder the conformers are embedded with.
+         * @param threads The threads of the run, no more tasks of a stage run at once than the stage is granted.
+         */
+        AlignmentPipeline(embedder::ConformerEmbedder& embedder, const core::ThreadBudget& threads);
+
+        /**
+         * Calculate the MCS of all ligand pairs in the pipeline (eager mode), the MCS are requested lazily by the
+         * optimizer otherwise.
+         * @param pairwiseMCS The provider to calculate the MCS with, it has to outlive run().
+         */
+        void setPairwiseMCS(const core::PairwiseMCSProvider* pairwiseMCS);
+
+        /**
+         * Embed the molecules and calculate the scores and pose registers of all ligand pairs.
+         * @param mols The molecules to embed, conformers are added to them.
+         * @param numConformers The number of conformers passed to ConformerEmbedder::planEmbedding() for every
+         * molecule.
+         * @return The embedded ligands with their pairwise scores and pose registers.
+         */
+        AlignmentPipelineResult run(const RDKit::MOL_SPTR_VECT& mols, const std::vector<unsigned>& numConformers);
+
+      private:
+        embedder::ConformerEmbedder& m_embedder;
+        const core::PairwiseMCSProvider* m_pairwiseMCS{nullptr};
+        core::ThreadBudget m_threads;
+    };
+}  // namespace coaler::multialign
@@ -1,30 +1,30 @@
 #include "AssemblyOptimizer.hpp"
 
-#include <GraphMol/ForceFieldHelpers/UFF/UFF.h>
 #include <GraphMol/SmilesParse/SmilesWrite.h>
 #include <spdlog/spdlog.h>
 
+#include <boost/functional/hash.hpp>
+
 #include <coaler/io/OutputWriter.hpp>
 
 #include "coaler/embedder/ConformerEmbedder.hpp"
 #include "coaler/multialign/scorer/AssemblyScorer.hpp"
 
-const unsigned SEED = 42;
-const float FORCE_TOL = 0.0135;
 const float RELATIVE_SCORE_THRESHOLD = 0.2;
 const float ABSOLUTE_SCORE_THRESHOLD = 0.3;
 const unsigned BRUTEFORCE_CONFS = 100;
 
 namespace {
-    RDKit::DGeomHelpers::EmbedParameters get_embed_params_for_optimizer_generation() {
-        RDKit::DGeomHelpers::EmbedParameters params;
-        params = RDKit::DGeomHelpers::srETKDGv3;
-        params.optimizerForceTol = FORCE_TOL;
-        params.randomSeed = SEED;
-        params.useRandomCoords = true;
-        params.numThreads = 1;
-        params.clearConfs = false;
-        return params;
+    // identifies the starting assembly, independent of the iteration order of the mapping
+    std::uint64_t get_assembly_seed(const coaler::multialign::LigandAlignmentAssembly &assembly) {
+        std::uint64_t seed = 0;
+        for (const auto &[ligandId, poseId] : assembly.getAssemblyMapping()) {
+            std::size_t entry = 0;
+            boost::hash_combine(entry, ligandId);
+            boost::hash_combine(entry, poseId);
+            seed += entry;
+        }
+        return seed;
     }
 }  // namespace
 
@@ -85,11 +85,10 @@ LigandID get_next_missing_ligand(const LigandAlignmentAssembly &assembly, const
     return maxLigandID + 1;
 }
 
-AssemblyOptimizer::AssemblyOptimizer(coaler::core::PairwiseMCSMap &strictMCSMap,
-                                     coaler::core::PairwiseMCSMap &relaxedMCSMap, embedder::ConformerEmbedder &embedder,
-                                     double coarseScoreThreshold, double fineScoreThreshold, int stepLimit, int threads)
-    : m_strictMCSMap(strictMCSMap),
-      m_relaxedMCSMap(relaxedMCSMap),
+AssemblyOptimizer::AssemblyOptimizer(const coaler::core::PairwiseMCSProvider &pairwiseMCS,
+                                     embedder::ConformerEmbedder &embedder, double coarseScoreThreshold,
+                                     double fineScoreThreshold, int stepLimit, int threads)
+    : m_pairwiseMCS(pairwiseMCS),
       m_embedder(embedder),
       m_coarseScoreThreshold(coarseScoreThreshold),
       m_fineScoreThreshold(fineScoreThreshold),
@@ -185,6 +184,7 @@ OptimizerState AssemblyOptimizer::optimizeAssembly(LigandAlignmentAssembly assem
     unsigned genAttemptsSuccessful = 0;
 
     double assemblyScore = AssemblyScorer::calculateAssemblyScore(assembly, scores, ligands);
+    const std::uint64_t assemblySeed = get_assembly_seed(assembly);
 
     // assembly optimization step
     auto start = std::chrono::high_resolution_clock::now();
@@ -261,9 +261,24 @@ OptimizerState AssemblyOptimizer::optimizeAssembly(LigandAlignmentAssembly assem
             LigandVector const alignmentTargets = generate_alignment_targets(ligands, *worstLigand);
             assert(alignmentTargets.size() == ligands.size() - 1);
 
-            auto newConfIDs = coaler::embedder::ConformerEmbedder::generateNewPosesForAssemblyLigand(
-                *worstLigand, alignmentTargets, assembly.getAssemblyMapping(), m_strictMCSMap, m_relaxedMCSMap,
-                ligandIsMissing);
+            // rigid superpositions of existing conformers are cheap, so they are tried before new poses are embedded
+            auto newConfIDs = m_embedder.superposeExistingPoses(*worstLigand, alignmentTargets,
+                                                                assembly.getAssemblyMapping(), m_pairwiseMCS);
+            if (!newConfIDs.empty() && !ligandIsMissing
+                && find_optimal_pose(worstLigandId, newConfIDs, assembly, scores, ligands).second <= assemblyScore) {
+                for (const auto confId : newConfIDs) {
+                    worstLigand->removePose(confId);
+                }
+                newConfIDs.clear();
+            }
+
+            if (newConfIDs.empty()) {
+                std::size_t attemptSeed = assemblySeed;
+                boost::hash_combine(attemptSeed, genAttempts);
+                newConfIDs = m_embedder.generateNewPosesForAssemblyLigand(*worstLigand, alignmentTargets,
+                                                                          assembly.getAssemblyMapping(), m_pairwiseMCS,
+                                                                          ligandIsMissing, attemptSeed);
+            }
 
             if (newConfIDs.empty()) {
                 spdlog::debug("no confs generated. skipping ligand {}", RDKit::MolToSmiles(worstLigand->getMolecule()));
@@ -272,8 +287,10 @@ OptimizerState AssemblyOptimizer::optimizeAssembly(LigandAlignmentAssembly assem
                 continue;
             }
 
-            std::vector<std::pair<int, double>> result;
-            RDKit::UFF::UFFOptimizeMoleculeConfs((RDKit::ROMol &)*worstLigand->getMoleculePtr(), result, 1);
+            // only the new poses are minimized, the existing ones are already scored
+            embedder::ConformerEmbedder::minimizeConformers((RDKit::ROMol &)*worstLigand->getMoleculePtr(),
+                                                            std::vector<int>(newConfIDs.begin(), newConfIDs.end()),
+                                                            m_threads);
 
             auto [bestNewPoseID, bestNewAssemblyScore]
                 = find_optimal_pose(worstLigandId, newConfIDs, assembly, scores, ligands);
@@ -391,15 +408,16 @@ void AssemblyOptimizer::fixWorstLigands(LigandAlignmentAssembly assembly, Pairwi
 
             // generate new conformers for ligand with fixed core coords
             const std::vector<multialign::PoseID> newPoseIDs
-                = m_embedder.generateNewPosesForAssemblyLigand(ligand, BRUTEFORCE_CONFS);
+                = m_embedder.generateNewPosesForAssemblyLigand(ligand, BRUTEFORCE_CONFS, get_assembly_seed(assembly));
             if (newPoseIDs.empty()) {
                 spdlog::debug("bruteforce: no confs generated. skipping ligand {}",
                               RDKit::MolToSmiles(ligand.getMolecule()));
                 continue;
             }
 
-            std::vector<std::pair<int, double>> result;
-            RDKit::UFF::UFFOptimizeMoleculeConfs((RDKit::ROMol &)*ligand.getMoleculePtr(), result, 1);
+            embedder::ConformerEmbedder::minimizeConformers((RDKit::ROMol &)*ligand.getMoleculePtr(),
+                                                            std::vector<int>(newPoseIDs.begin(), newPoseIDs.end()),
+                                                            m_threads);
 
             auto [bestNewPoseID, bestNewAssemblyScore]
                 = find_optimal_pose(ligandID, newPoseIDs, assemblyCopy, scores, ligands);
@@ -27,9 +27,8 @@ namespace coaler::multialign {
          * @note You can re-call the optimization with a smaller threshold (for refinment) using the overloaded function
          */
         // NOLINTBEGIN(readability-inconsistent-declaration-parameter-name)
-        AssemblyOptimizer(core::PairwiseMCSMap& strictMCSMap, core::PairwiseMCSMap& relaxedMCSMap,
-                          embedder::ConformerEmbedder& embedder, double coarseScoreThreshold, double fineScoreTreshold,
-                          int stepLimit, int threads);
+        AssemblyOptimizer(const core::PairwiseMCSProvider& pairwiseMCS, embedder::ConformerEmbedder& embedder,
+                          double coarseScoreThreshold, double fineScoreTreshold, int stepLimit, int threads);
         // NOLINTEND(readability-inconsistent-declaration-parameter-name)
 
         /**
@@ -75,8 +74,7 @@ namespace coaler::multialign {
         double m_coarseScoreThreshold;
         double m_fineScoreThreshold;
 
-        core::PairwiseMCSMap& m_strictMCSMap;
-        core::PairwiseMCSMap& m_relaxedMCSMap;
+        const core::PairwiseMCSProvider& m_pairwiseMCS;
 
         embedder::ConformerEmbedder& m_embedder;
     };
@@ -5,6 +5,12 @@ namespace coaler::multialign::constants {
     const unsigned DEFAULT_NOF_THREADS = 1;
     const double POSE_REGISTER_SIZE_FACTOR = 0.5;
 
+    /**
+     * The number of poses of the first ligand of a pair whose pose pairs are scored in one block, see
+     * MultiAligner::calculateAlignmentScores().
+     */
+    const unsigned SCORING_POSE_BLOCK_SIZE = 8;
+
     /**
      * This treshold determines the score deficit above which new conformers are attempted to be generated
      * during assembly optimization.
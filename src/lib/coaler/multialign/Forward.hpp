@@ -1,5 +1,6 @@
 #pragma once
 
+#include "AlignmentPipeline.hpp"
 #include "AssemblyOptimizer.hpp"
 #include "Constants.hpp"
 #include "LigandAlignmentAssembly.hpp"
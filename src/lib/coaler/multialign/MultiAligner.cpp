@@ -3,7 +3,9 @@
 #include <omp.h>
 #include <spdlog/spdlog.h>
 
+#include <limits>
 #include <queue>
+#include <tuple>
 #include <utility>
 
 #include "AssemblyOptimizer.hpp"
@@ -55,6 +57,51 @@ namespace coaler::multialign {
 
     /*----------------------------------------------------------------------------------------------------------------*/
 
+    MultiAligner::MultiAligner(LigandVector ligands, PairwiseAlignments pairwiseAlignments,
+                               PoseRegisterCollection poseRegisters, AssemblyOptimizer optimizer,
+                               core::CoreResult core, unsigned maxStartingAssemblies, unsigned nofThreads)
+        : m_core(std::move(core)),
+          m_maxStartingAssemblies(maxStartingAssemblies),
+          m_threads(nofThreads),
+          m_assemblyOptimizer(std::move(optimizer)),
+          m_ligands(std::move(ligands)),
+          m_poseRegisters(std::move(poseRegisters)),
+          m_pairwiseAlignments(std::move(pairwiseAlignments)) {
+        assert(m_maxStartingAssemblies > 0);
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    PairwiseAlignments MultiAligner::calculateAlignmentScores(const Ligand &firstLigand, const Ligand &secondLigand) {
+        return MultiAligner::calculateAlignmentScores(firstLigand, secondLigand, 0,
+                                                      std::numeric_limits<PoseID>::max());
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    PairwiseAlignments MultiAligner::calculateAlignmentScores(const Ligand &firstLigand, const Ligand &secondLigand,
+                                                              PoseID firstPoseBegin, PoseID firstPoseEnd) {
+        assert(firstLigand.getID() < secondLigand.getID());
+
+        PairwiseAlignments scores;
+        const RDKit::ROMol firstMol = firstLigand.getMolecule();
+        const RDKit::ROMol secondMol = secondLigand.getMolecule();
+        for (const UniquePoseID &firstPose : firstLigand.getPoses()) {
+            if (firstPose.getLigandInternalPoseId() < firstPoseBegin
+                || firstPose.getLigandInternalPoseId() >= firstPoseEnd) {
+                continue;
+            }
+            for (const UniquePoseID &secondPose : secondLigand.getPoses()) {
+                const double score = AlignmentScorer::calcTanimotoShapeSimilarity(
+                    firstMol, secondMol, firstPose.getLigandInternalPoseId(), secondPose.getLigandInternalPoseId());
+                scores.emplace(PosePair(firstPose, secondPose), score);
+            }
+        }
+        return scores;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
     PairwiseAlignments MultiAligner::calculateAlignmentScores(const LigandVector &ligands) {
         PairwiseAlignments scores;
 
@@ -62,41 +109,34 @@ namespace coaler::multialign {
         // A.getNumPoses() * B.getNumPoses() many embeddings
         unsigned const n = ligands.size();
         unsigned combinations = 0;
+        // (first ligand, second ligand, first pose of the block)
+        std::vector<std::tuple<LigandID, LigandID, PoseID>> blocks;
         for (unsigned idA = 0; idA < n; idA++) {
             for (unsigned idB = idA + 1; idB < n; idB++) {
                 combinations += ligands.at(idA).getNumPoses() * ligands.at(idB).getNumPoses();
+                for (PoseID begin = 0; begin < ligands.at(idA).getNumPoses();
+                     begin += constants::SCORING_POSE_BLOCK_SIZE) {
+                    blocks.emplace_back(idA, idB, begin);
+                }
             }
         }
 
-        spdlog::info("calculating {} combinations. This may take some time", combinations);
-
-        for (LigandID firstMolId = 0; firstMolId < ligands.size(); firstMolId++) {
-            spdlog::info("calculated {} combinations so far.", scores.size());
-            for (LigandID secondMolId = firstMolId + 1; secondMolId < ligands.size(); secondMolId++) {
-                unsigned const nofPosesFirst = ligands.at(firstMolId).getNumPoses();
-                unsigned const nofPosesSecond = ligands.at(secondMolId).getNumPoses();
-
-                omp_lock_t maplock;
-                omp_init_lock(&maplock);
-
-#pragma omp parallel for shared(maplock, ligands, scores, nofPosesFirst, nofPosesSecond, firstMolId, \
-                                    secondMolId) default(none)
-                for (unsigned firstMolPoseId = 0; firstMolPoseId < nofPosesFirst; firstMolPoseId++) {
-                    for (unsigned secondMolPoseId = 0; secondMolPoseId < nofPosesSecond; secondMolPoseId++) {
-                        RDKit::RWMol const firstMol = ligands.at(firstMolId).getMolecule();
-                        RDKit::RWMol const secondMol = ligands.at(secondMolId).getMolecule();
-                        const double score = AlignmentScorer::calcTanimotoShapeSimilarity(
-                            firstMol, secondMol, firstMolPoseId, secondMolPoseId);
-
-                        UniquePoseID firstPose(firstMolId, firstMolPoseId);
-                        UniquePoseID secondPose(secondMolId, secondMolPoseId);
-                        omp_set_lock(&maplock);
-                        scores.emplace(PosePair(firstPose, secondPose), score);
-                        omp_unset_lock(&maplock);
-                    }
-                }
-            }
+        spdlog::info("calculating {} combinations in {} blocks. This may take some time", combinations, blocks.size());
+
+        omp_lock_t maplock;
+        omp_init_lock(&maplock);
+
+#pragma omp parallel for schedule(dynamic) shared(maplock, ligands, scores, blocks) default(none)
+        for (unsigned i = 0; i < blocks.size(); i++) {
+            const auto [firstMolId, secondMolId, begin] = blocks.at(i);
+            const PairwiseAlignments blockScores = MultiAligner::calculateAlignmentScores(
+                ligands.at(firstMolId), ligands.at(secondMolId), begin, begin + constants::SCORING_POSE_BLOCK_SIZE);
+
+            omp_set_lock(&maplock);
+            scores.insert(blockScores.begin(), blockScores.end());
+            omp_unset_lock(&maplock);
         }
+        omp_destroy_lock(&maplock);
         spdlog::info("finished calculating pairwise alignments");
 
         return scores;
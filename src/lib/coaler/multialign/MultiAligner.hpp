@@ -30,13 +30,52 @@ namespace coaler::multialign {
                               unsigned maxStartingAssemblies = constants::DEFAULT_NOF_STARTING_ASSEMBLIES,
                               unsigned nofThreads = constants::DEFAULT_NOF_THREADS);
 
+        /**
+         * @brief Construct a new MultiAligner object from precomputed pairwise alignments
+         *
+         * @param ligands The ligands to align
+         * @param pairwiseAlignments The scores of all pose pairs of the ligands
+         * @param poseRegisters The pose registers of all ligand pairs
+         * @param optimizer The assembly optimizer to use
+         * @param core The core result
+         * @param maxStartingAssemblies The maximum number of starting assemblies to generate
+         * @param nofThreads The number of threads to use
+         */
+        MultiAligner(LigandVector ligands, PairwiseAlignments pairwiseAlignments, PoseRegisterCollection poseRegisters,
+                     AssemblyOptimizer optimizer, core::CoreResult core,
+                     unsigned maxStartingAssemblies = constants::DEFAULT_NOF_STARTING_ASSEMBLIES,
+                     unsigned nofThreads = constants::DEFAULT_NOF_THREADS);
+
         MultiAlignerResult alignMolecules();
 
+        /**
+         * @brief Calculate the scores of all pose pairs of two ligands
+         *
+         * @param firstLigand The first ligand, its id has to be lower than the one of the second ligand
+         * @param secondLigand The second ligand
+         * @return The scores of the pose pairs
+         */
+        static PairwiseAlignments calculateAlignmentScores(const Ligand& firstLigand, const Ligand& secondLigand);
+
+        /**
+         * @brief Calculate the scores of the pose pairs of two ligands whose first pose has a ligand internal id in
+         * [firstPoseBegin, firstPoseEnd), so the pose pairs of a ligand pair can be scored in independent blocks
+         *
+         * @param firstLigand The first ligand, its id has to be lower than the one of the second ligand
+         * @param secondLigand The second ligand
+         * @param firstPoseBegin The first pose id of the block
+         * @param firstPoseEnd The pose id after the block
+         * @return The scores of the pose pairs of the block
+         */
+        static PairwiseAlignments calculateAlignmentScores(const Ligand& firstLigand, const Ligand& secondLigand,
+                                                           PoseID firstPoseBegin, PoseID firstPoseEnd);
+
       private:
         /**
-         * @brief Generate all possible starting assemblies
+         * @brief Calculate the scores of all pose pairs of all ligand pairs, in blocks of
+         * constants::SCORING_POSE_BLOCK_SIZE poses of the first ligand
          *
-         * @return The generated starting assemblies
+         * @return The scores of the pose pairs
          */
         static PairwiseAlignments calculateAlignmentScores(const LigandVector& ligands);
 
@@ -27,18 +27,9 @@ namespace coaler::multialign {
                     continue;
                 }
 
-                const unsigned size = calculateRegisterSizeForLigand(ligands.at(firstLigand), ligands.at(secondLigand));
                 const LigandPair currentLigandPair(firstLigand, secondLigand);
-
-                PoseRegister poseRegister(firstLigand, secondLigand, size);
-
-                for (const UniquePoseID firstLigandPose : ligands.at(firstLigand).getPoses()) {
-                    for (const UniquePoseID secondLigandPose : ligands.at(secondLigand).getPoses()) {
-                        const PosePair pair(firstLigandPose, secondLigandPose);
-                        const double score = alignmentScores.at(pair);
-                        poseRegister.addPoses(pair, score);
-                    }
-                }
+                const PoseRegister poseRegister
+                    = buildPoseRegister(alignmentScores, ligands.at(firstLigand), ligands.at(secondLigand));
 
                 omp_set_lock(&poseRegistersLock);
                 poseRegisters.emplace(currentLigandPair, poseRegister);
@@ -53,6 +44,25 @@ namespace coaler::multialign {
         return collection;
     }
 
+    /*----------------------------------------------------------------------------------------------------------------*/
+
+    PoseRegister PoseRegisterBuilder::buildPoseRegister(PairwiseAlignments &alignmentScores, const Ligand &firstLigand,
+                                                        const Ligand &secondLigand) {
+        const unsigned size = calculateRegisterSizeForLigand(firstLigand, secondLigand);
+        PoseRegister poseRegister(firstLigand.getID(), secondLigand.getID(), size);
+
+        for (const UniquePoseID firstLigandPose : firstLigand.getPoses()) {
+            for (const UniquePoseID secondLigandPose : secondLigand.getPoses()) {
+                const PosePair pair(firstLigandPose, secondLigandPose);
+                const double score = alignmentScores.at(pair);
+                poseRegister.addPoses(pair, score);
+            }
+        }
+        return poseRegister;
+    }
+
+    /*----------------------------------------------------------------------------------------------------------------*/
+
     unsigned PoseRegisterBuilder::calculateRegisterSizeForLigand(const Ligand &firstLigand,
                                                                  const Ligand &secondLigand) {
         // return 2* (firstLigand.getNumHeavyAtoms() + secondLigand.getNumHeavyAtoms());  // TODO find appropriate value
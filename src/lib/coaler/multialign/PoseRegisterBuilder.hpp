@@ -24,6 +24,17 @@ namespace coaler::multialign {
 
         // NOLINTEND(readability-convert-member-functions-to-static)
 
+        /**
+         * @brief Build the PoseRegister of a single ligand pair.
+         *
+         * @param alignmentScores The scores of all pose pairs of the two ligands.
+         * @param firstLigand The first ligand.
+         * @param secondLigand The second ligand.
+         * @return The PoseRegister for the ligand pair.
+         */
+        static PoseRegister buildPoseRegister(PairwiseAlignments& alignmentScores, const Ligand& firstLigand,
+                                              const Ligand& secondLigand);
+
       private:
         /**
          * @brief Calculate the size of the PoseRegister for a ligand.
@@ -1,5 +1,5 @@
 #include <GraphMol/SmilesParse/SmartsWrite.h>
-#include <omp.h>
+#include <GraphMol/SmilesParse/SmilesWrite.h>
 
 #include <boost/program_options.hpp>
 #include <sstream>
@@ -24,8 +24,33 @@ struct ProgrammOptions {
     double coarse_optimization_threshold{};
     double fine_optimization_threshold{};
     int optimizer_step_limit{};
+    std::string conformer_cache_path{};
+    unsigned conformer_cache_size{};
+    std::string mcs_cache_path{};
+    unsigned mcs_cache_size{};
+    std::string pairwise_mcs_mode{};
+    double mcs_prescreen_threshold{};
+    std::string pairwise_mcs_algorithm{};
+    unsigned embed_timeout{};
+    std::string pose_generator{};
+    unsigned torsion_expansion{};
+    bool collapse_matches{};
+    bool core_tethered{};
+    double energy_window{};
+    double rmsd_threshold{};
+    unsigned long conformer_budget{};
+    int core_threads{};
+    int embed_threads{};
+    int mcs_threads{};
+    int score_threads{};
+    int optimizer_threads{};
+    bool pipeline{};
 };
 
+const std::uintmax_t BYTES_PER_MEGABYTE = 1024 * 1024;
+// even rigid ligands get a second conformer when a conformer budget is used
+const unsigned MIN_BUDGET_CONFORMERS = 2;
+
 const std::string HELP
     = "Usage: aligner [options]\n"
       "Options:\n"
@@ -42,11 +67,50 @@ const std::string HELP
       "molecule.\n\t\t\t\t\t\t\t"
       "Helps against combinatorial explosion if core is small or has high symmetry (default: false)\n"
       "  --assemblies <amount>\t\t\t\t\tNumber of starting assemblies (default: 10)\n"
-      "  --core <algorithm>\t\t\t\t\tAlgorithm to detect core structure (default: mcs, allowed: mcs, murcko)\n"
+      "  --core <algorithm>\t\t\t\t\tAlgorithm to detect core structure (default: mcs, allowed: mcs, murcko, "
+      "hierarchical, portfolio)\n"
       "  --confs-log <path>\t\t\t\t\tOptional path to folder to store the generated conformers\n"
       "  --optimizer-coarse-threshold <float>\t\t\tTreshold for the optimization step (default: 0.4)\n"
       "  --optimizer-fine-threshold <float>\t\t\tTreshold for the fine optimization step (default: 0.05)\n"
-      "  --optimizer-step-limit <amount> \t\t\tMaximum number of steps for the optimizer (default: 100)\n";
+      "  --optimizer-step-limit <amount> \t\t\tMaximum number of steps for the optimizer (default: 100)\n"
+      "  --conformer-cache <path>\t\t\t\tOptional path to folder to cache embedded conformers between runs\n"
+      "  --conformer-cache-size <MB>\t\t\t\tSize limit of the conformer cache (default: 1024)\n"
+      "  --mcs-cache <path>\t\t\t\t\tOptional path to folder to cache pairwise MCS between runs\n"
+      "  --mcs-cache-size <MB>\t\t\t\t\tSize limit of the pairwise MCS cache (default: 256)\n"
+      "  --pairwise-mcs <mode>\t\t\t\t\tCalculate pairwise MCS when the optimizer needs them or all up front "
+      "(default: lazy, allowed: lazy, eager)\n"
+      "  --mcs-prescreen <float>\t\t\t\tResolve ligand pairs below this RASCAL similarity bound with the core "
+      "instead of a MCS search, only with fmcs (default: 0 = off)\n"
+      "  --pairwise-mcs-algo <algorithm>\t\t\tAlgorithm for pairwise MCS, core-growth only grows the side chains "
+      "from the core matches\n\t\t\t\t\t\t\tand uses neither the MCS cache nor the prescreen "
+      "(default: fmcs, allowed: fmcs, core-growth)\n"
+      "  --embed-timeout <ms>\t\t\t\t\tCancel constrained embeddings of new poses after this time and fall back "
+      "to a smaller coordinate map (default: 0 = off)\n"
+      "  --pose-generator <generator>\t\t\tGenerate new poses by transplanting the MCS coordinates onto an "
+      "existing conformer or by embedding (default: embed, allowed: embed, transplant)\n"
+      "  --torsion-expansion <n>\t\t\t\tAdd up to n conformers per molecule by driving the torsions of the "
+      "embedded conformers (default: 0 = off)\n"
+      "  --collapse-matches <bool>\t\t\t\tOnly embed conformers for one of the core matches that are related by "
+      "a symmetry of the molecule,\n\t\t\t\t\t\t\te.g. 6 instead of 12 benzene matches in toluene (default: false)\n"
+      "  --core-tethered <bool>\t\t\t\tEmbed the conformers with the core atoms fixed to the coordinates of the "
+      "core instead of aligning them afterwards (default: false)\n"
+      "  --energy-window <kcal/mol>\t\t\t\tRemove conformers above this UFF energy window after embedding, "
+      "e.g. 25 (default: 0 = off)\n"
+      "  --rmsd-threshold <angstrom>\t\t\t\tRemove conformers within this heavy atom RMSD of a lower energy one, "
+      "e.g. 0.3 (default: 0 = off)\n"
+      "  --conformer-budget <pairs>\t\t\t\tDistribute conformers by ligand flexibility so that the number of pose "
+      "pairs stays below this target,\n\t\t\t\t\t\t\t"
+      "--conformers is the maximum per ligand (and match without --divide) (default: 0 = off)\n"
+      "  --core-threads <amount>\t\t\t\tThreads of the core calculation (default: 0 = all threads of -j)\n"
+      "  --embed-threads <amount>\t\t\t\tThreads of the conformer embedding (default: 0 = all threads of -j)\n"
+      "  --mcs-threads <amount>\t\t\t\tThreads of the eager pairwise MCS calculation (default: 0 = all threads of "
+      "-j)\n"
+      "  --score-threads <amount>\t\t\t\tThreads of the pairwise scoring and pose registers (default: 0 = all "
+      "threads of -j)\n"
+      "  --optimizer-threads <amount>\t\t\t\tThreads of the assembly optimization (default: 0 = all threads of -j)\n"
+      "  --pipeline <bool>\t\t\t\t\tRun the embedding, the scoring and the eager pairwise MCS as one task graph "
+      "on the threads of the stages,\n\t\t\t\t\t\t\tscoring starts as soon as both ligands of a pair are embedded "
+      "(default: false)\n";
 
 // NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays)
 std::optional<ProgrammOptions> parse_args(int argc, char* argv[]) {
@@ -72,7 +136,28 @@ std::optional<ProgrammOptions> parse_args(int argc, char* argv[]) {
         "optimizer-fine-threshold", opts::value<double>(&parsedOptions.fine_optimization_threshold)
                                         ->default_value(multialign::constants::FINE_OPTIMIZATION_THRESHOLD))(
         "optimizer-step-limit", opts::value<int>(&parsedOptions.optimizer_step_limit)
-                                    ->default_value(multialign::constants::OPTIMIZER_STEP_LIMIT));
+                                    ->default_value(multialign::constants::OPTIMIZER_STEP_LIMIT))(
+        "conformer-cache", opts::value<std::string>(&parsedOptions.conformer_cache_path)->default_value("none"))(
+        "conformer-cache-size", opts::value<unsigned>(&parsedOptions.conformer_cache_size)->default_value(1024))(
+        "mcs-cache", opts::value<std::string>(&parsedOptions.mcs_cache_path)->default_value("none"))(
+        "mcs-cache-size", opts::value<unsigned>(&parsedOptions.mcs_cache_size)->default_value(256))(
+        "pairwise-mcs", opts::value<std::string>(&parsedOptions.pairwise_mcs_mode)->default_value("lazy"))(
+        "mcs-prescreen", opts::value<double>(&parsedOptions.mcs_prescreen_threshold)->default_value(0))(
+        "pairwise-mcs-algo", opts::value<std::string>(&parsedOptions.pairwise_mcs_algorithm)->default_value("fmcs"))(
+        "embed-timeout", opts::value<unsigned>(&parsedOptions.embed_timeout)->default_value(0))(
+        "pose-generator", opts::value<std::string>(&parsedOptions.pose_generator)->default_value("embed"))(
+        "torsion-expansion", opts::value<unsigned>(&parsedOptions.torsion_expansion)->default_value(0))(
+        "collapse-matches", opts::value<bool>(&parsedOptions.collapse_matches)->default_value(false))(
+        "core-tethered", opts::value<bool>(&parsedOptions.core_tethered)->default_value(false))(
+        "energy-window", opts::value<double>(&parsedOptions.energy_window)->default_value(0))(
+        "rmsd-threshold", opts::value<double>(&parsedOptions.rmsd_threshold)->default_value(0))(
+        "conformer-budget", opts::value<unsigned long>(&parsedOptions.conformer_budget)->default_value(0))(
+        "core-threads", opts::value<int>(&parsedOptions.core_threads)->default_value(0))(
+        "embed-threads", opts::value<int>(&parsedOptions.embed_threads)->default_value(0))(
+        "mcs-threads", opts::value<int>(&parsedOptions.mcs_threads)->default_value(0))(
+        "score-threads", opts::value<int>(&parsedOptions.score_threads)->default_value(0))(
+        "optimizer-threads", opts::value<int>(&parsedOptions.optimizer_threads)->default_value(0))(
+        "pipeline", opts::value<bool>(&parsedOptions.pipeline)->default_value(false));
 
     opts::variables_map vm;
     opts::store(opts::parse_command_line(argc, argv, desc), vm);
@@ -106,7 +191,13 @@ int main(int argc, char* argv[]) {
         spdlog::set_level(spdlog::level::debug);
     }
 
-    omp_set_num_threads(opts.num_threads);
+    // nested calls take their share of the stage threads, so -j is never oversubscribed
+    core::ThreadBudget threads(opts.num_threads);
+    threads.setThreads(core::Stage::Core, opts.core_threads);
+    threads.setThreads(core::Stage::Embedding, opts.embed_threads);
+    threads.setThreads(core::Stage::PairwiseMCS, opts.mcs_threads);
+    threads.setThreads(core::Stage::Scoring, opts.score_threads);
+    threads.setThreads(core::Stage::Optimization, opts.optimizer_threads);
 
     std::ofstream output_file(opts.out_file);
     if (!output_file.is_open()) {
@@ -123,16 +214,23 @@ int main(int argc, char* argv[]) {
     };
 
     std::optional<coaler::core::CoreResult> coreResult;
-    core::Matcher matcher(opts.num_threads);
+    threads.enterStage(core::Stage::Core);
+    core::Matcher matcher(threads.getThreads(core::Stage::Core));
     spdlog::info("starting core calculation");
     // NOLINTBEGIN(bugprone-branch-clone)
     if (opts.core_type == "mcs") {
         coreResult = matcher.calculateCoreMcs(mols);
     } else if (opts.core_type == "murcko") {
         coreResult = matcher.calculateCoreMurcko(mols);
+    } else if (opts.core_type == "hierarchical") {
+        coreResult = matcher.calculateCoreHierarchical(mols);
+    } else if (opts.core_type == "portfolio") {
+        coreResult = matcher.calculateCorePortfolio(mols);
     } else {
-        spdlog::error("unknown coreResult calculation algorithm '{}' (allowed values are 'mcs' and 'murcko')",
-                      opts.core_type);
+        spdlog::error(
+            "unknown coreResult calculation algorithm '{}' (allowed values are 'mcs', 'murcko', 'hierarchical' and "
+            "'portfolio')",
+            opts.core_type);
         return 1;
     }
     // NOLINTEND(bugprone-branch-clone)
@@ -152,23 +250,116 @@ int main(int argc, char* argv[]) {
     } else {
         spdlog::info("embedding {} conformers for all molecules", opts.num_conformers);
     }
-    embedder::ConformerEmbedder embedder(core, opts.num_threads, opts.divide_conformers_by_matches);
+    threads.enterStage(core::Stage::Embedding);
+    embedder::ConformerEmbedder embedder(core, threads.getThreads(core::Stage::Embedding),
+                                         opts.divide_conformers_by_matches);
+    embedder.setEmbedTimeout(std::chrono::milliseconds(opts.embed_timeout));
+    embedder.setTorsionExpansion(opts.torsion_expansion);
+    embedder.setCollapseMatches(opts.collapse_matches);
+    embedder.setCoreTethered(opts.core_tethered);
+    embedder.setConformerFilter(opts.energy_window, opts.rmsd_threshold);
+    if (opts.pose_generator == "transplant") {
+        embedder.setPoseTransplant(true);
+    } else if (opts.pose_generator != "embed") {
+        spdlog::error("unknown pose generator {}", opts.pose_generator);
+        return 1;
+    }
+    if (opts.conformer_cache_path != "none") {
+        spdlog::info("using conformer cache at {}", opts.conformer_cache_path);
+        embedder.setConformerCache(std::make_shared<io::ConformerCache>(
+            opts.conformer_cache_path, opts.conformer_cache_size * BYTES_PER_MEGABYTE));
+    }
 
-#pragma omp parallel for shared(mols, embedder, opts) default(none)
-    for (unsigned i = 0; i < mols.size(); i++) {
-        embedder.embedConformers(mols.at(i), opts.num_conformers);
+    // number of conformers passed to embedConformers() for every molecule
+    std::vector<unsigned> numConformers(mols.size(), opts.num_conformers);
+    if (opts.conformer_budget > 0) {
+        std::vector<unsigned> numMatches;
+        std::vector<double> flexibilities;
+        unsigned maxMatches = 1;
+        for (const auto& mol : mols) {
+            numMatches.push_back(std::max<unsigned>(embedder.getCoreMatches(*mol)->size(), 1));
+            flexibilities.push_back(embedder::ConformerBudget::getFlexibility(*mol, numMatches.back()));
+            maxMatches = std::max(maxMatches, numMatches.back());
+        }
+
+        // the budget counts all conformers of a molecule, which are per match without --divide
+        const unsigned maxConformers = opts.divide_conformers_by_matches ? opts.num_conformers
+                                                                         : opts.num_conformers * maxMatches;
+        const embedder::ConformerBudget budget(opts.conformer_budget,
+                                               std::min(MIN_BUDGET_CONFORMERS, maxConformers), maxConformers);
+        std::vector<unsigned> totals = budget.distribute(flexibilities);
+        if (!opts.divide_conformers_by_matches) {
+            // --conformers stays the limit per match, ligands with fewer matches than maxMatches hit it earlier
+            for (unsigned i = 0; i < mols.size(); i++) {
+                totals.at(i) = std::min(totals.at(i), opts.num_conformers * numMatches.at(i));
+            }
+        }
+        spdlog::info("conformer budget of {} pose pairs, distributed {} pose pairs", opts.conformer_budget,
+                     embedder::ConformerBudget::countPosePairs(totals));
+        for (unsigned i = 0; i < mols.size(); i++) {
+            numConformers.at(i) = opts.divide_conformers_by_matches
+                                      ? totals.at(i)
+                                      : (totals.at(i) + numMatches.at(i) - 1) / numMatches.at(i);
+            spdlog::debug("{} conformers for {} (flexibility {})", totals.at(i), RDKit::MolToSmiles(*mols.at(i)),
+                          flexibilities.at(i));
+        }
     }
 
-    auto ligands = multialign::LigandVector(mols);
+    std::unique_ptr<io::PairwiseMCSCache> mcsCache;
+    if (opts.mcs_cache_path != "none") {
+        spdlog::info("using pairwise MCS cache at {}", opts.mcs_cache_path);
+        mcsCache
+            = std::make_unique<io::PairwiseMCSCache>(opts.mcs_cache_path, opts.mcs_cache_size * BYTES_PER_MEGABYTE);
+    }
 
-    spdlog::info("start calculating pairwise MCS.");
-    auto strictMcsMap = coaler::core::Matcher::calcPairwiseMCS(ligands, true, coreSmarts);
-    auto relaxedMcsMap = coaler::core::Matcher::calcPairwiseMCS(ligands, false, coreSmarts);
-    spdlog::info("finished calculating pairwise MCS.");
+    // the pairwise MCS only depends on the topology, so it can be calculated while the conformers are embedded
+    core::PairwiseMCSProvider pairwiseMcs(multialign::LigandVector(mols), coreSmarts, mcsCache.get());
+    if (opts.mcs_prescreen_threshold > 0) {
+        spdlog::info("using RASCAL similarity prescreen with threshold {}", opts.mcs_prescreen_threshold);
+        pairwiseMcs.setPrescreenThreshold(opts.mcs_prescreen_threshold);
+    }
+    if (opts.pairwise_mcs_algorithm == "core-growth") {
+        // the growth starts from the core matches the embedder uses, they are calculated once per ligand
+        std::vector<std::vector<RDKit::MatchVectType>> coreMatches;
+        for (const auto &mol : mols) {
+            std::vector<RDKit::MatchVectType> matches;
+            for (const auto &coreMatch : *embedder.getCoreMatches(*mol)) {
+                matches.push_back(coreMatch.match);
+            }
+            coreMatches.push_back(std::move(matches));
+        }
+        pairwiseMcs.setAlgorithm(core::PairwiseMCSAlgorithm::CoreGrowth, std::move(coreMatches));
+    } else if (opts.pairwise_mcs_algorithm != "fmcs") {
+        spdlog::error("unknown pairwise mcs algorithm {}", opts.pairwise_mcs_algorithm);
+        return 1;
+    }
+    if (opts.pairwise_mcs_mode != "eager" && opts.pairwise_mcs_mode != "lazy") {
+        spdlog::error("unknown pairwise mcs mode {}", opts.pairwise_mcs_mode);
+        return 1;
+    }
 
-    const multialign::AssemblyOptimizer optimizer(strictMcsMap, relaxedMcsMap, embedder,
-                                                  opts.coarse_optimization_threshold, opts.fine_optimization_threshold,
-                                                  opts.optimizer_step_limit, opts.num_threads);
+    std::optional<multialign::AlignmentPipelineResult> pipelineResult;
+    if (opts.pipeline) {
+        multialign::AlignmentPipeline pipeline(embedder, threads);
+        if (opts.pairwise_mcs_mode == "eager") {
+            pipeline.setPairwiseMCS(&pairwiseMcs);
+        }
+        pipelineResult = pipeline.run(mols, numConformers);
+    } else {
+        embedder.embedConformers(mols, numConformers);
+
+        if (opts.pairwise_mcs_mode == "eager") {
+            threads.enterStage(core::Stage::PairwiseMCS);
+            spdlog::info("start calculating pairwise MCS.");
+            pairwiseMcs.computeAll();
+            spdlog::info("finished calculating pairwise MCS.");
+        }
+    }
+    embedder.logFilterStatistics();
+
+    const multialign::AssemblyOptimizer optimizer(pairwiseMcs, embedder, opts.coarse_optimization_threshold,
+                                                  opts.fine_optimization_threshold, opts.optimizer_step_limit,
+                                                  threads.getThreads(core::Stage::Optimization));
 
     spdlog::info("finished embedding");
 
@@ -176,9 +367,20 @@ int main(int argc, char* argv[]) {
         coaler::io::OutputWriter::writeConformersToSDF(opts.conformer_log_path, mols);
     }
 
-    multialign::MultiAligner aligner(mols, optimizer, core, opts.num_start_assemblies, opts.num_threads);
+    std::optional<multialign::MultiAligner> aligner;
+    if (pipelineResult.has_value()) {
+        aligner.emplace(std::move(pipelineResult->ligands), std::move(pipelineResult->scores),
+                        std::move(pipelineResult->registers), optimizer, core, opts.num_start_assemblies,
+                        threads.getThreads(core::Stage::Scoring));
+    } else {
+        threads.enterStage(core::Stage::Scoring);
+        aligner.emplace(mols, optimizer, core, opts.num_start_assemblies, threads.getThreads(core::Stage::Scoring));
+    }
 
-    const multialign::MultiAlignerResult result = aligner.alignMolecules();
+    threads.enterStage(core::Stage::Optimization);
+    const multialign::MultiAlignerResult result = aligner->alignMolecules();
+    pairwiseMcs.logStatistics();
+    embedder.logStatistics();
     io::OutputWriter::writeSDF(opts.out_file, result);
 
     spdlog::info("done: exiting");
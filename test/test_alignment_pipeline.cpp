@@ -0,0 +1,78 @@
+#include <GraphMol/GraphMol.h>
+
+#include "catch2/catch.hpp"
+#include "coaler/core/Forward.hpp"
+#include "coaler/embedder/ConformerEmbedder.hpp"
+#include "coaler/multialign/AlignmentPipeline.hpp"
+#include "coaler/multialign/MultiAligner.hpp"
+#include "coaler/multialign/PoseRegisterBuilder.hpp"
+#include "test_helper.h"
+
+using namespace coaler;
+
+namespace {
+    const std::vector<std::string> SMILES = {"c1ccccc1CCCO", "c1ccccc1CCCN", "c1ccccc1OCC(C)N"};
+
+    RDKit::MOL_SPTR_VECT create_molecules() {
+        RDKit::MOL_SPTR_VECT mols;
+        for (const auto &smiles : SMILES) {
+            mols.push_back(ROMolFromSmiles(smiles));
+        }
+        return mols;
+    }
+}  // namespace
+
+TEST_CASE("test_alignment_pipeline_matches_sequential", "[alignment_pipeline]") {
+    RDKit::MOL_SPTR_VECT sequentialMols = create_molecules();
+    core::Matcher matcher(1);
+    const core::CoreResult coreResult = matcher.calculateCoreMcs(sequentialMols).value();
+    // more conformers than fit into one scoring block
+    const std::vector<unsigned> numConformers(SMILES.size(), multialign::constants::SCORING_POSE_BLOCK_SIZE + 3);
+
+    embedder::ConformerEmbedder sequentialEmbedder(coreResult, 1, true);
+    sequentialEmbedder.embedConformers(sequentialMols, numConformers);
+    const multialign::LigandVector sequentialLigands(sequentialMols);
+    multialign::PairwiseAlignments sequentialScores;
+    for (multialign::LigandID first = 0; first < sequentialLigands.size(); first++) {
+        for (multialign::LigandID second = first + 1; second < sequentialLigands.size(); second++) {
+            const multialign::PairwiseAlignments scores = multialign::MultiAligner::calculateAlignmentScores(
+                sequentialLigands.at(first), sequentialLigands.at(second));
+            sequentialScores.insert(scores.begin(), scores.end());
+        }
+    }
+    const multialign::PoseRegisterCollection sequentialRegisters
+        = multialign::PoseRegisterBuilder::buildPoseRegisters(sequentialScores, sequentialLigands, 1);
+
+    // the scoring runs on fewer threads than the embedding
+    core::ThreadBudget threads(4);
+    threads.setThreads(core::Stage::Scoring, 2);
+    const RDKit::MOL_SPTR_VECT pipelineMols = create_molecules();
+    embedder::ConformerEmbedder pipelineEmbedder(coreResult, 4, true);
+    multialign::AlignmentPipeline pipeline(pipelineEmbedder, threads);
+    const multialign::AlignmentPipelineResult result = pipeline.run(pipelineMols, numConformers);
+
+    REQUIRE(result.ligands.size() == sequentialLigands.size());
+    for (unsigned id = 0; id < sequentialLigands.size(); id++) {
+        CHECK(result.ligands.at(id).getNumPoses() == sequentialLigands.at(id).getNumPoses());
+    }
+
+    REQUIRE(result.scores.size() == sequentialScores.size());
+    for (const auto &[posePair, score] : sequentialScores) {
+        REQUIRE(result.scores.count(posePair) == 1);
+        CHECK(result.scores.at(posePair) == Approx(score));
+    }
+
+    const multialign::PairwisePoseRegisters registers = result.registers.getAllRegisters();
+    REQUIRE(registers.size() == sequentialRegisters.getAllRegisters().size());
+    for (const auto &[ligandPair, sequentialRegister] : sequentialRegisters.getAllRegisters()) {
+        const multialign::PoseRegister &pipelineRegister = registers.at(ligandPair);
+        CHECK(pipelineRegister.getSize() == sequentialRegister.getSize());
+        CHECK(pipelineRegister.getHighestScoringPair() == sequentialRegister.getHighestScoringPair());
+        CHECK(pipelineRegister.getHighestScore() == Approx(sequentialRegister.getHighestScore()));
+        for (const auto &ligand : sequentialLigands) {
+            for (const auto &pose : ligand.getPoses()) {
+                CHECK(pipelineRegister.containsPose(pose) == sequentialRegister.containsPose(pose));
+            }
+        }
+    }
+}
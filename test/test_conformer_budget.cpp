@@ -0,0 +1,49 @@
+#include <catch2/catch.hpp>
+
+#include "coaler/embedder/ConformerBudget.hpp"
+#include "test_helper.h"
+
+using namespace coaler::embedder;
+
+TEST_CASE("test_conformer_budget", "[conformer_budget]") {
+    SECTION("flexibility") {
+        auto rigid = ROMolFromSmiles("c1ccccc1");
+        auto flexible = ROMolFromSmiles("c1ccccc1CCCCCC");
+        auto ring = ROMolFromSmiles("C1CCCCC1");
+
+        CHECK(ConformerBudget::getFlexibility(*rigid, 1) == 1.0);
+        CHECK(ConformerBudget::getFlexibility(*flexible, 1) > ConformerBudget::getFlexibility(*rigid, 1));
+        CHECK(ConformerBudget::getFlexibility(*ring, 1) > ConformerBudget::getFlexibility(*rigid, 1));
+        CHECK(ConformerBudget::getFlexibility(*rigid, 2) == 2 * ConformerBudget::getFlexibility(*rigid, 1));
+    }
+
+    SECTION("pose pairs") {
+        CHECK(ConformerBudget::countPosePairs({}) == 0);
+        CHECK(ConformerBudget::countPosePairs({3}) == 0);
+        CHECK(ConformerBudget::countPosePairs({2, 3, 4}) == 2 * 3 + 2 * 4 + 3 * 4);
+    }
+
+    SECTION("distribution") {
+        const ConformerBudget budget(1000, 2, 50);
+        const auto numConformers = budget.distribute({1.0, 4.0, 8.0});
+
+        REQUIRE(numConformers.size() == 3);
+        CHECK(ConformerBudget::countPosePairs(numConformers) <= 1000);
+        CHECK(numConformers.at(0) <= numConformers.at(1));
+        CHECK(numConformers.at(1) <= numConformers.at(2));
+        CHECK(numConformers.at(0) >= 2);
+        CHECK(numConformers.at(2) <= 50);
+    }
+
+    SECTION("minimum exceeds the target") {
+        const ConformerBudget budget(1, 2, 10);
+        const auto numConformers = budget.distribute({1.0, 1.0, 1.0});
+        CHECK(numConformers == std::vector<unsigned>{2, 2, 2});
+    }
+
+    SECTION("maximum within the target") {
+        const ConformerBudget budget(1000000, 2, 10);
+        const auto numConformers = budget.distribute({1.0, 3.0});
+        CHECK(numConformers == std::vector<unsigned>{10, 10});
+    }
+}
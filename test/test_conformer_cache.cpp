@@ -0,0 +1,66 @@
+#include <GraphMol/DistGeomHelpers/Embedder.h>
+#include <GraphMol/MolOps.h>
+
+#include <catch2/catch.hpp>
+#include <numeric>
+
+#include "coaler/io/ConformerCache.hpp"
+#include "test_helper.h"
+
+using namespace coaler::io;
+
+TEST_CASE("conformer_cache_roundtrip", "[io]") {
+    const TemporaryDirectory cacheDir("coaler_test_conformer_cache");
+    ConformerCache cache(cacheDir.getPath(), 1024 * 1024);
+
+    auto mol = MolFromSmiles("c1ccccc1CCO");
+    RDKit::MolOps::addHs(*mol);
+    RDKit::DGeomHelpers::EmbedParameters params;
+    params.randomSeed = 42;
+    RDKit::DGeomHelpers::EmbedMultipleConfs(*mol, 3, params);
+
+    cache.store(*mol, "c1ccccc1", "params");
+
+    SECTION("cache hit") {
+        RDKit::RWMol copy(*mol);
+        copy.clearConformers();
+        REQUIRE(cache.load(copy, "c1ccccc1", "params"));
+        REQUIRE(copy.getNumConformers() == 3);
+        for (unsigned confId = 0; confId < 3; confId++) {
+            for (unsigned atomId = 0; atomId < mol->getNumAtoms(); atomId++) {
+                const auto expected = mol->getConformer(static_cast<int>(confId)).getAtomPos(atomId);
+                const auto actual = copy.getConformer(static_cast<int>(confId)).getAtomPos(atomId);
+                CHECK((expected - actual).length() < 1e-3);
+            }
+        }
+    }
+
+    SECTION("different parameters miss") {
+        RDKit::RWMol copy(*mol);
+        copy.clearConformers();
+        CHECK(!cache.load(copy, "c1ccccc1", "other params"));
+        CHECK(!cache.load(copy, "C1CCCCC1", "params"));
+        CHECK(copy.getNumConformers() == 0);
+    }
+
+    SECTION("hit with different atom order") {
+        std::vector<unsigned> newOrder(mol->getNumAtoms());
+        std::iota(newOrder.rbegin(), newOrder.rend(), 0);
+        std::unique_ptr<RDKit::ROMol> renumbered(RDKit::MolOps::renumberAtoms(*mol, newOrder));
+        renumbered->clearConformers();
+
+        REQUIRE(cache.load(*renumbered, "c1ccccc1", "params"));
+        REQUIRE(renumbered->getNumConformers() == 3);
+
+        // the heavy atoms of the side chain have no symmetric counterpart, so they have to end up at the same position
+        for (unsigned newId = 0; newId < renumbered->getNumAtoms(); newId++) {
+            const auto* originalAtom = mol->getAtomWithIdx(newOrder.at(newId));
+            if (originalAtom->getAtomicNum() == 1 || originalAtom->getIsAromatic()) {
+                continue;
+            }
+            const auto expected = mol->getConformer(0).getAtomPos(newOrder.at(newId));
+            const auto actual = renumbered->getConformer(0).getAtomPos(newId);
+            CHECK((expected - actual).length() < 1e-3);
+        }
+    }
+}
@@ -1,17 +1,66 @@
 
+#include <GraphMol/MolAlign/AlignMolecules.h>
 #include <GraphMol/SmilesParse/SmartsWrite.h>
 #include <GraphMol/Substruct/SubstructMatch.h>
 
+#include <algorithm>
+
 #include "GraphMol/SmilesParse/SmilesWrite.h"
 #include "catch2/catch.hpp"
 #include "coaler/core/Forward.hpp"
 #include "coaler/embedder/ConformerEmbedder.hpp"
+#include "coaler/io/ConformerCache.hpp"
 #include "coaler/embedder/SubstructureAnalyzer.hpp"
+#include "coaler/multialign/models/Forward.hpp"
 #include "test_helper.h"
 
 using namespace coaler::embedder;
 namespace core = coaler::core;
 
+namespace {
+    const std::string FIRST_SMILES = "c1ccccc1CCCO";
+    const std::string SECOND_SMILES = "c1ccccc1CCCN";
+
+    core::CoreResult calculate_core(const std::string& firstSmiles = FIRST_SMILES,
+                                    const std::string& secondSmiles = SECOND_SMILES) {
+        core::Matcher matcher(1);
+        RDKit::MOL_SPTR_VECT mols = {ROMolFromSmiles(firstSmiles), ROMolFromSmiles(secondSmiles)};
+        return matcher.calculateCoreMcs(mols).value();
+    }
+
+    coaler::multialign::LigandVector embed_ligands(ConformerEmbedder& embedder, const std::string& firstSmiles,
+                                                   const std::string& secondSmiles) {
+        auto mol1 = ROMolFromSmiles(firstSmiles);
+        auto mol2 = ROMolFromSmiles(secondSmiles);
+        embedder.embedConformers(mol1, 5);
+        embedder.embedConformers(mol2, 5);
+
+        coaler::multialign::LigandVector ligands;
+        ligands.push_back(coaler::multialign::Ligand(*mol1, {}, 0));
+        ligands.push_back(coaler::multialign::Ligand(*mol2, {}, 1));
+        return ligands;
+    }
+
+    /**
+     * Two ligands with 5 conformers each, their core, the embedder and their pairwise MCS. The second ligand is the
+     * pose generation target of the first one.
+     */
+    struct EmbeddedLigandPair {
+        explicit EmbeddedLigandPair(const std::string& firstSmiles = FIRST_SMILES,
+                                    const std::string& secondSmiles = SECOND_SMILES)
+            : core(calculate_core(firstSmiles, secondSmiles)),
+              ligands(embed_ligands(embedder, firstSmiles, secondSmiles)),
+              pairwiseMcs(ligands, RDKit::MolToSmarts(*core.core)),
+              targets{ligands.at(1)} {}
+
+        core::CoreResult core;
+        ConformerEmbedder embedder{core, 1, true};
+        coaler::multialign::LigandVector ligands;
+        core::PairwiseMCSProvider pairwiseMcs;
+        coaler::multialign::LigandVector targets;
+    };
+}  // namespace
+
 TEST_CASE("test_mcs", "[conformer_generator_tester]") {
     SECTION("test with one match") {
         auto mol1 = ROMolFromSmiles("c1ccncc1CCCO");
@@ -92,3 +141,264 @@ TEST_CASE("test_mcs_match_mapping", "[conformer_generator_tester]") {
     CHECK(ligandCoords.at(3).x == 3);
     CHECK(ligandCoords.at(4).x == 4);
 }
+
+TEST_CASE("test_known_embedding_failures", "[conformer_generator_tester]") {
+    EmbeddedLigandPair pair;
+
+    // all atoms of the first target conformer are at the same position, so no embedding onto it is possible
+    auto* target = const_cast<RDKit::RWMol*>(pair.ligands.at(1).getMoleculePtr());
+    for (unsigned atomId = 0; atomId < target->getNumAtoms(); atomId++) {
+        target->getConformer(0).setAtomPos(atomId, RDGeom::Point3D(0, 0, 0));
+    }
+    pair.targets = {pair.ligands.at(1)};
+
+    CHECK(pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}}, pair.pairwiseMcs)
+              .empty());
+    auto statistics = pair.embedder.getPoseGenerationStatistics();
+    CHECK(statistics.numFailedEmbeddings == 1);
+    CHECK(statistics.numSkippedKnownFailures == 0);
+
+    // the failed target conformer is not embedded onto again
+    CHECK(pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}}, pair.pairwiseMcs)
+              .empty());
+    statistics = pair.embedder.getPoseGenerationStatistics();
+    CHECK(statistics.numAttempts == 2);
+    CHECK(statistics.numTargets == 2);
+    CHECK(statistics.numFailedEmbeddings == 1);
+    CHECK(statistics.numSkippedKnownFailures == 1);
+    CHECK(statistics.numSkippedInfeasible == 0);
+
+    // other target conformers are still embedded onto
+    CHECK(pair.embedder
+              .generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 1}}, pair.pairwiseMcs)
+              .size()
+          == 1);
+    CHECK(pair.embedder.getPoseGenerationStatistics().numSkippedKnownFailures == 1);
+}
+
+TEST_CASE("test_pose_generation_timeout", "[conformer_generator_tester]") {
+    SECTION("embeddings within the timeout") {
+        EmbeddedLigandPair pair;
+        pair.embedder.setEmbedTimeout(std::chrono::milliseconds(60000));
+
+        auto newPoses = pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}},
+                                                                        pair.pairwiseMcs);
+
+        CHECK(newPoses.size() == 1);
+        const auto statistics = pair.embedder.getTimeoutStatistics();
+        CHECK(statistics.count(0) == 1);
+        CHECK(statistics.at(0).numEmbeddings == 1);
+        CHECK(statistics.at(0).numTimeouts == 0);
+        CHECK(statistics.count(1) == 0);
+    }
+
+    SECTION("timed out embeddings fall back") {
+        // long chains take far longer than the timeout to embed
+        EmbeddedLigandPair pair("c1ccccc1CCCCCCCCCCCCCCCCCCCCCCCCCCCCCCO", "c1ccccc1CCCCCCCCCCCCCCCCCCCCCCCCCCCCCCN");
+        pair.embedder.setEmbedTimeout(std::chrono::milliseconds(1));
+
+        const unsigned numConformers = pair.ligands.at(0).getMoleculePtr()->getNumConformers();
+        auto newPoses = pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}},
+                                                                        pair.pairwiseMcs);
+
+        // how many embeddings time out depends on the machine, but a timed out relaxed embedding is always followed
+        // by the strict one and no timed out embedding is recorded as a failure
+        const auto statistics = pair.embedder.getTimeoutStatistics();
+        REQUIRE(statistics.count(0) == 1);
+        if (statistics.at(0).numTimeouts > 0) {
+            CHECK(statistics.at(0).numEmbeddings >= 2);
+        }
+        CHECK(statistics.at(0).numFallbackSuccesses <= newPoses.size());
+        CHECK(pair.ligands.at(0).getMoleculePtr()->getNumConformers() == numConformers + newPoses.size());
+        CHECK(pair.embedder.getPoseGenerationStatistics().numFailedEmbeddings == 0);
+    }
+}
+
+TEST_CASE("test_pose_transplant", "[conformer_generator_tester]") {
+    EmbeddedLigandPair pair;
+    pair.embedder.setPoseTransplant(true);
+
+    auto newPoses = pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}},
+                                                                    pair.pairwiseMcs);
+
+    // the pose was built without distance geometry and keeps the target coordinates of the mcs atoms
+    REQUIRE(newPoses.size() == 1);
+    CHECK(pair.embedder.getTimeoutStatistics().empty());
+    const auto& [ligandMatch, targetMatch, mcsString] = pair.pairwiseMcs.get({0, 1}, false);
+    const auto coords = ConformerEmbedder::getLigandMcsAtomCoordsFromTargetMatch(
+        pair.ligands.at(1).getMoleculePtr()->getConformer(0).getPositions(), ligandMatch, targetMatch);
+    const auto& newConformer = pair.ligands.at(0).getMoleculePtr()->getConformer(static_cast<int>(newPoses.front()));
+    for (const auto& [atomId, pos] : coords) {
+        CHECK((newConformer.getAtomPos(atomId) - pos).length() < 1e-6);
+    }
+}
+
+TEST_CASE("test_core_match_cache", "[conformer_generator_tester]") {
+    const EmbeddedLigandPair pair;
+    const RDKit::ROMol& mol = *pair.ligands.at(0).getMoleculePtr();
+
+    const auto matches = pair.embedder.getCoreMatches(mol);
+    REQUIRE(!matches->empty());
+    CHECK(pair.embedder.getCoreMatches(mol) == matches);
+
+    // copies of the molecule share the matches
+    const RDKit::ROMol copy(mol);
+    CHECK(pair.embedder.getCoreMatches(copy) == matches);
+
+    for (const auto& [match, alignmentMap] : *matches) {
+        REQUIRE(match.size() == alignmentMap.size());
+        for (unsigned i = 0; i < match.size(); i++) {
+            CHECK(alignmentMap.at(i).first == match.at(i).second);
+            CHECK(alignmentMap.at(i).second == pair.core.core_to_ref.at(match.at(i).first));
+        }
+    }
+}
+
+TEST_CASE("test_topological_bounds_cache", "[conformer_generator_tester]") {
+    const EmbeddedLigandPair pair;
+    const RDKit::ROMol& mol = *pair.ligands.at(0).getMoleculePtr();
+
+    // the bounds were calculated by embedConformers() before the ligand copied the molecule
+    const auto bounds = ConformerEmbedder::getTopologicalBounds(mol);
+    REQUIRE(bounds->numRows() == mol.getNumAtoms());
+    CHECK(ConformerEmbedder::getTopologicalBounds(mol) == bounds);
+    const RDKit::ROMol copy(mol);
+    CHECK(ConformerEmbedder::getTopologicalBounds(copy) == bounds);
+
+    // the bounds only depend on the topology, a new molecule gets the same values
+    const auto fresh = ConformerEmbedder::getTopologicalBounds(*ROMolFromSmiles(FIRST_SMILES));
+    CHECK(fresh != bounds);
+    for (unsigned i = 0; i < mol.getNumAtoms(); i++) {
+        for (unsigned j = 0; j < mol.getNumAtoms(); j++) {
+            CHECK(fresh->getVal(i, j) == bounds->getVal(i, j));
+        }
+    }
+
+    // bonded atoms are about one bond length apart
+    CHECK(bounds->getLowerBound(0, 1) > 1.0);
+    CHECK(bounds->getUpperBound(0, 1) < 2.0);
+}
+
+TEST_CASE("test_cached_conformers_topology", "[conformer_generator_tester]") {
+    const auto core = calculate_core();
+    const TemporaryDirectory cacheDir("coaler_test_cached_conformers_topology");
+    auto cache = std::make_shared<coaler::io::ConformerCache>(cacheDir.getPath(), 1024 * 1024);
+
+    ConformerEmbedder embedder(core, 1, true);
+    embedder.setConformerCache(cache);
+    embedder.embedConformers(ROMolFromSmiles(FIRST_SMILES), 5);
+
+    // molecules loaded from the cache get the same topology data as embedded ones
+    auto cached = ROMolFromSmiles(FIRST_SMILES);
+    embedder.embedConformers(cached, 5);
+    REQUIRE(cached->getNumConformers() == 5);
+    CHECK(cached->hasProp("_coalerCoreMatches"));
+    CHECK(cached->hasProp("_coalerBoundsMatrix"));
+    CHECK(cached->hasProp("_coalerUFFParams"));
+}
+
+TEST_CASE("test_core_tethered_embedding", "[conformer_generator_tester]") {
+    auto mol1 = ROMolFromSmiles("c1ccncc1CCCO");
+    auto mol2 = ROMolFromSmiles("c1c(O)cc(O)cc1O");
+
+    core::Matcher matcher(1);
+
+    RDKit::MOL_SPTR_VECT mols = {mol1, mol2};
+    auto core = matcher.calculateCoreMcs(mols).value();
+
+    // the core rmsd of every conformer at the best of its core matches
+    const auto getCoreRmsds = [&core](bool tethered) {
+        auto mol = ROMolFromSmiles("c1ccncc1CCCO");
+        ConformerEmbedder embedder(core, 1, true);
+        embedder.setCoreTethered(tethered);
+        embedder.embedConformers(mol, 10);
+        REQUIRE(mol->getNumConformers() == 10);
+
+        std::vector<double> rmsds;
+        for (unsigned confId = 0; confId < mol->getNumConformers(); confId++) {
+            double bestRmsd = std::numeric_limits<double>::max();
+            for (const auto& coreMatch : *embedder.getCoreMatches(*mol)) {
+                RDGeom::Transform3D transform;
+                bestRmsd = std::min(bestRmsd, RDKit::MolAlign::getAlignmentTransform(*mol, *core.ref, transform,
+                                                                                      static_cast<int>(confId), -1,
+                                                                                      &coreMatch.alignmentMap));
+            }
+            rmsds.push_back(bestRmsd);
+        }
+        return rmsds;
+    };
+
+    // tethered conformers keep the exact core geometry, minimized free conformers deviate from it
+    const std::vector<double> tethered = getCoreRmsds(true);
+    const std::vector<double> untethered = getCoreRmsds(false);
+    for (const double rmsd : tethered) {
+        CHECK(rmsd < 0.05);
+    }
+    CHECK(*std::max_element(tethered.begin(), tethered.end())
+          < *std::max_element(untethered.begin(), untethered.end()));
+}
+
+TEST_CASE("test_generation_seeds", "[conformer_generator_tester]") {
+    EmbeddedLigandPair pair;
+
+    const auto first = pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}},
+                                                                       pair.pairwiseMcs, false, 1);
+    REQUIRE(first.size() == 1);
+
+    // the same attempt reproduces the same embedding, which is discarded as a duplicate
+    const auto repeated = pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}},
+                                                                          pair.pairwiseMcs, false, 1);
+    CHECK(repeated.empty());
+
+    // another attempt is seeded differently
+    const auto next = pair.embedder.generateNewPosesForAssemblyLigand(pair.ligands.at(0), pair.targets, {{1, 0}},
+                                                                      pair.pairwiseMcs, false, 2);
+    CHECK(next.size() == 1);
+}
+
+TEST_CASE("test_minimize_new_conformers", "[conformer_generator_tester]") {
+    auto mol = ROMolFromSmiles("c1ccccc1CCCO");
+    RDKit::DGeomHelpers::EmbedParameters params = RDKit::DGeomHelpers::srETKDGv3;
+    params.randomSeed = 42;
+    RDKit::DGeomHelpers::EmbedMultipleConfs(*mol, 3, params);
+    REQUIRE(mol->getNumConformers() == 3);
+    const RDGeom::POINT3D_VECT untouched = mol->getConformer(0).getPositions();
+
+    const auto results = ConformerEmbedder::minimizeConformers(*mol, {1, 2}, 2);
+    REQUIRE(results.size() == 2);
+
+    // conformer 0 was not requested and keeps its coordinates
+    for (unsigned atomId = 0; atomId < mol->getNumAtoms(); atomId++) {
+        CHECK((mol->getConformer(0).getAtomPos(atomId) - untouched.at(atomId)).length() == 0);
+    }
+
+    // minimizing again does not lower the energy notably
+    const auto again = ConformerEmbedder::minimizeConformers(*mol, {1, 2}, 1);
+    for (unsigned i = 0; i < results.size(); i++) {
+        CHECK(again.at(i).second == Approx(results.at(i).second).margin(0.1));
+    }
+}
+
+TEST_CASE("test_parallel_embedding_tasks", "[conformer_generator_tester]") {
+    const auto core = calculate_core();
+
+    // the conformers do not depend on the number of threads
+    RDKit::MOL_SPTR_VECT sequential = {ROMolFromSmiles(FIRST_SMILES), ROMolFromSmiles(SECOND_SMILES)};
+    RDKit::MOL_SPTR_VECT parallel = {ROMolFromSmiles(FIRST_SMILES), ROMolFromSmiles(SECOND_SMILES)};
+    ConformerEmbedder(core, 1, true).embedConformers(sequential, {12, 7});
+    ConformerEmbedder(core, 4, true).embedConformers(parallel, {12, 7});
+
+    for (unsigned molIndex = 0; molIndex < sequential.size(); molIndex++) {
+        const RDKit::ROMol& first = *sequential.at(molIndex);
+        const RDKit::ROMol& second = *parallel.at(molIndex);
+        REQUIRE(first.getNumConformers() == second.getNumConformers());
+        for (int confId = 0; confId < static_cast<int>(first.getNumConformers()); confId++) {
+            for (unsigned atomId = 0; atomId < first.getNumAtoms(); atomId++) {
+                CHECK((first.getConformer(confId).getAtomPos(atomId) - second.getConformer(confId).getAtomPos(atomId))
+                          .length()
+                      < 1e-6);
+            }
+        }
+    }
+    CHECK(sequential.at(0)->getNumConformers() == 12);
+}
@@ -0,0 +1,55 @@
+#include <GraphMol/Conformer.h>
+
+#include <catch2/catch.hpp>
+
+#include "coaler/embedder/ConformerFilter.hpp"
+#include "test_helper.h"
+
+using namespace coaler::embedder;
+
+namespace {
+    // adds a conformer with all atoms on the x axis, shifted by offset
+    void add_line_conformer(RDKit::ROMol& mol, int id, double offset) {
+        auto* conformer = new RDKit::Conformer(mol.getNumAtoms());
+        conformer->setId(id);
+        for (unsigned i = 0; i < mol.getNumAtoms(); i++) {
+            conformer->setAtomPos(i, RDGeom::Point3D(i + offset, 0, 0));
+        }
+        mol.addConformer(conformer, false);
+    }
+}  // namespace
+
+TEST_CASE("test_conformer_filter", "[conformer_filter]") {
+    auto mol = ROMolFromSmiles("Cc1ccccc1");
+
+    // conformer 1 duplicates conformer 0, conformer 3 is far above the energy window
+    add_line_conformer(*mol, 0, 0);
+    add_line_conformer(*mol, 1, 0.01);
+    add_line_conformer(*mol, 2, 2);
+    add_line_conformer(*mol, 3, 4);
+    const std::vector<std::pair<int, double>> energies = {{0, 10.0}, {0, 11.0}, {0, 12.0}, {0, 100.0}};
+
+    SECTION("disabled") {
+        const ConformerFilter filter(0, 0);
+        CHECK(!filter.isEnabled());
+        CHECK(filter.filter(*mol, energies) == 4);
+    }
+
+    SECTION("energy window and rmsd") {
+        const ConformerFilter filter(25, 0.3);
+        REQUIRE(filter.isEnabled());
+        CHECK(filter.filter(*mol, energies) == 2);
+
+        // the remaining conformers are 0 and 2, renumbered to 0 and 1
+        REQUIRE(mol->getNumConformers() == 2);
+        CHECK(mol->getConformer(0).getAtomPos(0).x == 0);
+        CHECK(mol->getConformer(1).getAtomPos(0).x == 2);
+    }
+
+    SECTION("lowest energy duplicate is kept") {
+        const std::vector<std::pair<int, double>> reversed = {{0, 11.0}, {0, 10.0}, {0, 12.0}, {0, 13.0}};
+        const ConformerFilter filter(0, 0.3);
+        CHECK(filter.filter(*mol, reversed) == 3);
+        CHECK(mol->getConformer(0).getAtomPos(0).x == 0.01);
+    }
+}
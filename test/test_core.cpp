@@ -1,9 +1,14 @@
+#include <GraphMol/MolOps.h>
 #include <GraphMol/RDKitBase.h>
 #include <GraphMol/ROMol.h>
 #include <GraphMol/SmilesParse/SmartsWrite.h>
+#include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <catch2/catch.hpp>
+#include <chrono>
 #include <string>
+#include <thread>
 
 #include "coaler/core/Matcher.hpp"
 #include "coaler/io/FileParser.hpp"
@@ -60,4 +65,111 @@ TEST_CASE("Core_Murcko", "[core]") {
         CHECK(RDKit::MolToSmarts(*largeCoreMurcko.value().core)
           == "[#6&!R]-&!@[#6&!R](-&!@[#17,#6,#9;!R])-&!@[#8&!R]-&!@[#6&!R](-&!@[#7,#6;!R]-,=;!@[#8&!R])-&!@[#6&!R](-&!@[#6]1:&@[#6]:&@[#7,#6]:&@[#6]:&@[#7,#6]:&@[#6]:&@1)-&!@[#6&!R]-&!@[#6]1:&@[#7,#6]:&@[#6]:&@[#6]:&@[#6]2:&@[#6]:&@1:&@[#6]:&@[#6]:&@[#6]:&@[#6]:&@2");
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Murcko_Scaffold_Extraction", "[core]") {
+    // the propyl side chain is removed, the methyl group on the linker stays
+    auto mol = MolFromSmiles("c1ccccc1C(C)Cc1ccccc1CCC");
+    auto scaffold = Matcher::extractMurckoScaffold(*mol);
+    RDKit::MolOps::sanitizeMol(*scaffold);
+
+    CHECK(RDKit::MolToSmiles(*scaffold) == RDKit::MolToSmiles(*MolFromSmiles("CC(Cc1ccccc1)c1ccccc1")));
+}
+
+TEST_CASE("Murcko_Scaffold_Benchmark", "[.benchmark]") {
+    Matcher matcher(1);
+    for (const std::string size : {"Small", "Medium", "Large", "Huge"}) {
+        RDKit::MOL_SPTR_VECT mols = coaler::io::FileParser::parse("test/data/testMurcko" + size + ".smi");
+        auto mcs = matcher.calculateCoreMcs(mols);
+        REQUIRE(mcs.has_value());
+        RDKit::RWMol core = *mcs->core;
+        RDKit::MolOps::sanitizeMol(core);
+
+        const unsigned repetitions = 1000;
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < repetitions; i++) {
+            auto scaffold = Matcher::extractMurckoScaffold(core);
+            REQUIRE(scaffold->getNumAtoms() <= core.getNumAtoms());
+        }
+        const auto duration = std::chrono::steady_clock::now() - start;
+
+        spdlog::info("murcko {}: {} core atoms, {} us per scaffold", size, core.getNumAtoms(),
+                     std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / repetitions);
+    }
+}
+
+TEST_CASE("Core_Hierarchical", "[core]") {
+    Matcher matcher(2);
+    RDKit::MOL_SPTR_VECT mols = coaler::io::FileParser::parse("test/data/testMurckoMedium.smi");
+    auto core = matcher.calculateCoreHierarchical(mols);
+    REQUIRE(core.has_value());
+    CHECK(core->core->getNumAtoms() > 0);
+
+    RDKit::SubstructMatchParameters params;
+    params.useChirality = false;
+    for (const auto& mol : mols) {
+        CHECK(!RDKit::SubstructMatch(*mol, *core->core, params).empty());
+    }
+}
+
+TEST_CASE("Core_Generalize_Fragment", "[core]") {
+    auto fragment = MolFromSmiles("c1ccccc1CO");
+    RDKit::MOL_SPTR_VECT mols = {MolFromSmiles("c1ccccc1CCO"), MolFromSmiles("Cc1ccncc1CN")};
+
+    auto query = Matcher::generalizeFragment(*fragment, mols);
+    REQUIRE(query != nullptr);
+    CHECK(query->getNumAtoms() == fragment->getNumAtoms());
+
+    RDKit::SubstructMatchParameters params;
+    params.useChirality = false;
+    for (const auto& mol : mols) {
+        CHECK(!RDKit::SubstructMatch(*mol, *query, params).empty());
+    }
+
+    // the ring of the fragment must not be matched onto chain atoms
+    RDKit::MOL_SPTR_VECT acyclic = {MolFromSmiles("CCCCCCCCO")};
+    CHECK(Matcher::generalizeFragment(*fragment, acyclic) == nullptr);
+}
+
+TEST_CASE("Core_Portfolio", "[core]") {
+    auto mol1 = MolFromSmiles("c1cc(ccc1N2CCOCC2=O)N3C[C@@H](OC3=O)CNC(=O)c4ccc(s4)Cl");
+    auto mol2 = MolFromSmiles("CC1(C(=O)N(C(=S)N1c2ccc(c(c2)F)C(=O)NC)c3ccc(c(c3)C(F)(F)F)C#N)C");
+    RDKit::MOL_SPTR_VECT mols = {mol1, mol2};
+
+    Matcher matcher(2);
+    auto portfolio = matcher.calculateCorePortfolio(mols);
+    REQUIRE(portfolio.has_value());
+
+    // the result depends on which variants finish in time, but it is above the minimum core size
+    const unsigned smallest = std::min(mol1->getNumAtoms(), mol2->getNumAtoms());
+    CHECK(portfolio->core->getNumAtoms() >= smallest / 5);
+
+    RDKit::SubstructMatchParameters params;
+    params.useChirality = false;
+    for (const auto& mol : mols) {
+        CHECK(!RDKit::SubstructMatch(*mol, *portfolio->core, params).empty());
+    }
+}
+
+TEST_CASE("Core_Hierarchical_Benchmark", "[.benchmark]") {
+    Matcher matcher(static_cast<int>(std::thread::hardware_concurrency()));
+    for (const std::string file : {"test/data/testMurckoHuge.smi", "test/data/AID_1806504.smi"}) {
+        RDKit::MOL_SPTR_VECT mols = coaler::io::FileParser::parse(file);
+
+        auto start = std::chrono::steady_clock::now();
+        auto flat = matcher.calculateCoreMcs(mols);
+        auto flatDuration = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        auto hierarchical = matcher.calculateCoreHierarchical(mols);
+        auto hierarchicalDuration = std::chrono::steady_clock::now() - start;
+
+        REQUIRE(flat.has_value());
+        REQUIRE(hierarchical.has_value());
+        spdlog::info("{}: flat mcs {} atoms in {} ms, hierarchical mcs {} atoms in {} ms", file,
+                     flat->core->getNumAtoms(),
+                     std::chrono::duration_cast<std::chrono::milliseconds>(flatDuration).count(),
+                     hierarchical->core->getNumAtoms(),
+                     std::chrono::duration_cast<std::chrono::milliseconds>(hierarchicalDuration).count());
+    }
+}
@@ -1,6 +1,10 @@
 //
 // Created by niklas on 12/9/23.
 //
+#include <filesystem>
+#include <random>
+#include <string>
+
 #include "GraphMol/RWMol.h"
 #include "GraphMol/SmilesParse/SmilesParse.h"
 
@@ -14,6 +18,34 @@ namespace {
     RDKit::ROMOL_SPTR ROMolFromSmiles(const std::string &smiles) {
         return boost::make_shared<RDKit::ROMol>(*RDKit::SmilesToMol(smiles));
     }
+
+    /**
+     * A uniquely named directory in the system temp directory that is removed on destruction, so parallel test runs
+     * neither collide nor see the state of earlier runs.
+     */
+    class TemporaryDirectory {
+      public:
+        explicit TemporaryDirectory(const std::string &prefix) {
+            std::random_device device;
+            do {
+                m_path = std::filesystem::temp_directory_path()
+                         / (prefix + "_" + std::to_string(device()) + std::to_string(device()));
+            } while (!std::filesystem::create_directories(m_path));
+        }
+
+        ~TemporaryDirectory() {
+            std::error_code error;
+            std::filesystem::remove_all(m_path, error);
+        }
+
+        TemporaryDirectory(const TemporaryDirectory &) = delete;
+        TemporaryDirectory &operator=(const TemporaryDirectory &) = delete;
+
+        [[nodiscard]] std::string getPath() const { return m_path.string(); }
+
+      private:
+        std::filesystem::path m_path;
+    };
 }  // namespace
 
 #endif  // COALER_TEST_HELPER_H
@@ -0,0 +1,52 @@
+#include <GraphMol/Conformer.h>
+
+#include <catch2/catch.hpp>
+#include <cmath>
+
+#include "coaler/embedder/KabschSuperposer.hpp"
+
+using namespace coaler::embedder;
+
+TEST_CASE("test_kabsch_superposer", "[kabsch_superposer]") {
+    const RDGeom::POINT3D_VECT reference
+        = {{0, 0, 0}, {1.5, 0, 0}, {1.5, 1.5, 0}, {0, 1.5, 0.5}, {-0.7, 0.3, 1.2}, {2.1, -0.4, 0.8}};
+
+    // probe 0 is the reference rotated by 90 degrees around z and translated, probe 1 is distorted
+    RDGeom::POINT3D_VECT rotated;
+    RDGeom::POINT3D_VECT distorted;
+    for (const auto& pos : reference) {
+        rotated.emplace_back(-pos.y + 3, pos.x - 2, pos.z + 1);
+        distorted.emplace_back(pos.x * 1.5, pos.y, pos.z);
+    }
+
+    KabschSuperposer superposer(reference);
+    superposer.addProbe(rotated);
+    superposer.addProbe(distorted);
+    REQUIRE(superposer.getNumProbes() == 2);
+
+    const auto transforms = superposer.superpose();
+    REQUIRE(transforms.size() == 2);
+    CHECK(transforms.at(0).rmsd == Approx(0).margin(1e-6));
+    CHECK(transforms.at(1).rmsd > 0.1);
+
+    RDKit::Conformer conformer(rotated.size());
+    for (unsigned atomId = 0; atomId < rotated.size(); atomId++) {
+        conformer.setAtomPos(atomId, rotated.at(atomId));
+    }
+    transforms.at(0).apply(conformer);
+    for (unsigned atomId = 0; atomId < reference.size(); atomId++) {
+        CHECK((conformer.getAtomPos(atomId) - reference.at(atomId)).length() == Approx(0).margin(1e-6));
+    }
+
+    // the rmsd is the one of the applied transform
+    RDKit::Conformer distortedConformer(distorted.size());
+    for (unsigned atomId = 0; atomId < distorted.size(); atomId++) {
+        distortedConformer.setAtomPos(atomId, distorted.at(atomId));
+    }
+    transforms.at(1).apply(distortedConformer);
+    double squaredDeviation = 0;
+    for (unsigned atomId = 0; atomId < reference.size(); atomId++) {
+        squaredDeviation += (distortedConformer.getAtomPos(atomId) - reference.at(atomId)).lengthSq();
+    }
+    CHECK(std::sqrt(squaredDeviation / reference.size()) == Approx(transforms.at(1).rmsd).margin(1e-6));
+}
@@ -25,8 +25,8 @@ TEST_CASE("basic_test", "[multialigner_tester]") {
 
     coaler::embedder::ConformerEmbedder embedder(coreResult, 1, true);
 
-    core::PairwiseMCSMap mcsMap;
-    multialign::AssemblyOptimizer optimizer(mcsMap, mcsMap, embedder, 1, 0.5, 100, 1);
+    core::PairwiseMCSProvider pairwiseMcs(multialign::LigandVector(mols), "");
+    multialign::AssemblyOptimizer optimizer(pairwiseMcs, embedder, 1, 0.5, 100, 1);
     multialign::MultiAligner aligner(mols, optimizer, coreResult, 2);
     multialign::MultiAlignerResult result = aligner.alignMolecules();
 
@@ -1,11 +1,34 @@
+#include <GraphMol/FMCS/FMCS.h>
+#include <GraphMol/MolOps.h>
 #include <spdlog/spdlog.h>
 
+#include <numeric>
+
 #include "GraphMol/SmilesParse/SmartsWrite.h"
 #include "GraphMol/SmilesParse/SmilesWrite.h"
 #include "catch2/catch.hpp"
+#include "coaler/core/CoreSeededMCS.hpp"
 #include "coaler/core/Matcher.hpp"
+#include "coaler/core/PairwiseMCSCalculator.hpp"
+#include "coaler/core/PairwiseMCSProvider.hpp"
+#include "coaler/io/PairwiseMCSCache.hpp"
 #include "test_helper.h"
 
+namespace {
+    // all matches of the core in every ligand, like the matches of ConformerEmbedder::getCoreMatches()
+    std::vector<std::vector<RDKit::MatchVectType>> get_core_matches(const coaler::multialign::LigandVector& ligands,
+                                                                    const std::string& coreSmarts) {
+        std::unique_ptr<RDKit::ROMol> core(RDKit::SmartsToMol(coreSmarts));
+        RDKit::SubstructMatchParameters params;
+        params.uniquify = false;
+        std::vector<std::vector<RDKit::MatchVectType>> matches;
+        for (const auto& ligand : ligands) {
+            matches.push_back(RDKit::SubstructMatch(*ligand.getMoleculePtr(), *core, params));
+        }
+        return matches;
+    }
+}  // namespace
+
 TEST_CASE("mcs contains core", "[core]") {
     auto mol1 = MolFromSmiles("c1ccccc1CC1CCCCCC1");
     auto mol2 = MolFromSmiles("c1ccccc1CCC1CCCCCC1");
@@ -44,3 +67,234 @@ TEST_CASE("mcs contains core", "[core]") {
         CHECK(!containsCore.empty());
     }
 }
+
+TEST_CASE("fused pairwise mcs", "[core]") {
+    coaler::multialign::LigandVector ligands;
+    coaler::multialign::LigandID id = 0;
+    for (const auto* smiles : {"c1ccccc1CC1CCCCCC1", "c1ccccc1CCC1CCCCCC1", "c1ccccc1C", "c1ccncc1CCO"}) {
+        auto mol = MolFromSmiles(smiles);
+        RDKit::MolOps::addHs(*mol);
+        ligands.push_back(coaler::multialign::Ligand(*mol, {}, id));
+        id++;
+    }
+
+    const coaler::core::PairwiseMCSCalculator calculator(ligands, "");
+    const auto [strictMap, relaxedMap] = calculator.calculateAll();
+    REQUIRE(strictMap.size() == 6);
+    REQUIRE(relaxedMap.size() == 6);
+
+    // reference: an independent RDKit::findMCS run per pair on the hydrogen free molecules
+    for (const auto& [pair, strictMcs] : strictMap) {
+        const RDKit::MOL_SPTR_VECT molPair{
+            RDKit::ROMOL_SPTR(RDKit::MolOps::removeHs(ligands.at(pair.getFirst()).getMolecule())),
+            RDKit::ROMOL_SPTR(RDKit::MolOps::removeHs(ligands.at(pair.getSecond()).getMolecule()))};
+
+        for (const bool strict : {true, false}) {
+            RDKit::MCSParameters params = strict ? coaler::core::Matcher::getStrictMCSParams()
+                                                 : coaler::core::Matcher::getRelaxedMCSParams();
+            const RDKit::MCSResult expected = RDKit::findMCS(molPair, &params);
+            const auto& [firstMatch, secondMatch, smarts] = strict ? strictMcs : relaxedMap.at(pair);
+
+            CHECK(smarts == expected.SmartsString);
+            CHECK(firstMatch.size() == expected.NumAtoms);
+            CHECK(secondMatch.size() == expected.NumAtoms);
+        }
+    }
+}
+
+TEST_CASE("lazy pairwise mcs", "[core]") {
+    coaler::multialign::LigandVector ligands;
+    coaler::multialign::LigandID id = 0;
+    for (const auto* smiles : {"c1ccccc1CC1CCCCCC1", "c1ccccc1CCC1CCCCCC1", "c1ccccc1C"}) {
+        ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles(smiles), {}, id));
+        id++;
+    }
+    const coaler::multialign::LigandPair pair(2, 0);
+
+    coaler::core::PairwiseMCSProvider lazy(ligands, "");
+    CHECK(lazy.getNumPairs() == 3);
+    CHECK(lazy.getNumComputed() == 0);
+
+    const auto& relaxed = lazy.get(pair, false);
+    CHECK(&lazy.get(pair, false) == &relaxed);
+    CHECK(lazy.getNumComputed() == 1);
+    CHECK(lazy.getNumRequested() == 1);
+    CHECK(lazy.getNumUnusedPairs() == 2);
+
+    coaler::core::PairwiseMCSProvider eager(ligands, "");
+    eager.computeAll();
+    CHECK(eager.getNumComputed() == 6);
+    CHECK(eager.getNumUnusedPairs() == 3);
+    CHECK(eager.get(pair, false) == relaxed);
+    CHECK(eager.get(pair, true) == lazy.get(pair, true));
+}
+
+TEST_CASE("pairwise mcs feasibility", "[core]") {
+    coaler::multialign::LigandVector ligands;
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("C[C@H](N)c1ccccc1"), {}, 0));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("C[C@@H](N)c1ccccc1"), {}, 1));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("CC(N)c1ccccc1"), {}, 2));
+
+    coaler::core::PairwiseMCSProvider provider(ligands, "c1ccccc1");
+
+    // opposite chiral tags can not be embedded onto each other
+    const auto& enantiomers = provider.getFeasibility({0, 1});
+    CHECK(provider.getNumComputed() == 1);
+    CHECK(enantiomers.firstCoverage == 1.0);
+    CHECK(enantiomers.secondCoverage == 1.0);
+    CHECK(!enantiomers.firstChiralityCompatible);
+    CHECK(!enantiomers.secondChiralityCompatible);
+
+    // a chiral center can be embedded onto an unspecified one but not the other way around
+    const auto& racemate = provider.getFeasibility({0, 2});
+    CHECK(racemate.firstChiralityCompatible);
+    CHECK(!racemate.secondChiralityCompatible);
+}
+
+TEST_CASE("pairwise mcs prescreen", "[core]") {
+    coaler::multialign::LigandVector ligands;
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1CCCCCCCCCCCC(=O)O"), {}, 0));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1N1CCOCC1"), {}, 1));
+    const coaler::multialign::LigandPair pair(0, 1);
+
+    coaler::core::PairwiseMCSCalculator calculator(ligands, "c1ccccc1");
+    calculator.setPrescreenThreshold(0.9);
+    auto mcsParams = coaler::core::Matcher::getRelaxedMCSParams();
+    const auto [firstMatch, secondMatch, smarts] = calculator.calculate(pair, false, mcsParams);
+
+    // dissimilar pairs are resolved with the matches of the seed
+    CHECK(calculator.getNumPrescreened() == 1);
+    CHECK(smarts == "c1ccccc1");
+    CHECK(firstMatch.size() == 6);
+    CHECK(secondMatch.size() == 6);
+}
+
+TEST_CASE("core seeded pairwise mcs", "[core]") {
+    coaler::multialign::LigandVector ligands;
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1CCO"), {}, 0));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1CCN"), {}, 1));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1C1CCCC1"), {}, 2));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1C1CCCCC1"), {}, 3));
+
+    coaler::core::PairwiseMCSCalculator calculator(ligands, "c1ccccc1");
+    calculator.setAlgorithm(coaler::core::PairwiseMCSAlgorithm::CoreGrowth, get_core_matches(ligands, "c1ccccc1"));
+    auto mcsParams = coaler::core::Matcher::getRelaxedMCSParams();
+
+    // relaxed growth maps the hetero atoms onto each other, strict growth stops before them
+    const auto [relaxedFirst, relaxedSecond, relaxedSmarts] = calculator.calculate({0, 1}, false, mcsParams);
+    CHECK(relaxedFirst.size() == 9);
+    CHECK(relaxedSecond.size() == 9);
+    const auto [strictFirst, strictSecond, strictSmarts] = calculator.calculate({0, 1}, true, mcsParams);
+    CHECK(strictFirst.size() == 8);
+    CHECK(strictSecond.size() == 8);
+
+    // rings of different size are never mapped partially
+    const auto [ringFirst, ringSecond, ringSmarts] = calculator.calculate({2, 3}, false, mcsParams);
+    CHECK(ringFirst.size() == 6);
+    CHECK(ringSecond.size() == 6);
+
+    // matches are pairs of (query id, atom id) with the same query ids in both molecules
+    for (unsigned i = 0; i < relaxedFirst.size(); i++) {
+        CHECK(relaxedFirst.at(i).first == relaxedSecond.at(i).first);
+        CHECK(ligands.at(0).getMolecule().getAtomWithIdx(relaxedFirst.at(i).second)->getAtomicNum() != 1);
+    }
+
+    // the SMARTS is generalized to the elements of both molecules
+    std::unique_ptr<RDKit::ROMol> relaxedQuery(RDKit::SmartsToMol(relaxedSmarts));
+    RDKit::MatchVectType match;
+    CHECK(relaxedQuery->getNumAtoms() == 9);
+    CHECK(RDKit::SubstructMatch(ligands.at(0).getMolecule(), *relaxedQuery, match));
+    CHECK(RDKit::SubstructMatch(ligands.at(1).getMolecule(), *relaxedQuery, match));
+}
+
+TEST_CASE("core seeded pairwise mcs growth and chirality", "[core]") {
+    coaler::multialign::LigandVector ligands;
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1C(C)CCCC"), {}, 0));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1C(CCCC)C"), {}, 1));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("C[C@H](O)c1ccccc1"), {}, 2));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("O[C@@H](C)c1ccccc1"), {}, 3));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("C[C@@H](O)c1ccccc1"), {}, 4));
+
+    coaler::core::PairwiseMCSCalculator calculator(ligands, "c1ccccc1");
+    calculator.setAlgorithm(coaler::core::PairwiseMCSAlgorithm::CoreGrowth, get_core_matches(ligands, "c1ccccc1"));
+    auto mcsParams = coaler::core::Matcher::getStrictMCSParams();
+
+    // the long chains are mapped onto each other regardless of the order of the neighbors
+    const auto [chainFirst, chainSecond, chainSmarts] = calculator.calculate({0, 1}, false, mcsParams);
+    CHECK(chainFirst.size() == 12);
+
+    // the same stereo center written in a different atom order is mapped, the enantiomer is not
+    const auto [sameFirst, sameSecond, sameSmarts] = calculator.calculate({2, 3}, true, mcsParams);
+    CHECK(sameFirst.size() == 9);
+    const auto [enantiomerFirst, enantiomerSecond, enantiomerSmarts] = calculator.calculate({2, 4}, true, mcsParams);
+    CHECK(enantiomerFirst.size() == 6);
+}
+
+TEST_CASE("core seeded pairwise mcs strict core atoms", "[core]") {
+    coaler::multialign::LigandVector ligands;
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccncc1CCO"), {}, 0));
+    ligands.push_back(coaler::multialign::Ligand(*MolFromSmiles("c1ccccc1CCO"), {}, 1));
+
+    // the core generalizes the nitrogen of the first ligand
+    const std::string coreSmarts = "[#6]1:[#6]:[#6]:[#6,#7]:[#6]:[#6]:1";
+    coaler::core::PairwiseMCSCalculator calculator(ligands, coreSmarts);
+    calculator.setAlgorithm(coaler::core::PairwiseMCSAlgorithm::CoreGrowth, get_core_matches(ligands, coreSmarts));
+    auto mcsParams = coaler::core::Matcher::getStrictMCSParams();
+
+    const auto [relaxedFirst, relaxedSecond, relaxedSmarts] = calculator.calculate({0, 1}, false, mcsParams);
+    CHECK(relaxedFirst.size() == 9);
+
+    // the strict MCS leaves out the core atom of different elements
+    const auto [strictFirst, strictSecond, strictSmarts] = calculator.calculate({0, 1}, true, mcsParams);
+    CHECK(strictFirst.size() == 8);
+    for (const auto& [queryId, atomId] : strictFirst) {
+        CHECK(ligands.at(0).getMoleculePtr()->getAtomWithIdx(atomId)->getAtomicNum() != 7);
+    }
+}
+
+TEST_CASE("pairwise mcs cache", "[core]") {
+    const TemporaryDirectory cacheDir("coaler_test_pairwise_mcs_cache");
+    coaler::io::PairwiseMCSCache cache(cacheDir.getPath(), 1024 * 1024);
+
+    auto mol1 = MolFromSmiles("c1ccccc1CC1CCCCCC1");
+    auto mol2 = MolFromSmiles("c1ccccc1CCC1CCCCCC1");
+    coaler::multialign::LigandVector ligands;
+    ligands.push_back(coaler::multialign::Ligand(*mol1, {}, 0));
+    ligands.push_back(coaler::multialign::Ligand(*mol2, {}, 1));
+
+    const auto uncached = coaler::core::Matcher::calcPairwiseMCS(ligands, true, "", &cache);
+    const auto cached = coaler::core::Matcher::calcPairwiseMCS(ligands, true, "", &cache);
+    const coaler::multialign::LigandPair pair(0, 1);
+    CHECK(cached.at(pair) == uncached.at(pair));
+
+    const auto canonical1 = coaler::io::PairwiseMCSCache::getCanonicalMolecule(*mol1);
+    const auto canonical2 = coaler::io::PairwiseMCSCache::getCanonicalMolecule(*mol2);
+
+    SECTION("empty results are not stored") {
+        cache.store(canonical1, canonical2, false, "", {});
+        CHECK(!cache.load(canonical1, canonical2, false, "").has_value());
+    }
+
+    SECTION("molecules in reversed order and with permuted atoms") {
+        std::vector<unsigned> newOrder(mol1->getNumAtoms());
+        std::iota(newOrder.rbegin(), newOrder.rend(), 0);
+        std::unique_ptr<RDKit::ROMol> renumbered(RDKit::MolOps::renumberAtoms(*mol1, newOrder));
+
+        auto reloaded = cache.load(canonical2, coaler::io::PairwiseMCSCache::getCanonicalMolecule(*renumbered), true,
+                                   "");
+        REQUIRE(reloaded.has_value());
+
+        const auto& [firstMatch, secondMatch, smarts] = uncached.at(pair);
+        const auto& [reloadedSecondMatch, reloadedFirstMatch, reloadedSmarts] = reloaded.value();
+        CHECK(smarts == reloadedSmarts);
+        CHECK(reloadedSecondMatch == secondMatch);
+        REQUIRE(reloadedFirstMatch.size() == firstMatch.size());
+
+        // the reloaded match has to be a valid match of the mcs in the renumbered molecule
+        auto* mcsQuery = RDKit::SmartsToMol(smarts);
+        for (const auto& [queryId, molId] : reloadedFirstMatch) {
+            CHECK(mcsQuery->getAtomWithIdx(queryId)->Match(renumbered->getAtomWithIdx(molId)));
+        }
+        delete mcsQuery;
+    }
+}
@@ -0,0 +1,49 @@
+#include <GraphMol/Substruct/SubstructMatch.h>
+
+#include <catch2/catch.hpp>
+
+#include "coaler/embedder/SubstructureAnalyzer.hpp"
+#include "test_helper.h"
+
+using namespace coaler::embedder;
+
+namespace {
+    std::vector<RDKit::MatchVectType> get_all_matches(const RDKit::ROMol& molecule, const RDKit::ROMol& query) {
+        RDKit::SubstructMatchParameters params;
+        params.uniquify = false;
+        params.maxMatches = 1000;
+        return RDKit::SubstructMatch(molecule, query, params);
+    }
+}  // namespace
+
+TEST_CASE("test_group_symmetry_equivalent_matches", "[substructure_analyzer]") {
+    auto core = ROMolFromSmiles("c1ccccc1");
+
+    SECTION("one substituent") {
+        auto mol = ROMolFromSmiles("Cc1ccccc1");
+        const auto matches = get_all_matches(*mol, *core);
+        REQUIRE(matches.size() == 12);
+
+        const auto groups = SubstructureAnalyzer::groupSymmetryEquivalentMatches(*mol, matches);
+        CHECK(groups.size() == 6);
+        for (const auto& group : groups) {
+            CHECK(group.size() == 2);
+        }
+        CHECK(groups.front().front() == 0);
+    }
+
+    SECTION("two equivalent substituents") {
+        auto mol = ROMolFromSmiles("Cc1ccc(C)cc1");
+        const auto groups = SubstructureAnalyzer::groupSymmetryEquivalentMatches(*mol, get_all_matches(*mol, *core));
+        CHECK(groups.size() == 3);
+        for (const auto& group : groups) {
+            CHECK(group.size() == 4);
+        }
+    }
+
+    SECTION("no symmetry") {
+        auto mol = ROMolFromSmiles("Cc1ccc(N)c(O)c1");
+        const auto groups = SubstructureAnalyzer::groupSymmetryEquivalentMatches(*mol, get_all_matches(*mol, *core));
+        CHECK(groups.size() == 12);
+    }
+}
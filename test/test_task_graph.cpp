@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "coaler/core/TaskGraph.hpp"
+
+using namespace coaler::core;
+
+TEST_CASE("test_task_graph_dependencies", "[task_graph]") {
+    TaskGraph graph;
+    std::mutex mutex;
+    std::vector<int> order;
+    const auto record = [&](int task) {
+        return [&, task]() {
+            const std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(task);
+        };
+    };
+
+    const auto first = graph.addTask(record(0));
+    const auto second = graph.addTask(record(1));
+    const auto joined = graph.addTask(record(2), {first, second});
+    graph.addTask(record(3), {joined});
+    CHECK(graph.getNumTasks() == 4);
+
+    graph.run(4);
+    REQUIRE(order.size() == 4);
+    CHECK(order.at(2) == 2);
+    CHECK(order.at(3) == 3);
+
+    // an empty graph returns immediately
+    TaskGraph empty;
+    empty.run(2);
+}
+
+TEST_CASE("test_task_graph_priority", "[task_graph]") {
+    TaskGraph graph;
+    std::vector<int> order;
+    graph.addTask([&]() { order.push_back(0); }, {}, 0);
+    graph.addTask([&]() { order.push_back(1); }, {}, 2);
+    graph.addTask([&]() { order.push_back(2); }, {}, 1);
+    graph.addTask([&]() { order.push_back(3); }, {}, 2);
+
+    // a single thread runs the ready tasks by priority, then in the order they were added
+    graph.run(1);
+    CHECK(order == std::vector<int>{1, 3, 2, 0});
+}
+
+TEST_CASE("test_task_graph_exception", "[task_graph]") {
+    TaskGraph graph;
+    std::atomic<int> numRun{0};
+    const auto failing = graph.addTask([]() { throw std::runtime_error("task failed"); });
+    graph.addTask([&]() { numRun++; }, {failing});
+
+    CHECK_THROWS_AS(graph.run(2), std::runtime_error);
+    CHECK(numRun == 0);
+}
+
+TEST_CASE("test_task_graph_stage_threads", "[task_graph]") {
+    ThreadBudget budget(4);
+    budget.setThreads(Stage::Scoring, 1);
+
+    TaskGraph graph;
+    std::atomic<int> numRunning{0};
+    std::atomic<int> maxRunning{0};
+    std::atomic<int> numOther{0};
+    for (int i = 0; i < 8; i++) {
+        graph.addTask(
+            [&]() {
+                const int running = ++numRunning;
+                int expected = maxRunning;
+                while (running > expected && !maxRunning.compare_exchange_weak(expected, running)) {
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                numRunning--;
+            },
+            {}, 0, Stage::Scoring);
+    }
+    graph.addTask([&]() { numOther++; }, {}, 0, Stage::Embedding);
+
+    // the scoring tasks run one after the other, the remaining threads run the other stages
+    graph.run(budget);
+    CHECK(maxRunning == 1);
+    CHECK(numOther == 1);
+}
+
+TEST_CASE("test_task_graph_add_while_running", "[task_graph]") {
+    TaskGraph graph;
+    std::atomic<int> numAdded{0};
+    std::vector<int> order;
+    std::mutex mutex;
+    const auto spawning = graph.addTask([&]() {
+        // the added tasks only become known while the graph runs, the last one waits for the others
+        std::vector<TaskGraph::TaskID> added;
+        for (int i = 0; i < 4; i++) {
+            added.push_back(graph.addTask([&]() { numAdded++; }));
+        }
+        graph.addTask(
+            [&]() {
+                const std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(numAdded);
+            },
+            added);
+    });
+    graph.addTask(
+        [&]() {
+            const std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(-1);
+        },
+        {spawning});
+
+    graph.run(3);
+    CHECK(graph.getNumTasks() == 7);
+    CHECK(numAdded == 4);
+    REQUIRE(order.size() == 2);
+    CHECK(std::count(order.begin(), order.end(), 4) == 1);
+}
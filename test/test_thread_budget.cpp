@@ -0,0 +1,48 @@
+#include <omp.h>
+
+#include <algorithm>
+#include <catch2/catch.hpp>
+
+#include "coaler/core/ThreadBudget.hpp"
+
+using namespace coaler::core;
+
+TEST_CASE("test_thread_budget", "[thread_budget]") {
+    ThreadBudget budget(8);
+    CHECK(budget.getTotal() == 8);
+    CHECK(budget.getThreads(Stage::Embedding) == 8);
+
+    budget.setThreads(Stage::Embedding, 2);
+    budget.setThreads(Stage::Scoring, 16);
+    budget.setThreads(Stage::Core, 0);
+    CHECK(budget.getThreads(Stage::Embedding) == 2);
+    CHECK(budget.getThreads(Stage::Scoring) == 8);
+    CHECK(budget.getThreads(Stage::Core) == 8);
+
+    CHECK(ThreadBudget(0).getTotal() == 1);
+}
+
+TEST_CASE("test_thread_budget_nested_share", "[thread_budget]") {
+    CHECK(ThreadBudget::getNestedShare(8) == 8);
+    CHECK(ThreadBudget::getNestedShare(0) == 1);
+
+    // a nested call gets its share of the threads of the team, but at least one thread
+    std::vector<int> teamSizes(4, 0);
+    std::vector<int> shares(4, 0);
+    std::vector<int> minimalShares(4, 0);
+#pragma omp parallel num_threads(4) shared(teamSizes, shares, minimalShares)
+    {
+        const int threadId = omp_get_thread_num();
+        teamSizes.at(threadId) = omp_get_num_threads();
+        shares.at(threadId) = ThreadBudget::getNestedShare(8);
+        minimalShares.at(threadId) = ThreadBudget::getNestedShare(2);
+    }
+
+    // without omp or with fewer threads available the team is smaller than requested
+    const int teamSize = teamSizes.at(0);
+    REQUIRE(teamSize >= 1);
+    for (int i = 0; i < teamSize; i++) {
+        CHECK(shares.at(i) == std::max(8 / teamSize, 1));
+        CHECK(minimalShares.at(i) == std::max(2 / teamSize, 1));
+    }
+}
@@ -0,0 +1,44 @@
+#include <GraphMol/DistGeomHelpers/Embedder.h>
+#include <GraphMol/MolOps.h>
+
+#include <catch2/catch.hpp>
+
+#include "coaler/embedder/TorsionDriver.hpp"
+#include "test_helper.h"
+
+using namespace coaler::embedder;
+
+TEST_CASE("test_torsion_driver", "[torsion_driver]") {
+    auto mol = ROMolFromSmiles("c1ccccc1CCCCO");
+    RDKit::DGeomHelpers::EmbedParameters params = RDKit::DGeomHelpers::srETKDGv3;
+    params.randomSeed = 42;
+    RDKit::DGeomHelpers::EmbedMultipleConfs(*mol, 2, params);
+    REQUIRE(mol->getNumConformers() == 2);
+
+    const std::vector<unsigned> ring = {0, 1, 2, 3, 4, 5};
+    const TorsionDriver driver(*mol, ring);
+
+    // the bond to the ring and the chain bonds are rotatable, the bond to the terminal oxygen is not
+    CHECK(driver.getNumTorsions() == 4);
+
+    const unsigned numAdded = driver.expand(*mol, 10);
+    CHECK(numAdded > 0);
+    CHECK(numAdded <= 10);
+    CHECK(mol->getNumConformers() == 2 + numAdded);
+
+    // the fixed atoms keep the coordinates of one of the source conformers
+    for (unsigned confId = 2; confId < mol->getNumConformers(); confId++) {
+        bool keepsRing = false;
+        for (int sourceId = 0; sourceId < 2; sourceId++) {
+            bool samePositions = true;
+            for (const auto atomId : ring) {
+                samePositions &= (mol->getConformer(static_cast<int>(confId)).getAtomPos(atomId)
+                                  - mol->getConformer(sourceId).getAtomPos(atomId))
+                                     .length()
+                                 < 1e-6;
+            }
+            keepsRing |= samePositions;
+        }
+        CHECK(keepsRing);
+    }
+}